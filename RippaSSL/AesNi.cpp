@@ -0,0 +1,358 @@
+#include "AesNi.h"
+#include "error.h"
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RIPPASSL_AESNI
+#endif
+
+namespace {
+    bool detectAesNi()
+    {
+#ifdef RIPPASSL_AESNI
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2");
+#else
+        return false;
+#endif
+    }
+
+#ifdef RIPPASSL_AESNI
+    // folds the previous round key into itself, then adds the (broadcast)
+    // output of the key generation assist:
+    __attribute__((target("aes,sse2")))
+    inline __m128i expandStep(__m128i key, __m128i assist)
+    {
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        return _mm_xor_si128(key, assist);
+    }
+
+    // the round constant shall be an immediate, hence the macros:
+#define RIPPASSL_EXPAND128(i, rcon)                                          \
+    rk[i] = expandStep(rk[i - 1],                                            \
+                       _mm_shuffle_epi32(                                    \
+                           _mm_aeskeygenassist_si128(rk[i - 1], rcon), 0xFF))
+
+#define RIPPASSL_EXPAND256(i, rcon)                                          \
+    rk[i] = expandStep(rk[i - 2],                                            \
+                       _mm_shuffle_epi32(                                    \
+                           _mm_aeskeygenassist_si128(rk[i - 1], rcon), 0xFF))
+
+#define RIPPASSL_EXPAND256_ODD(i)                                            \
+    rk[i] = expandStep(rk[i - 2],                                            \
+                       _mm_shuffle_epi32(                                    \
+                           _mm_aeskeygenassist_si128(rk[i - 1], 0x00), 0xAA))
+
+    __attribute__((target("aes,sse2")))
+    void expandKey128(__m128i* rk, const uint8_t* key)
+    {
+        rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+        RIPPASSL_EXPAND128(1, 0x01);
+        RIPPASSL_EXPAND128(2, 0x02);
+        RIPPASSL_EXPAND128(3, 0x04);
+        RIPPASSL_EXPAND128(4, 0x08);
+        RIPPASSL_EXPAND128(5, 0x10);
+        RIPPASSL_EXPAND128(6, 0x20);
+        RIPPASSL_EXPAND128(7, 0x40);
+        RIPPASSL_EXPAND128(8, 0x80);
+        RIPPASSL_EXPAND128(9, 0x1B);
+        RIPPASSL_EXPAND128(10, 0x36);
+    }
+
+    __attribute__((target("aes,sse2")))
+    void expandKey256(__m128i* rk, const uint8_t* key)
+    {
+        rk[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+        rk[1] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key + 16));
+        RIPPASSL_EXPAND256(2, 0x01);
+        RIPPASSL_EXPAND256_ODD(3);
+        RIPPASSL_EXPAND256(4, 0x02);
+        RIPPASSL_EXPAND256_ODD(5);
+        RIPPASSL_EXPAND256(6, 0x04);
+        RIPPASSL_EXPAND256_ODD(7);
+        RIPPASSL_EXPAND256(8, 0x08);
+        RIPPASSL_EXPAND256_ODD(9);
+        RIPPASSL_EXPAND256(10, 0x10);
+        RIPPASSL_EXPAND256_ODD(11);
+        RIPPASSL_EXPAND256(12, 0x20);
+        RIPPASSL_EXPAND256_ODD(13);
+        RIPPASSL_EXPAND256(14, 0x40);
+    }
+
+#undef RIPPASSL_EXPAND128
+#undef RIPPASSL_EXPAND256
+#undef RIPPASSL_EXPAND256_ODD
+
+    // independent blocks are interleaved by this many, which keeps the AES
+    // unit busy across the latency of each round:
+    constexpr size_t interleave = 8;
+
+    __attribute__((target("aes,sse2")))
+    inline __m128i load(const uint8_t* data)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    }
+
+    __attribute__((target("aes,sse2")))
+    inline void store(uint8_t* data, __m128i block)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data), block);
+    }
+
+    __attribute__((target("aes,sse2")))
+    inline __m128i encryptBlock(const __m128i* rk, unsigned int rounds,
+                                __m128i block)
+    {
+        block = _mm_xor_si128(block, rk[0]);
+        for (unsigned int r = 1; r < rounds; ++r)
+            block = _mm_aesenc_si128(block, rk[r]);
+        return _mm_aesenclast_si128(block, rk[rounds]);
+    }
+
+    __attribute__((target("aes,sse2")))
+    inline __m128i decryptBlock(const __m128i* rk, unsigned int rounds,
+                                __m128i block)
+    {
+        block = _mm_xor_si128(block, rk[0]);
+        for (unsigned int r = 1; r < rounds; ++r)
+            block = _mm_aesdec_si128(block, rk[r]);
+        return _mm_aesdeclast_si128(block, rk[rounds]);
+    }
+
+    // runs "interleave" blocks through the rounds side by side. Inlining is
+    // forced, as the lanes shall stay in registers:
+    __attribute__((target("aes,sse2"), always_inline))
+    inline void encryptBlocks(const __m128i* rk, unsigned int rounds,
+                              __m128i* blocks)
+    {
+#pragma GCC unroll 8
+        for (size_t b = 0; b < interleave; ++b)
+            blocks[b] = _mm_xor_si128(blocks[b], rk[0]);
+        for (unsigned int r = 1; r < rounds; ++r)
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                blocks[b] = _mm_aesenc_si128(blocks[b], rk[r]);
+#pragma GCC unroll 8
+        for (size_t b = 0; b < interleave; ++b)
+            blocks[b] = _mm_aesenclast_si128(blocks[b], rk[rounds]);
+    }
+
+    __attribute__((target("aes,sse2"), always_inline))
+    inline void decryptBlocks(const __m128i* rk, unsigned int rounds,
+                              __m128i* blocks)
+    {
+#pragma GCC unroll 8
+        for (size_t b = 0; b < interleave; ++b)
+            blocks[b] = _mm_xor_si128(blocks[b], rk[0]);
+        for (unsigned int r = 1; r < rounds; ++r)
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                blocks[b] = _mm_aesdec_si128(blocks[b], rk[r]);
+#pragma GCC unroll 8
+        for (size_t b = 0; b < interleave; ++b)
+            blocks[b] = _mm_aesdeclast_si128(blocks[b], rk[rounds]);
+    }
+
+    __attribute__((target("aes,sse2")))
+    void invertKey(__m128i* inverse, const __m128i* rk, unsigned int rounds)
+    {
+        inverse[0] = rk[rounds];
+        for (unsigned int r = 1; r < rounds; ++r)
+            inverse[r] = _mm_aesimc_si128(rk[rounds - r]);
+        inverse[rounds] = rk[0];
+    }
+
+    __attribute__((target("aes,sse2")))
+    void ecbEncrypt(const __m128i* rk, unsigned int rounds,
+                    uint8_t* output, const uint8_t* input, size_t blocks)
+    {
+        size_t i = 0;
+
+        for (; i + interleave <= blocks; i += interleave)
+        {
+            __m128i lanes[interleave];
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                lanes[b] = load(input + (i + b) * 16);
+            encryptBlocks(rk, rounds, lanes);
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                store(output + (i + b) * 16, lanes[b]);
+        }
+
+        for (; i < blocks; ++i)
+            store(output + i * 16,
+                  encryptBlock(rk, rounds, load(input + i * 16)));
+    }
+
+    __attribute__((target("aes,sse2")))
+    void ecbDecrypt(const __m128i* rk, unsigned int rounds,
+                    uint8_t* output, const uint8_t* input, size_t blocks)
+    {
+        size_t i = 0;
+
+        for (; i + interleave <= blocks; i += interleave)
+        {
+            __m128i lanes[interleave];
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                lanes[b] = load(input + (i + b) * 16);
+            decryptBlocks(rk, rounds, lanes);
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                store(output + (i + b) * 16, lanes[b]);
+        }
+
+        for (; i < blocks; ++i)
+            store(output + i * 16,
+                  decryptBlock(rk, rounds, load(input + i * 16)));
+    }
+
+    // every block depends on the previous ciphertext: no interleaving here.
+    __attribute__((target("aes,sse2")))
+    void cbcEncrypt(const __m128i* rk, unsigned int rounds, uint8_t* iv,
+                    uint8_t* output, const uint8_t* input, size_t blocks)
+    {
+        __m128i chain = load(iv);
+
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            chain = encryptBlock(rk, rounds,
+                                 _mm_xor_si128(load(input + i * 16), chain));
+            store(output + i * 16, chain);
+        }
+
+        store(iv, chain);
+    }
+
+    // the ciphertext blocks are all loaded before anything is stored, so that
+    // in-place operation still has them for the chaining:
+    __attribute__((target("aes,sse2")))
+    void cbcDecrypt(const __m128i* rk, unsigned int rounds, uint8_t* iv,
+                    uint8_t* output, const uint8_t* input, size_t blocks)
+    {
+        __m128i chain = load(iv);
+        size_t i = 0;
+
+        for (; i + interleave <= blocks; i += interleave)
+        {
+            __m128i cipherText[interleave];
+            __m128i lanes[interleave];
+#pragma GCC unroll 8
+            for (size_t b = 0; b < interleave; ++b)
+                lanes[b] = cipherText[b] = load(input + (i + b) * 16);
+            decryptBlocks(rk, rounds, lanes);
+            store(output + i * 16, _mm_xor_si128(lanes[0], chain));
+#pragma GCC unroll 8
+            for (size_t b = 1; b < interleave; ++b)
+                store(output + (i + b) * 16,
+                      _mm_xor_si128(lanes[b], cipherText[b - 1]));
+            chain = cipherText[interleave - 1];
+        }
+
+        for (; i < blocks; ++i)
+        {
+            __m128i cipherText = load(input + i * 16);
+            store(output + i * 16,
+                  _mm_xor_si128(decryptBlock(rk, rounds, cipherText), chain));
+            chain = cipherText;
+        }
+
+        store(iv, chain);
+    }
+#endif
+}
+
+bool RippaSSL::aesNiAvailable()
+{
+    static const bool available {detectAesNi()};
+    return available;
+}
+
+void RippaSSL::expandAesKey(AesKeySchedule& schedule,
+                            const uint8_t*  key,
+                            size_t          keyLen)
+{
+    if ((NULL == key) || ((16 != keyLen) && (32 != keyLen)))
+        throw InputError_KEY_LENGTH {};
+
+    if (!aesNiAvailable())
+        throw InputError_UNSUPPORTED_MODE {};
+
+#ifdef RIPPASSL_AESNI
+    __m128i* rk = reinterpret_cast<__m128i*>(schedule.roundKeys);
+
+    if (16 == keyLen)
+    {
+        expandKey128(rk, key);
+        schedule.rounds = 10;
+    }
+    else
+    {
+        expandKey256(rk, key);
+        schedule.rounds = 14;
+    }
+#endif
+}
+
+void RippaSSL::invertAesKey(AesKeySchedule&       inverse,
+                            const AesKeySchedule& schedule)
+{
+#ifdef RIPPASSL_AESNI
+    invertKey(reinterpret_cast<__m128i*>(inverse.roundKeys),
+              reinterpret_cast<const __m128i*>(schedule.roundKeys),
+              schedule.rounds);
+    inverse.rounds = schedule.rounds;
+#endif
+}
+
+void RippaSSL::aesEcbEncrypt(const AesKeySchedule& schedule,
+                             uint8_t*              output,
+                             const uint8_t*        input,
+                             size_t                blocks)
+{
+#ifdef RIPPASSL_AESNI
+    ecbEncrypt(reinterpret_cast<const __m128i*>(schedule.roundKeys),
+               schedule.rounds, output, input, blocks);
+#endif
+}
+
+void RippaSSL::aesEcbDecrypt(const AesKeySchedule& inverse,
+                             uint8_t*              output,
+                             const uint8_t*        input,
+                             size_t                blocks)
+{
+#ifdef RIPPASSL_AESNI
+    ecbDecrypt(reinterpret_cast<const __m128i*>(inverse.roundKeys),
+               inverse.rounds, output, input, blocks);
+#endif
+}
+
+void RippaSSL::aesCbcEncrypt(const AesKeySchedule& schedule,
+                             uint8_t*              iv,
+                             uint8_t*              output,
+                             const uint8_t*        input,
+                             size_t                blocks)
+{
+#ifdef RIPPASSL_AESNI
+    cbcEncrypt(reinterpret_cast<const __m128i*>(schedule.roundKeys),
+               schedule.rounds, iv, output, input, blocks);
+#endif
+}
+
+void RippaSSL::aesCbcDecrypt(const AesKeySchedule& inverse,
+                             uint8_t*              iv,
+                             uint8_t*              output,
+                             const uint8_t*        input,
+                             size_t                blocks)
+{
+#ifdef RIPPASSL_AESNI
+    cbcDecrypt(reinterpret_cast<const __m128i*>(inverse.roundKeys),
+               inverse.rounds, iv, output, input, blocks);
+#endif
+}
@@ -0,0 +1,66 @@
+#ifndef RIPPASSL_AESNI_H
+#define RIPPASSL_AESNI_H
+
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    /*!
+    Expanded AES key, as consumed by the AES-NI instructions: one 16 bytes
+    round key per round, plus the initial whitening one.
+    */
+    struct AesKeySchedule {
+        alignas(16) uint8_t roundKeys[15 * 16];
+        unsigned int rounds;
+    };
+
+    /*!
+    Returns true if the CPU implements the AES-NI instruction set, detected
+    once at runtime through CPUID. Always false on non-x86 builds.
+    */
+    bool aesNiAvailable();
+
+    /*!
+    Expands a 16 or 32 bytes key (AES-128 or AES-256) into "schedule".
+    Requires aesNiAvailable(); throws InputError_KEY_LENGTH on other lengths.
+    */
+    void expandAesKey(AesKeySchedule& schedule,
+                      const uint8_t*  key,
+                      size_t          keyLen);
+
+    /*!
+    Derives the decryption schedule of the equivalent inverse cipher from an
+    expanded (encryption) one: the round keys in reverse order, the inner
+    ones through InvMixColumns.
+    */
+    void invertAesKey(AesKeySchedule&       inverse,
+                      const AesKeySchedule& schedule);
+
+    /*!
+    Whole-block kernels over "blocks" 16 bytes blocks, taking the encryption
+    schedule or the inverse one respectively. output may point to input. The
+    CBC ones chain through "iv", which is left holding the last ciphertext
+    block for the next call. They require aesNiAvailable(), which the
+    schedules already imply.
+    */
+    void aesEcbEncrypt(const AesKeySchedule& schedule,
+                       uint8_t*              output,
+                       const uint8_t*        input,
+                       size_t                blocks);
+    void aesEcbDecrypt(const AesKeySchedule& inverse,
+                       uint8_t*              output,
+                       const uint8_t*        input,
+                       size_t                blocks);
+    void aesCbcEncrypt(const AesKeySchedule& schedule,
+                       uint8_t*              iv,
+                       uint8_t*              output,
+                       const uint8_t*        input,
+                       size_t                blocks);
+    void aesCbcDecrypt(const AesKeySchedule& inverse,
+                       uint8_t*              iv,
+                       uint8_t*              output,
+                       const uint8_t*        input,
+                       size_t                blocks);
+}
+
+#endif
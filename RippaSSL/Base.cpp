@@ -11,5 +11,21 @@ const std::map<RippaSSL::Algo, size_t> RippaSSL::blockSizes
     {RippaSSL::Algo::AES128CBC, 16},
     {RippaSSL::Algo::AES128ECB, 16},
     {RippaSSL::Algo::AES256CBC, 16},
-    {RippaSSL::Algo::AES256ECB, 16}
+    {RippaSSL::Algo::AES256ECB, 16},
+    {RippaSSL::Algo::AES128CTR, 16},
+    {RippaSSL::Algo::AES256CTR, 16},
+    {RippaSSL::Algo::AES128GCM, 16},
+    {RippaSSL::Algo::AES256GCM, 16}
+};
+
+const std::map<RippaSSL::Algo, size_t> RippaSSL::ivSizes
+{
+    {RippaSSL::Algo::AES128CBC, 16},
+    {RippaSSL::Algo::AES128ECB, 16},
+    {RippaSSL::Algo::AES256CBC, 16},
+    {RippaSSL::Algo::AES256ECB, 16},
+    {RippaSSL::Algo::AES128CTR, 16},
+    {RippaSSL::Algo::AES256CTR, 16},
+    {RippaSSL::Algo::AES128GCM, 12},
+    {RippaSSL::Algo::AES256GCM, 12}
 };
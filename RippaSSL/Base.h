@@ -20,7 +20,11 @@ namespace RippaSSL {
         Bcm_CBC_Encrypt,
         Bcm_CBC_Decrypt,
         Bcm_ECB_Encrypt,
-        Bcm_ECB_Decrypt
+        Bcm_ECB_Decrypt,
+        Bcm_CTR_Encrypt,
+        Bcm_CTR_Decrypt,
+        Bcm_GCM_Encrypt,
+        Bcm_GCM_Decrypt
     };
 
     enum class Algo
@@ -28,10 +32,16 @@ namespace RippaSSL {
         AES128CBC,
         AES128ECB,
         AES256CBC,
-        AES256ECB
+        AES256ECB,
+        AES128CTR,
+        AES256CTR,
+        AES128GCM,
+        AES256GCM
     };
 
     extern const std::map<RippaSSL::Algo, size_t> blockSizes;
+    // IV lengths, which differ from the block size for GCM:
+    extern const std::map<RippaSSL::Algo, size_t> ivSizes;
 
     template<typename CTX, typename HND>
     class SymCryptoBase {
@@ -51,11 +61,25 @@ namespace RippaSSL {
             virtual int finalize(      std::vector<uint8_t>& output,
                                  const std::vector<uint8_t>& input) = 0;
 
+            /*!
+            Zero-copy counterparts of the above, for data that doesn't live in
+            a std::vector: they never allocate, and return the number of bytes
+            written to output, whose required capacity is documented by each
+            implementation. output may point to input (in-place operation),
+            but the two buffers shall not partially overlap.
+            */
+            virtual size_t update(uint8_t*       output,
+                                  const uint8_t* input,
+                                  size_t         inputLen) = 0;
+            virtual size_t finalize(uint8_t*       output,
+                                    const uint8_t* input,
+                                    size_t         inputLen) = 0;
+
         protected:
             CTX* context;
             const HND* handle;
             Algo currentAlgorithm;
-            int alreadyUpdatedData;
+            size_t alreadyUpdatedData;
             bool requirePadding;
 
             // disables copy semantics - this class contains pointer resources,
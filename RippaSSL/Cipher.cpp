@@ -1,74 +1,242 @@
 
 #include "Base.h"
 #include "Cipher.h"
+#include "Registry.h"
+#include "Profiler.h"
+#include "MessageBatch.h"
+#include "AesNi.h"
 #include "error.h"
 
 #include <openssl/evp.h>
 #include <openssl/params.h>
+#include <openssl/crypto.h>
 
 #include <vector>
-#include <cstdint>
+#include <thread>
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+
+// the EVP interface takes int lengths: longer inputs get split into pieces of
+// this size, which is a multiple of every block size:
+static constexpr size_t maxUpdateLen = 1u << 30;
+
+/*!
+Adds "blocks" to the big-endian counter of counterLen bytes, with carry over
+its whole width, as OpenSSL does when stepping a CTR counter.
+*/
+static void addToCounter(uint8_t* counter, size_t counterLen, uint64_t blocks)
+{
+    unsigned int carry = 0;
+
+    for (size_t i = counterLen; i-- > 0 && (blocks || carry); blocks >>= 8)
+    {
+        unsigned int sum = counter[i] + (blocks & 0xFF) + carry;
+        counter[i] = static_cast<uint8_t>(sum);
+        carry = sum >> 8;
+    }
+}
+
+/*!
+Runs the update function over inputLen bytes with the given context, adding
+the produced bytes to "written". Returns false if OpenSSL fails.
+*/
+static bool contextUpdate(const RippaSSL::CipherFunctionPointers& functions,
+                          CipherCtx*                              context,
+                          uint8_t*                                output,
+                          const uint8_t*                          input,
+                          size_t                                  inputLen,
+                          size_t&                                 written)
+{
+    for (size_t offset = 0; offset < inputLen; offset += maxUpdateLen)
+    {
+        int outLen = 0;
+        int pieceLen = std::min(inputLen - offset, maxUpdateLen);
+
+        if (!functions.cryptoUpdate(context,
+                                    output + written, &outLen,
+                                    input + offset,   pieceLen))
+        {
+            return false;
+        }
+
+        written += outLen;
+    }
+
+    return true;
+}
+
+/*!
+Returns true if the AES-NI kernels can stand in for EVP: they cover the AES
+ECB and CBC algorithms, without padding.
+*/
+static bool nativeEligible(RippaSSL::Algo    algo,
+                           RippaSSL::BcmMode mode,
+                           bool              padding)
+{
+    using RippaSSL::Algo;
+    using RippaSSL::BcmMode;
+
+    return !padding && RippaSSL::aesNiAvailable() &&
+           ((algo == Algo::AES128CBC) || (algo == Algo::AES128ECB) ||
+            (algo == Algo::AES256CBC) || (algo == Algo::AES256ECB)) &&
+           ((mode == BcmMode::Bcm_CBC_Encrypt) ||
+            (mode == BcmMode::Bcm_CBC_Decrypt) ||
+            (mode == BcmMode::Bcm_ECB_Encrypt) ||
+            (mode == BcmMode::Bcm_ECB_Decrypt));
+}
+
+/*!
+What EVP keeps for an AES ECB/CBC context without padding, kept here instead:
+the key schedules, the chaining IV and a partial block waiting for the rest.
+Without padding, EVP releases every whole block right away and refuses to
+finalize on a partial one; so does this.
+*/
+struct RippaSSL::Cipher::NativeState {
+    AesKeySchedule schedule;
+    AesKeySchedule inverse;
+    alignas(16) uint8_t iv[16];
+    uint8_t pending[16];
+    size_t pendingLen;
+    size_t keyLen;
+    bool chained;
+    bool decrypt;
+
+    void setKey(const uint8_t* key)
+    {
+        expandAesKey(schedule, key, keyLen);
+
+        if (decrypt)
+            invertAesKey(inverse, schedule);
+    }
+
+    // a NULL IV keeps the chaining where it is, as EVP does:
+    void restart(const uint8_t* newIv)
+    {
+        if (NULL != newIv)
+            std::memcpy(iv, newIv, sizeof(iv));
+
+        pendingLen = 0;
+    }
+
+    void process(uint8_t* output, const uint8_t* input, size_t blocks)
+    {
+        if (chained && decrypt)
+            aesCbcDecrypt(inverse, iv, output, input, blocks);
+        else if (chained)
+            aesCbcEncrypt(schedule, iv, output, input, blocks);
+        else if (decrypt)
+            aesEcbDecrypt(inverse, output, input, blocks);
+        else
+            aesEcbEncrypt(schedule, output, input, blocks);
+    }
+
+    size_t update(uint8_t* output, const uint8_t* input, size_t inputLen)
+    {
+        size_t written = 0;
+
+        if (pendingLen)
+        {
+            size_t taken = std::min(sizeof(pending) - pendingLen, inputLen);
+            std::memcpy(pending + pendingLen, input, taken);
+            pendingLen += taken;
+            input      += taken;
+            inputLen   -= taken;
+
+            if (pendingLen < sizeof(pending))
+                return 0;
+
+            process(output, pending, 1);
+            written = sizeof(pending);
+            pendingLen = 0;
+        }
+
+        size_t blocks = inputLen / sizeof(pending);
+        process(output + written, input, blocks);
+        written += blocks * sizeof(pending);
+
+        pendingLen = inputLen % sizeof(pending);
+        std::memcpy(pending, input + blocks * sizeof(pending), pendingLen);
+
+        return written;
+    }
+};
 
 /*!
 Constructor for the symmetric encryption/decryption object. It will initialise
 it with proper values, so that on object instantiation, the user gets an
 immediately employable entity.
 */
+RippaSSL::Cipher::Cipher(Algo                        algo,
+                         BcmMode                     mode,
+                         const std::vector<uint8_t>& key,
+                         const uint8_t*              iv,
+                         bool                        padding)
+: Cipher(algo, mode, key.data(), key.size(), iv, padding)
+{
+    // nothing required.
+}
+
 RippaSSL::Cipher::Cipher(Algo                       algo,
                          BcmMode                    mode,
-                         const std::vector<uint8_t> key,
+                         const uint8_t*             key,
+                         size_t                     keyLen,
                          const uint8_t*             iv,
                          bool                       padding)
-: SymCryptoBase(algo, padding)
+: SymCryptoBase(algo, padding), currentMode {mode}, workers {1},
+  native {nativeEligible(algo, mode, padding) ? new NativeState {} : nullptr}
 {
-    if (NULL == (this->context = EVP_CIPHER_CTX_new()))
-    {
-        throw InputError_NULLPTR {};
-    }
+    // the algorithm comes from the process-wide registry, which spares the
+    // provider lookup:
+    this->handle = fetchCipher(algo);
 
     if (mode == RippaSSL::BcmMode::Bcm_CBC_Encrypt ||
-        mode == RippaSSL::BcmMode::Bcm_ECB_Encrypt)
+        mode == RippaSSL::BcmMode::Bcm_ECB_Encrypt ||
+        mode == RippaSSL::BcmMode::Bcm_CTR_Encrypt ||
+        mode == RippaSSL::BcmMode::Bcm_GCM_Encrypt)
     {
         FunctionPointers.cryptoInit   = EVP_EncryptInit;
         FunctionPointers.cryptoUpdate = EVP_EncryptUpdate;
         FunctionPointers.cryptoFinal  = EVP_EncryptFinal;
     }
     else if (mode == RippaSSL::BcmMode::Bcm_CBC_Decrypt ||
-             mode == RippaSSL::BcmMode::Bcm_ECB_Decrypt)
+             mode == RippaSSL::BcmMode::Bcm_ECB_Decrypt ||
+             mode == RippaSSL::BcmMode::Bcm_CTR_Decrypt ||
+             mode == RippaSSL::BcmMode::Bcm_GCM_Decrypt)
     {
         FunctionPointers.cryptoInit   = EVP_DecryptInit;
         FunctionPointers.cryptoUpdate = EVP_DecryptUpdate;
         FunctionPointers.cryptoFinal  = EVP_DecryptFinal;
     }
 
-    if (mode == RippaSSL::BcmMode::Bcm_CBC_Encrypt ||
-        mode == RippaSSL::BcmMode::Bcm_CBC_Decrypt)
+    // OpenSSL reads as many key bytes as the algorithm requires:
+    if ((NULL == key) ||
+        (keyLen < static_cast<size_t>(EVP_CIPHER_get_key_length(this->handle))))
     {
-        if (algo == RippaSSL::Algo::AES128CBC)
-        {
-            this->handle = EVP_aes_128_cbc();
-        }
-        else
-        {
-            this->handle = EVP_aes_256_cbc();
-        }
+        throw InputError_KEY_LENGTH {};
     }
-    else
+
+    // no EVP context is allocated until one is needed, see setWorkers:
+    if (this->native)
     {
-        if (algo == RippaSSL::Algo::AES128ECB)
-        {
-            this->handle = EVP_aes_128_ecb();
-        }
-        else
-        {
-            this->handle = EVP_aes_256_ecb();
-        }
+        this->native->keyLen  = EVP_CIPHER_get_key_length(this->handle);
+        this->native->chained = (algo == Algo::AES128CBC) ||
+                                (algo == Algo::AES256CBC);
+        this->native->decrypt = (mode == BcmMode::Bcm_ECB_Decrypt) ||
+                                (mode == BcmMode::Bcm_CBC_Decrypt);
+        this->native->setKey(key);
+        this->native->restart(iv);
+        return;
+    }
+
+    if (NULL == (this->context = EVP_CIPHER_CTX_new()))
+    {
+        throw InputError_NULLPTR {};
     }
 
     if (!FunctionPointers.cryptoInit(this->context, this->handle,
-                                     key.data(), iv))
+                                     key, iv))
     {
         throw OpenSSLError_CryptoInit {};
     }
@@ -77,54 +245,388 @@ RippaSSL::Cipher::Cipher(Algo                       algo,
     EVP_CIPHER_CTX_set_padding(this->context, this->requirePadding);
 }
 
+RippaSSL::Cipher::Cipher(const Cipher&  prototype,
+                         const uint8_t* iv,
+                         bool           padding)
+: SymCryptoBase(prototype.currentAlgorithm, padding),
+  FunctionPointers {prototype.FunctionPointers},
+  currentMode {prototype.currentMode}, workers {1}
+{
+    this->handle = prototype.handle;
+
+    // a native prototype has no EVP context to copy: if padding keeps the
+    // copy on EVP, its key is the first round keys of the schedule.
+    if (prototype.native && !padding)
+    {
+        this->native.reset(new NativeState {*prototype.native});
+    }
+    else if (NULL == (this->context = EVP_CIPHER_CTX_new()))
+    {
+        throw InputError_NULLPTR {};
+    }
+    else if (prototype.native ?
+             !FunctionPointers.cryptoInit(this->context, this->handle,
+                                          prototype.native->schedule.roundKeys,
+                                          iv) :
+             !EVP_CIPHER_CTX_copy(this->context, prototype.context))
+    {
+        EVP_CIPHER_CTX_free(this->context);
+        throw OpenSSLError_CryptoInit {};
+    }
+
+    try {
+        reset(iv);
+    } catch (OpenSSLError_CryptoInit& ci) {
+        EVP_CIPHER_CTX_free(this->context);
+        throw;
+    }
+}
+
 int RippaSSL::Cipher::update(      std::vector<uint8_t>& output,
                              const std::vector<uint8_t>& input)
 {
-    int outLen = 0;
-    if (!FunctionPointers.cryptoUpdate(this->context, output.data(), &outLen,
-                                                input.data(),  input.size()))
+    // output might be the same object as input, so the length is taken first:
+    size_t inputLen = input.size();
+    size_t requiredMemory = inputLen + blockSizes.at(this->currentAlgorithm);
+
+    if (output.size() < requiredMemory)
     {
-        throw OpenSSLError_CryptoUpdate {};
+        output.resize(requiredMemory);
     }
 
-    this->alreadyUpdatedData += input.size();
-
-    return outLen;
+    return update(output.data(), input.data(), inputLen);
 }
 
 int RippaSSL::Cipher::finalize(      std::vector<uint8_t>& output,
                                const std::vector<uint8_t>& input)
 {
+    // a partial block held back from earlier updates comes out too, followed
+    // by a block of padding:
+    size_t inputLen = input.size();
+    size_t requiredMemory = inputLen +
+                            2 * blockSizes.at(this->currentAlgorithm);
+
+    if (output.size() < requiredMemory)
+    {
+        output.resize(requiredMemory);
+    }
+
+    size_t finalizeLen = finalize(output.data(), input.data(), inputLen);
+    output.resize(finalizeLen);
+
+    return finalizeLen;
+}
+
+size_t RippaSSL::Cipher::update(uint8_t*       output,
+                                const uint8_t* input,
+                                size_t         inputLen)
+{
+    ProfileScope profile {this->currentAlgorithm,
+                          KernelOperation::CipherUpdate, inputLen};
+
+    if (this->native)
+    {
+        this->alreadyUpdatedData += inputLen;
+        return this->native->update(output, input, inputLen);
+    }
+
+    if (parallelEligible(inputLen))
+    {
+        return parallelUpdate(output, input, inputLen);
+    }
+
+    return serialUpdate(output, input, inputLen);
+}
+
+size_t RippaSSL::Cipher::serialUpdate(uint8_t*       output,
+                                      const uint8_t* input,
+                                      size_t         inputLen)
+{
+    size_t written = 0;
+
+    if (!contextUpdate(FunctionPointers, this->context,
+                       output, input, inputLen, written))
+    {
+        throw OpenSSLError_CryptoUpdate {};
+    }
+
+    this->alreadyUpdatedData += inputLen;
+
+    return written;
+}
+
+void RippaSSL::Cipher::setWorkers(unsigned int workerCount)
+{
+    this->workers = std::max(1u, workerCount);
+
+    // the parallel path works on copies of the EVP context, which takes over
+    // from the AES-NI state here: the key is the first round keys of the
+    // schedule, and a partial block is simply fed to it again.
+    if ((this->workers > 1) && this->native)
+    {
+        int outLen = 0;
+        uint8_t unused[16];
+
+        if ((NULL == this->context) &&
+            (NULL == (this->context = EVP_CIPHER_CTX_new())))
+        {
+            throw InputError_NULLPTR {};
+        }
+
+        if (!FunctionPointers.cryptoInit(this->context, this->handle,
+                                         this->native->schedule.roundKeys,
+                                         this->native->iv))
+        {
+            throw OpenSSLError_CryptoInit {};
+        }
+
+        EVP_CIPHER_CTX_set_padding(this->context, this->requirePadding);
+
+        if (!FunctionPointers.cryptoUpdate(this->context, unused, &outLen,
+                                           this->native->pending,
+                                           this->native->pendingLen))
+        {
+            throw OpenSSLError_CryptoInit {};
+        }
+
+        OPENSSL_cleanse(this->native.get(), sizeof(NativeState));
+        this->native.reset();
+    }
+}
+
+bool RippaSSL::Cipher::nativeBackend() const
+{
+    return static_cast<bool>(this->native);
+}
+
+bool RippaSSL::Cipher::parallelEligible(size_t inputLen) const
+{
+    const size_t blockSize = blockSizes.at(this->currentAlgorithm);
+    const bool decrypt = (this->currentMode == BcmMode::Bcm_ECB_Decrypt) ||
+                         (this->currentMode == BcmMode::Bcm_CBC_Decrypt);
+
+    if ((this->workers < 2) || (inputLen < 2 * parallelMinSlice))
+        return false;
+
+    // CBC encryption chains every block to the previous output, so it can't
+    // be split:
+    if ((this->currentMode != BcmMode::Bcm_ECB_Encrypt) &&
+        (this->currentMode != BcmMode::Bcm_CTR_Encrypt) &&
+        (this->currentMode != BcmMode::Bcm_CTR_Decrypt) && !decrypt)
+        return false;
+
+    // the context shall not be holding data back: neither a partial block,
+    // nor the last block a padded decryption keeps until the next call:
+    return !(this->alreadyUpdatedData % blockSize) &&
+           !(decrypt && this->requirePadding && this->alreadyUpdatedData);
+}
+
+/*!
+Processes the input as a sequence of block-aligned slices, one per worker,
+each one through a copy of the context. The slices are independent in ECB
+mode, so the result is the same as a serial update. CBC decryption of a block
+only needs the previous ciphertext block, so every slice is seeded with the
+last ciphertext block of the one before it as IV. In CTR mode, every slice
+starts from the counter value matching its offset.
+The last bytes (up to one block) are left to this object's context, which
+then takes care of the buffering and padding rules as usual.
+*/
+size_t RippaSSL::Cipher::parallelUpdate(uint8_t*       output,
+                                        const uint8_t* input,
+                                        size_t         inputLen)
+{
+    const size_t blockSize   = blockSizes.at(this->currentAlgorithm);
+    const size_t parallelLen = (inputLen - 1) / blockSize * blockSize;
+    const size_t sliceCount  = std::min<size_t>(this->workers,
+                                                parallelLen / parallelMinSlice);
+    const size_t sliceLen    = parallelLen / sliceCount / blockSize * blockSize;
+
+    const bool chained = (this->currentMode == BcmMode::Bcm_CBC_Decrypt);
+    const bool counter = (this->currentMode == BcmMode::Bcm_CTR_Encrypt) ||
+                         (this->currentMode == BcmMode::Bcm_CTR_Decrypt);
+
+    std::vector<std::thread> threads;
+    std::vector<char> failed(sliceCount, 0);
+
+    // the seed IVs are taken before anything runs, as in-place operation
+    // overwrites the ciphertext. The last one is for this object's context,
+    // which resumes after the parallel part:
+    std::vector<uint8_t> seeds;
+    if (chained)
+    {
+        for (size_t slice = 1; slice <= sliceCount; ++slice)
+        {
+            const uint8_t* seed = input + ((slice == sliceCount) ?
+                                           parallelLen : slice * sliceLen) -
+                                  blockSize;
+            seeds.insert(seeds.end(), seed, seed + blockSize);
+        }
+    }
+    else if (counter)
+    {
+        std::vector<uint8_t> base(blockSize);
+
+        if (!EVP_CIPHER_CTX_get_updated_iv(this->context, base.data(),
+                                           blockSize))
+        {
+            throw OpenSSLError_CryptoUpdate {};
+        }
+
+        for (size_t slice = 1; slice <= sliceCount; ++slice)
+        {
+            size_t offset = (slice == sliceCount) ? parallelLen :
+                                                    slice * sliceLen;
+            seeds.insert(seeds.end(), base.begin(), base.end());
+            addToCounter(seeds.data() + seeds.size() - blockSize, blockSize,
+                         offset / blockSize);
+        }
+    }
+
+    auto sliceWorker = [&] (size_t slice) {
+        size_t offset = slice * sliceLen;
+        size_t len = (slice + 1 == sliceCount) ? parallelLen - offset :
+                                                 sliceLen;
+        size_t written = 0;
+        CipherCtx* sliceContext = EVP_CIPHER_CTX_new();
+
+        // the copies never hold data back, as they get whole blocks only and
+        // leave padding to this object's context. The first slice goes on
+        // with the IV the context already holds:
+        const uint8_t* seed = ((chained || counter) && slice) ?
+                              seeds.data() + (slice - 1) * blockSize : NULL;
+
+        failed[slice] =
+            (NULL == sliceContext)                                         ||
+            !EVP_CIPHER_CTX_copy(sliceContext, this->context)              ||
+            ((NULL != seed) &&
+             !EVP_CipherInit_ex(sliceContext, NULL, NULL, NULL, seed, -1)) ||
+            !EVP_CIPHER_CTX_set_padding(sliceContext, 0)                   ||
+            !contextUpdate(FunctionPointers, sliceContext,
+                           output + offset, input + offset, len, written);
+
+        EVP_CIPHER_CTX_free(sliceContext);
+    };
+
+    // the calling thread takes care of the first slice. Should a thread fail
+    // to start, the ones already running are joined before giving up, as
+    // destroying them while joinable would terminate the process:
+    try {
+        for (size_t slice = 1; slice < sliceCount; ++slice)
+        {
+            threads.emplace_back(sliceWorker, slice);
+        }
+    } catch (...) {
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        throw;
+    }
+    sliceWorker(0);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end())
+    {
+        throw OpenSSLError_CryptoUpdate {};
+    }
+
+    if (chained || counter)
+    {
+        if (!EVP_CipherInit_ex(this->context, NULL, NULL, NULL,
+                               seeds.data() + (sliceCount - 1) * blockSize, -1))
+        {
+            throw OpenSSLError_CryptoUpdate {};
+        }
+
+        EVP_CIPHER_CTX_set_padding(this->context, this->requirePadding);
+    }
+
+    this->alreadyUpdatedData += parallelLen;
+
+    return parallelLen + serialUpdate(output + parallelLen,
+                                      input + parallelLen,
+                                      inputLen - parallelLen);
+}
+
+size_t RippaSSL::Cipher::finalize(uint8_t*       output,
+                                  const uint8_t* input,
+                                  size_t         inputLen)
+{
+    ProfileScope profile {this->currentAlgorithm,
+                          KernelOperation::CipherFinalize, inputLen};
+
+    size_t written = 0;
     int finalizeLen = 0;
 
-    if (input.size())
+    if (inputLen)
     {
         try {
-            // checks whether the output vector needs more reserved space for
-            // the update function to work properly:
-            unsigned int requiredMemory =
-                this->alreadyUpdatedData + input.size();
-            requiredMemory +=
-                (this->requirePadding) ?
-                    blockSizes.at(this->currentAlgorithm) -
-                       (input.size() % blockSizes.at(this->currentAlgorithm)) :
-                    0;
-
-            if (output.capacity() < requiredMemory)
-            {
-                output.resize(requiredMemory);
-            }
-
-            update(output, input);
+            written = update(output, input, inputLen);
         } catch (OpenSSLError_CryptoUpdate& cu) {
             throw OpenSSLError_CryptoFinalize {};
-        } catch (InputError_MISALIGNED_DATA& misdata) {
-            throw;
         }
     }
 
+    // without padding, there's nothing left but a partial block to refuse:
+    if (this->native)
+    {
+        if (this->native->pendingLen)
+            throw OpenSSLError_CryptoFinalize {};
+
+        return written;
+    }
+
     if (!FunctionPointers.cryptoFinal(this->context,
-                                      output.data(), &finalizeLen))
+                                      output + written, &finalizeLen))
+    {
+        throw OpenSSLError_CryptoFinalize {};
+    }
+
+    return written + finalizeLen;
+}
+
+void RippaSSL::Cipher::updateAad(const uint8_t* aad, size_t aadLen)
+{
+    if ((this->currentMode != BcmMode::Bcm_GCM_Encrypt) &&
+        (this->currentMode != BcmMode::Bcm_GCM_Decrypt))
+    {
+        throw InputError_UNSUPPORTED_MODE {};
+    }
+
+    // a NULL output tells OpenSSL that the data is AAD:
+    for (size_t offset = 0; offset < aadLen; offset += maxUpdateLen)
+    {
+        int outLen = 0;
+        int pieceLen = std::min(aadLen - offset, maxUpdateLen);
+
+        if (!FunctionPointers.cryptoUpdate(this->context, NULL, &outLen,
+                                           aad + offset, pieceLen))
+        {
+            throw OpenSSLError_CryptoUpdate {};
+        }
+    }
+}
+
+size_t RippaSSL::Cipher::finalizeTag(uint8_t*       output,
+                                     const uint8_t* input,
+                                     size_t         inputLen,
+                                     uint8_t*       tag,
+                                     size_t         tagLen)
+{
+    if ((this->currentMode != BcmMode::Bcm_GCM_Encrypt) ||
+        (tagLen > aeadTagSize))
+    {
+        throw InputError_UNSUPPORTED_MODE {};
+    }
+
+    size_t finalizeLen = finalize(output, input, inputLen);
+
+    if (!EVP_CIPHER_CTX_ctrl(this->context, EVP_CTRL_AEAD_GET_TAG,
+                             tagLen, tag))
     {
         throw OpenSSLError_CryptoFinalize {};
     }
@@ -132,6 +634,137 @@ int RippaSSL::Cipher::finalize(      std::vector<uint8_t>& output,
     return finalizeLen;
 }
 
+size_t RippaSSL::Cipher::finalizeVerify(uint8_t*       output,
+                                        const uint8_t* input,
+                                        size_t         inputLen,
+                                        const uint8_t* tag,
+                                        size_t         tagLen)
+{
+    ProfileScope profile {this->currentAlgorithm,
+                          KernelOperation::CipherFinalize, inputLen};
+
+    if ((this->currentMode != BcmMode::Bcm_GCM_Decrypt) ||
+        !tagLen || (tagLen > aeadTagSize))
+    {
+        throw InputError_UNSUPPORTED_MODE {};
+    }
+
+    size_t written = 0;
+    int finalizeLen = 0;
+
+    if (inputLen)
+    {
+        try {
+            written = update(output, input, inputLen);
+        } catch (OpenSSLError_CryptoUpdate& cu) {
+            throw OpenSSLError_CryptoFinalize {};
+        }
+    }
+
+    // OpenSSL compares the expected tag while finalizing:
+    if (!EVP_CIPHER_CTX_ctrl(this->context, EVP_CTRL_AEAD_SET_TAG, tagLen,
+                             const_cast<uint8_t*>(tag)))
+    {
+        throw OpenSSLError_CryptoFinalize {};
+    }
+
+    if (!FunctionPointers.cryptoFinal(this->context,
+                                      output + written, &finalizeLen))
+    {
+        throw OpenSSLError_Authentication {};
+    }
+
+    return written + finalizeLen;
+}
+
+void RippaSSL::Cipher::reset(const uint8_t* iv)
+{
+    if (this->native)
+    {
+        this->native->restart(iv);
+        this->alreadyUpdatedData = 0;
+        return;
+    }
+
+    // a NULL cipher and key keep the current ones, -1 the current direction:
+    if (!EVP_CipherInit_ex(this->context, NULL, NULL, NULL, iv, -1))
+    {
+        throw OpenSSLError_CryptoInit {};
+    }
+
+    EVP_CIPHER_CTX_set_padding(this->context, this->requirePadding);
+    this->alreadyUpdatedData = 0;
+}
+
+void RippaSSL::Cipher::rekey(const std::vector<uint8_t>& key,
+                             const uint8_t*              iv)
+{
+    rekey(key.data(), key.size(), iv);
+}
+
+void RippaSSL::Cipher::rekey(const uint8_t* key,
+                             size_t         keyLen,
+                             const uint8_t* iv)
+{
+    if ((NULL == key) ||
+        (keyLen < static_cast<size_t>(EVP_CIPHER_get_key_length(this->handle))))
+    {
+        throw InputError_KEY_LENGTH {};
+    }
+
+    if (this->native)
+    {
+        this->native->setKey(key);
+        this->native->restart(iv);
+        this->alreadyUpdatedData = 0;
+        return;
+    }
+
+    if (!EVP_CipherInit_ex(this->context, NULL, NULL, key, iv, -1))
+    {
+        throw OpenSSLError_CryptoInit {};
+    }
+
+    EVP_CIPHER_CTX_set_padding(this->context, this->requirePadding);
+    this->alreadyUpdatedData = 0;
+}
+
+void RippaSSL::Cipher::finalizeBatch(MessageBatch& batch)
+{
+    if ((batch.algorithm() != this->currentAlgorithm)          ||
+        (this->currentMode == BcmMode::Bcm_GCM_Encrypt)        ||
+        (this->currentMode == BcmMode::Bcm_GCM_Decrypt))
+    {
+        throw InputError_UNSUPPORTED_MODE {};
+    }
+
+    const size_t records = batch.size();
+    size_t currentKey = MessageBatch::noKey;
+
+    for (size_t i = 0; i < records; ++i)
+    {
+        // the next record is contiguous, so its loads overlap this one's work:
+        if (i + 1 < records)
+        {
+            __builtin_prefetch(batch.payload(i + 1));
+            __builtin_prefetch(batch.output(i + 1), 1);
+        }
+
+        if (batch.keyIndex(i) == currentKey)
+        {
+            reset(batch.iv(i));
+        }
+        else
+        {
+            rekey(batch.key(i), batch.keyLength(i), batch.iv(i));
+            currentKey = batch.keyIndex(i);
+        }
+
+        batch.setOutputLength(i, finalize(batch.output(i), batch.payload(i),
+                                          batch.payloadLength(i)));
+    }
+}
+
 /*!
 The Cipher entity destructor will take care of releasing the memory for the
 symmetric algorithms context. No cleaner solution could be applied as openssl's
@@ -141,4 +774,7 @@ of pointers is available to client application.
 RippaSSL::Cipher::~Cipher()
 {
     EVP_CIPHER_CTX_free(this->context);
+
+    if (this->native)
+        OPENSSL_cleanse(this->native.get(), sizeof(NativeState));
 }
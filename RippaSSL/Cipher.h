@@ -1,5 +1,5 @@
 #ifndef RIPPASSL_CIPHER_H
-
+#define RIPPASSL_CIPHER_H
 
 #include "Base.h"
 
@@ -7,10 +7,20 @@
 #include <openssl/params.h>
 
 #include <vector>
+#include <memory>
 #include <cstdint>
 #include <cstdio>
 
 namespace RippaSSL {
+    class MessageBatch;
+
+    // the parallel path kicks in only when every worker gets a slice at
+    // least this large, in bytes:
+    constexpr size_t parallelMinSlice = 256 * 1024;
+
+    // length of the authentication tags of the AEAD (GCM) modes, in bytes:
+    constexpr size_t aeadTagSize = 16;
+
     struct CipherFunctionPointers {
         int (*cryptoInit) (CipherCtx*           context,
                            const CipherHandle*  cipher,
@@ -28,19 +38,127 @@ namespace RippaSSL {
                             int*                outLen);
     };
 
+    /*!
+    AES-128/256 in ECB and CBC modes without padding runs on AES-NI directly,
+    bypassing EVP, when the CPU has it: a key schedule and an IV are all the
+    state there is, which makes small messages, reset() and rekey() much
+    cheaper. The output is the same either way; every other case, and CPUs
+    without AES-NI, stay on EVP.
+    */
     class Cipher : public SymCryptoBase<CipherCtx, CipherHandle> {
         public:
             explicit Cipher(Algo                          algo,
                             BcmMode                       mode,
-                            const std::vector<uint8_t>    key,
+                            const std::vector<uint8_t>&   key,
+                            const uint8_t*                iv,
+                            bool                          padding = false);
+
+            explicit Cipher(Algo                          algo,
+                            BcmMode                       mode,
+                            const uint8_t*                key,
+                            size_t                        keyLen,
+                            const uint8_t*                iv,
+                            bool                          padding = false);
+
+            /*!
+            Creates an independent working copy of prototype's context, so
+            that the key schedule is copied rather than computed again: only
+            the IV (nullptr for ECB) and the padding are set.
+            */
+            explicit Cipher(const Cipher&                 prototype,
                             const uint8_t*                iv,
                             bool                          padding = false);
 
+            /*!
+            The vector flavours grow output when it is too small for the
+            result; finalize also shrinks it to the bytes actually written.
+            */
             int update(      std::vector<uint8_t>& output,
                        const std::vector<uint8_t>& input);
             int finalize(      std::vector<uint8_t>& output,
                          const std::vector<uint8_t>& input);
 
+            /*!
+            output shall have room for inputLen bytes plus one block for
+            update, plus two blocks for finalize: data might be held back by
+            a call and released by the next one, and finalize may add a block
+            of padding after it. For the same reason, in-place operation requires every call to be fed
+            whole blocks, and padding to be disabled when decrypting.
+            */
+            size_t update(uint8_t*       output,
+                          const uint8_t* input,
+                          size_t         inputLen);
+            size_t finalize(uint8_t*       output,
+                            const uint8_t* input,
+                            size_t         inputLen);
+
+            /*!
+            AEAD modes only: authenticates aadLen bytes of additional data,
+            which isn't encrypted. All of it shall be passed before the first
+            update. Throws InputError_UNSUPPORTED_MODE in other modes.
+            */
+            void updateAad(const uint8_t* aad, size_t aadLen);
+
+            /*!
+            AEAD encryption only: finalizes like finalize() above, then writes
+            the first tagLen (up to aeadTagSize) bytes of the authentication
+            tag to "tag".
+            */
+            size_t finalizeTag(uint8_t*       output,
+                               const uint8_t* input,
+                               size_t         inputLen,
+                               uint8_t*       tag,
+                               size_t         tagLen = aeadTagSize);
+
+            /*!
+            AEAD decryption only: finalizes like finalize() above, checking
+            the data against the tagLen bytes of "tag". Throws
+            OpenSSLError_Authentication on mismatch, in which case everything
+            output so far shall be discarded.
+            */
+            size_t finalizeVerify(uint8_t*       output,
+                                  const uint8_t* input,
+                                  size_t         inputLen,
+                                  const uint8_t* tag,
+                                  size_t         tagLen = aeadTagSize);
+
+            /*!
+            Restarts the operation with a new IV (nullptr for ECB), keeping the
+            context and the key schedule in place.
+            */
+            void reset(const uint8_t* iv);
+
+            /*!
+            Restarts the operation with a new key and IV, reusing the
+            context allocated at construction.
+            */
+            void rekey(const std::vector<uint8_t>& key, const uint8_t* iv);
+            void rekey(const uint8_t* key, size_t keyLen, const uint8_t* iv);
+
+            /*!
+            Runs every record of "batch" as a whole message, in order, into its
+            output slot: consecutive records sharing a key only reset the IV,
+            the others rekey this context. The batch shall be for the
+            algorithm given at construction, which shall not be an AEAD one,
+            else InputError_UNSUPPORTED_MODE is thrown.
+            */
+            void finalizeBatch(MessageBatch& batch);
+
+            /*!
+            Sets how many threads may share a large update, each working on
+            its own copy of the context over a block-aligned slice of the
+            input. The output is byte-identical to the single-threaded one.
+            The ECB and CTR modes and CBC decryption are split, CBC encryption
+            can't be; the default of 1 disables it. Objects running on AES-NI
+            move to EVP for good when given more than one worker.
+            */
+            void setWorkers(unsigned int workerCount);
+
+            /*!
+            Returns true if this object runs on AES-NI rather than on EVP.
+            */
+            bool nativeBackend() const;
+
             ~Cipher();
 
             // explicitly forbids copy semantics:
@@ -48,7 +166,21 @@ namespace RippaSSL {
             Cipher& operator= (const Cipher&) = delete;
 
         private:
+            bool parallelEligible(size_t inputLen) const;
+            size_t parallelUpdate(uint8_t*       output,
+                                  const uint8_t* input,
+                                  size_t         inputLen);
+            size_t serialUpdate(uint8_t*       output,
+                                const uint8_t* input,
+                                size_t         inputLen);
+
+            // the AES-NI state, only allocated when this object runs on it:
+            struct NativeState;
+
             CipherFunctionPointers FunctionPointers;
+            BcmMode currentMode;
+            unsigned int workers;
+            std::unique_ptr<NativeState> native;
     };
 }
 
@@ -0,0 +1,162 @@
+#include "ContextCache.h"
+#include "Base.h"
+#include "Cipher.h"
+#include "error.h"
+
+#include <openssl/crypto.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/*!
+FNV-1a over the key, seeded with the algorithm, the mode and the padding: the
+index only narrows the search down, entries still compare the whole key.
+*/
+static uint64_t hashKey(RippaSSL::Algo    algo,
+                        RippaSSL::BcmMode mode,
+                        bool              padding,
+                        const uint8_t*    key,
+                        size_t            keyLen)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    auto mix = [&hash] (uint8_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001B3ull;
+    };
+
+    mix(static_cast<uint8_t>(algo));
+    mix(static_cast<uint8_t>(mode));
+    mix(static_cast<uint8_t>(padding));
+    for (size_t i = 0; i < keyLen; ++i)
+        mix(key[i]);
+
+    return hash;
+}
+
+RippaSSL::ContextCache::ContextCache(size_t capacity)
+: maxEntries {std::max<size_t>(capacity, 1)}, hits {0}, misses {0},
+  evictions {0}
+{
+    index.reserve(maxEntries);
+}
+
+RippaSSL::Cipher RippaSSL::ContextCache::acquire(Algo           algo,
+                                                 BcmMode        mode,
+                                                 const uint8_t* key,
+                                                 size_t         keyLen,
+                                                 const uint8_t* iv,
+                                                 bool           padding)
+{
+    if (NULL == key)
+        throw InputError_KEY_LENGTH {};
+
+    uint64_t keyHash = hashKey(algo, mode, padding, key, keyLen);
+    std::lock_guard<std::mutex> guard {lock};
+
+    auto range = index.equal_range(keyHash);
+    for (auto found = range.first; found != range.second; ++found)
+    {
+        Entry& entry = *found->second;
+
+        if ((entry.algo == algo) && (entry.mode == mode) &&
+            (entry.padding == padding) && (entry.key.size() == keyLen) &&
+            !CRYPTO_memcmp(entry.key.data(), key, keyLen))
+        {
+            ++hits;
+            entries.splice(entries.begin(), entries, found->second);
+
+            return Cipher {*entry.prototype, iv, padding};
+        }
+    }
+
+    // the key schedule is computed once, here, and copied afterwards. The
+    // prototype pads as its copies do, so that both take the same backend:
+    std::unique_ptr<Cipher> prototype {new Cipher {algo, mode, key, keyLen,
+                                                   nullptr, padding}};
+    ++misses;
+
+    if (entries.size() >= maxEntries)
+    {
+        drop(std::prev(entries.end()));
+        ++evictions;
+    }
+
+    entries.push_front(Entry {algo, mode, padding, keyHash,
+                              std::vector<uint8_t> (key, key + keyLen),
+                              std::move(prototype)});
+    index.emplace(keyHash, entries.begin());
+
+    return Cipher {*entries.front().prototype, iv, padding};
+}
+
+RippaSSL::Cipher RippaSSL::ContextCache::acquire(
+    Algo                        algo,
+    BcmMode                     mode,
+    const std::vector<uint8_t>& key,
+    const uint8_t*              iv,
+    bool                        padding)
+{
+    return acquire(algo, mode, key.data(), key.size(), iv, padding);
+}
+
+size_t RippaSSL::ContextCache::evict(const uint8_t* key, size_t keyLen)
+{
+    std::lock_guard<std::mutex> guard {lock};
+    size_t dropped = 0;
+
+    for (auto position = entries.begin(); position != entries.end(); )
+    {
+        auto next = std::next(position);
+
+        if ((position->key.size() == keyLen) &&
+            !CRYPTO_memcmp(position->key.data(), key, keyLen))
+        {
+            drop(position);
+            ++dropped;
+        }
+
+        position = next;
+    }
+
+    evictions += dropped;
+
+    return dropped;
+}
+
+void RippaSSL::ContextCache::clear()
+{
+    std::lock_guard<std::mutex> guard {lock};
+
+    while (!entries.empty())
+        drop(entries.begin());
+}
+
+RippaSSL::ContextCache::Statistics RippaSSL::ContextCache::statistics() const
+{
+    std::lock_guard<std::mutex> guard {lock};
+
+    return Statistics {hits, misses, evictions, entries.size(), maxEntries};
+}
+
+void RippaSSL::ContextCache::drop(Position position)
+{
+    auto range = index.equal_range(position->keyHash);
+    for (auto found = range.first; found != range.second; ++found)
+    {
+        if (found->second == position)
+        {
+            index.erase(found);
+            break;
+        }
+    }
+
+    OPENSSL_cleanse(position->key.data(), position->key.size());
+    entries.erase(position);
+}
+
+RippaSSL::ContextCache::~ContextCache()
+{
+    clear();
+}
@@ -0,0 +1,99 @@
+#ifndef RIPPASSL_CONTEXTCACHE_H
+#define RIPPASSL_CONTEXTCACHE_H
+
+#include "Base.h"
+#include "Cipher.h"
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    /*!
+    A bounded cache of initialized contexts, one per (algorithm, mode,
+    padding, key), that hands out working copies: a repeat key costs a
+    context copy and an IV set instead of a key schedule. When full, the
+    least recently used key goes. The cache owns copies of the keys it
+    holds, cleansed on eviction, and is safe to share between threads; the
+    Ciphers it returns are independent of it and of each other.
+    */
+    class ContextCache {
+        public:
+            struct Statistics {
+                uint64_t hits;
+                uint64_t misses;
+                uint64_t evictions;
+                size_t   size;
+                size_t   capacity;
+            };
+
+            /*!
+            capacity is the number of keys kept, at least 1.
+            */
+            explicit ContextCache(size_t capacity);
+
+            /*!
+            Returns a Cipher for key, set up with iv (nullptr for ECB) and
+            padding. Throws as the Cipher constructors do.
+            */
+            Cipher acquire(Algo           algo,
+                           BcmMode        mode,
+                           const uint8_t* key,
+                           size_t         keyLen,
+                           const uint8_t* iv,
+                           bool           padding = false);
+
+            Cipher acquire(Algo                        algo,
+                           BcmMode                     mode,
+                           const std::vector<uint8_t>& key,
+                           const uint8_t*              iv,
+                           bool                        padding = false);
+
+            /*!
+            Drops the contexts of key, whatever their algorithm, mode and
+            padding, e.g. when it is retired. Returns how many there were.
+            */
+            size_t evict(const uint8_t* key, size_t keyLen);
+
+            /*!
+            Drops every context.
+            */
+            void clear();
+
+            Statistics statistics() const;
+
+            ~ContextCache();
+
+            ContextCache(const ContextCache&)             = delete;
+            ContextCache& operator= (const ContextCache&) = delete;
+
+        private:
+            struct Entry {
+                Algo                    algo;
+                BcmMode                 mode;
+                bool                    padding;
+                uint64_t                keyHash;
+                std::vector<uint8_t>    key;
+                std::unique_ptr<Cipher> prototype;
+            };
+
+            typedef std::list<Entry>::iterator Position;
+
+            void drop(Position position);
+
+            // most recently used first:
+            std::list<Entry> entries;
+            std::unordered_multimap<uint64_t, Position> index;
+            size_t   maxEntries;
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            mutable std::mutex lock;
+    };
+}
+
+#endif
@@ -0,0 +1,124 @@
+#include "Etm.h"
+#include "Base.h"
+#include "Cipher.h"
+#include "Mac.h"
+#include "error.h"
+
+#include <openssl/crypto.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+    RippaSSL::Algo checkedAlgo(RippaSSL::Algo algo, RippaSSL::BcmMode mode)
+    {
+        if (((algo != RippaSSL::Algo::AES128CBC)      &&
+             (algo != RippaSSL::Algo::AES256CBC))     ||
+            ((mode != RippaSSL::BcmMode::Bcm_CBC_Encrypt) &&
+             (mode != RippaSSL::BcmMode::Bcm_CBC_Decrypt)))
+        {
+            throw RippaSSL::InputError_UNSUPPORTED_MODE {};
+        }
+
+        return algo;
+    }
+}
+
+RippaSSL::EncryptThenMac::EncryptThenMac(Algo                        algo,
+                                         BcmMode                     mode,
+                                         const std::vector<uint8_t>& cipherKey,
+                                         const uint8_t*              iv,
+                                         const std::vector<uint8_t>& macKey,
+                                         bool                        padding)
+: EncryptThenMac(algo, mode, cipherKey.data(), cipherKey.size(), iv,
+                 macKey.data(), macKey.size(), padding)
+{
+    // nothing required.
+}
+
+RippaSSL::EncryptThenMac::EncryptThenMac(Algo           algo,
+                                         BcmMode        mode,
+                                         const uint8_t* cipherKey,
+                                         size_t         cipherKeyLen,
+                                         const uint8_t* iv,
+                                         const uint8_t* macKey,
+                                         size_t         macKeyLen,
+                                         bool           padding)
+: cipher {checkedAlgo(algo, mode), mode, cipherKey, cipherKeyLen, iv, padding},
+  mac {algo, MacMode::CMAC, macKey, macKeyLen, nullptr},
+  currentAlgorithm {algo},
+  encrypting {mode == BcmMode::Bcm_CBC_Encrypt}
+{
+    // nothing required.
+}
+
+size_t RippaSSL::EncryptThenMac::update(uint8_t*       output,
+                                        const uint8_t* input,
+                                        size_t         inputLen)
+{
+    size_t written = 0;
+
+    for (size_t offset = 0; offset < inputLen; offset += etmTileSize)
+    {
+        size_t tileLen = std::min(etmTileSize, inputLen - offset);
+
+        if (encrypting)
+        {
+            size_t outLen = cipher.update(output + written,
+                                          input + offset, tileLen);
+            mac.update(nullptr, output + written, outLen);
+            written += outLen;
+        }
+        else
+        {
+            // the ciphertext is absorbed before an in-place decryption
+            // overwrites it:
+            mac.update(nullptr, input + offset, tileLen);
+            written += cipher.update(output + written,
+                                     input + offset, tileLen);
+        }
+    }
+
+    return written;
+}
+
+size_t RippaSSL::EncryptThenMac::finalizeTag(uint8_t*       output,
+                                             const uint8_t* input,
+                                             size_t         inputLen,
+                                             uint8_t*       tag)
+{
+    if (!encrypting)
+        throw InputError_UNSUPPORTED_MODE {};
+
+    size_t written = update(output, input, inputLen);
+    size_t finalLen = cipher.finalize(output + written, nullptr, 0);
+
+    mac.update(nullptr, output + written, finalLen);
+    mac.finalize(tag, nullptr, 0);
+
+    return written + finalLen;
+}
+
+size_t RippaSSL::EncryptThenMac::finalizeVerify(uint8_t*       output,
+                                                const uint8_t* input,
+                                                size_t         inputLen,
+                                                const uint8_t* tag)
+{
+    if (encrypting)
+        throw InputError_UNSUPPORTED_MODE {};
+
+    size_t written = update(output, input, inputLen);
+    uint8_t computed[EVP_MAX_BLOCK_LENGTH];
+
+    mac.finalize(computed, nullptr, 0);
+
+    if (CRYPTO_memcmp(computed, tag, tagSize()))
+        throw OpenSSLError_Authentication {};
+
+    return written + cipher.finalize(output + written, nullptr, 0);
+}
+
+size_t RippaSSL::EncryptThenMac::tagSize() const
+{
+    return blockSizes.at(currentAlgorithm);
+}
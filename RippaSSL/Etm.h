@@ -0,0 +1,88 @@
+#ifndef RIPPASSL_ETM_H
+#define RIPPASSL_ETM_H
+
+#include "Base.h"
+#include "Cipher.h"
+#include "Mac.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace RippaSSL {
+    // the data is walked in tiles of this many bytes, small enough for the
+    // ciphertext to still sit in L1 when the CMAC reads it back:
+    constexpr size_t etmTileSize = 16 * 1024;
+
+    /*!
+    AES-CBC encryption followed by an AES-CMAC over the ciphertext, in a
+    single pass: each tile is encrypted and immediately absorbed by the MAC
+    while still hot in cache. The ciphertext and the tag are identical to
+    running a Cipher and then a Cmac over the whole buffer.
+    In the decryption direction the MAC is computed over the input instead,
+    before each tile is decrypted, so that in-place operation stays valid.
+    */
+    class EncryptThenMac {
+        public:
+            /*!
+            algo is AES128CBC or AES256CBC, mode its encryption or decryption
+            direction; anything else throws InputError_UNSUPPORTED_MODE.
+            The same algorithm keys the CMAC with macKey.
+            */
+            explicit EncryptThenMac(Algo                        algo,
+                                    BcmMode                     mode,
+                                    const std::vector<uint8_t>& cipherKey,
+                                    const uint8_t*              iv,
+                                    const std::vector<uint8_t>& macKey,
+                                    bool                        padding = false);
+
+            explicit EncryptThenMac(Algo           algo,
+                                    BcmMode        mode,
+                                    const uint8_t* cipherKey,
+                                    size_t         cipherKeyLen,
+                                    const uint8_t* iv,
+                                    const uint8_t* macKey,
+                                    size_t         macKeyLen,
+                                    bool           padding = false);
+
+            /*!
+            Same contract as Cipher::update: output shall have room for
+            inputLen bytes plus one block.
+            */
+            size_t update(uint8_t*       output,
+                          const uint8_t* input,
+                          size_t         inputLen);
+
+            /*!
+            Encryption only: finalizes the ciphertext like Cipher::finalize,
+            then writes the tag (one block long) to "tag".
+            */
+            size_t finalizeTag(uint8_t*       output,
+                               const uint8_t* input,
+                               size_t         inputLen,
+                               uint8_t*       tag);
+
+            /*!
+            Decryption only: finalizes the plaintext like Cipher::finalize,
+            checking the ciphertext against the one block long "tag". Throws
+            OpenSSLError_Authentication on mismatch, in which case everything
+            output so far shall be discarded.
+            */
+            size_t finalizeVerify(uint8_t*       output,
+                                  const uint8_t* input,
+                                  size_t         inputLen,
+                                  const uint8_t* tag);
+
+            /*!
+            Length of the tag, in bytes.
+            */
+            size_t tagSize() const;
+
+        private:
+            Cipher cipher;
+            Cmac   mac;
+            Algo   currentAlgorithm;
+            bool   encrypting;
+    };
+}
+
+#endif
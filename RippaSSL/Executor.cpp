@@ -0,0 +1,222 @@
+#include "Executor.h"
+#include "Base.h"
+#include "Cipher.h"
+#include "Mac.h"
+#include "error.h"
+
+#include <map>
+#include <memory>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+/*!
+The contexts a worker reuses across tasks, created on first use.
+*/
+struct RippaSSL::Executor::WorkerContexts {
+    // padding is fixed at construction, hence part of the key:
+    std::map<std::tuple<Algo, BcmMode, bool>, std::unique_ptr<Cipher>> ciphers;
+    std::map<std::pair<Algo, MacMode>, std::unique_ptr<Cmac>>          macs;
+
+    std::vector<uint8_t> run(const CipherTask& task)
+    {
+        if ((BcmMode::Bcm_GCM_Encrypt == task.mode) ||
+            (BcmMode::Bcm_GCM_Decrypt == task.mode))
+        {
+            throw InputError_UNSUPPORTED_MODE {};
+        }
+
+        const uint8_t* iv = task.iv.empty() ? nullptr : task.iv.data();
+        std::unique_ptr<Cipher>& cipher =
+            ciphers[std::make_tuple(task.algo, task.mode, task.padding)];
+
+        if (!cipher)
+        {
+            cipher.reset(new Cipher {task.algo, task.mode, task.key, iv,
+                                     task.padding});
+        }
+        else
+        {
+            cipher->rekey(task.key, iv);
+        }
+
+        std::vector<uint8_t> output;
+        cipher->finalize(output, task.input);
+
+        return output;
+    }
+
+    std::vector<uint8_t> run(const MacTask& task)
+    {
+        std::unique_ptr<Cmac>& mac = macs[{task.algo, task.mode}];
+
+        if (!mac)
+        {
+            mac.reset(new Cmac {task.algo, task.mode, task.key, nullptr});
+        }
+        else
+        {
+            mac->rekey(task.key.data(), task.key.size());
+        }
+
+        if (!task.iv.empty())
+            mac->update(nullptr, task.iv.data(), task.iv.size());
+
+        std::vector<uint8_t> output;
+        mac->finalize(output, task.input);
+
+        return output;
+    }
+};
+
+RippaSSL::Executor::Executor(unsigned int workerCount, size_t queueDepth)
+: maxQueued {std::max<size_t>(queueDepth, 1)}, stopping {false}
+{
+    if (!workerCount)
+        workerCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    workers.reserve(workerCount);
+
+    // should a thread fail to start, the ones already running are stopped
+    // and joined before giving up, as the destructor won't run:
+    try {
+        for (unsigned int i = 0; i < workerCount; ++i)
+            workers.emplace_back(&Executor::workerLoop, this);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock {queueMutex};
+            stopping = true;
+        }
+
+        notEmpty.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+        throw;
+    }
+}
+
+std::future<std::vector<uint8_t>> RippaSSL::Executor::submit(CipherTask task)
+{
+    // std::function requires copyable targets, hence the shared promise:
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    std::future<std::vector<uint8_t>> result {promise->get_future()};
+
+    enqueue([promise, task {std::move(task)}] (WorkerContexts& contexts) {
+        try {
+            promise->set_value(contexts.run(task));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+
+    return result;
+}
+
+std::future<std::vector<uint8_t>> RippaSSL::Executor::submit(MacTask task)
+{
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    std::future<std::vector<uint8_t>> result {promise->get_future()};
+
+    enqueue([promise, task {std::move(task)}] (WorkerContexts& contexts) {
+        try {
+            promise->set_value(contexts.run(task));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+
+    return result;
+}
+
+void RippaSSL::Executor::submit(CipherTask task, TaskCallback callback)
+{
+    enqueue([callback {std::move(callback)}, task {std::move(task)}]
+            (WorkerContexts& contexts) {
+        std::vector<uint8_t> output;
+        std::exception_ptr error;
+
+        try {
+            output = contexts.run(task);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        callback(std::move(output), error);
+    });
+}
+
+void RippaSSL::Executor::submit(MacTask task, TaskCallback callback)
+{
+    enqueue([callback {std::move(callback)}, task {std::move(task)}]
+            (WorkerContexts& contexts) {
+        std::vector<uint8_t> output;
+        std::exception_ptr error;
+
+        try {
+            output = contexts.run(task);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        callback(std::move(output), error);
+    });
+}
+
+unsigned int RippaSSL::Executor::workerCount() const
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+size_t RippaSSL::Executor::queueDepth() const
+{
+    return maxQueued;
+}
+
+void RippaSSL::Executor::enqueue(QueuedTask task)
+{
+    {
+        std::unique_lock<std::mutex> lock {queueMutex};
+        notFull.wait(lock, [this] { return queue.size() < maxQueued; });
+        queue.push_back(std::move(task));
+    }
+
+    notEmpty.notify_one();
+}
+
+void RippaSSL::Executor::workerLoop()
+{
+    WorkerContexts contexts;
+
+    for (;;)
+    {
+        QueuedTask task;
+
+        {
+            std::unique_lock<std::mutex> lock {queueMutex};
+            notEmpty.wait(lock, [this] { return stopping || !queue.empty(); });
+
+            if (queue.empty())
+                return;
+
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+
+        notFull.notify_one();
+        task(contexts);
+    }
+}
+
+RippaSSL::Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock {queueMutex};
+        stopping = true;
+    }
+
+    notEmpty.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
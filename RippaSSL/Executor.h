@@ -0,0 +1,106 @@
+#ifndef RIPPASSL_EXECUTOR_H
+#define RIPPASSL_EXECUTOR_H
+
+#include "Base.h"
+#include "Mac.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <exception>
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    /*!
+    A whole-message encryption or decryption, as Cipher::finalize runs it.
+    iv is empty for ECB. AEAD modes aren't supported.
+    */
+    struct CipherTask {
+        Algo                 algo;
+        BcmMode              mode;
+        std::vector<uint8_t> key;
+        std::vector<uint8_t> iv;
+        std::vector<uint8_t> input;
+        bool                 padding;
+    };
+
+    /*!
+    A whole-message MAC, as Cmac::finalize computes it: a non-empty iv is
+    absorbed first, as the Cmac constructor does.
+    */
+    struct MacTask {
+        Algo                 algo;
+        MacMode              mode;
+        std::vector<uint8_t> key;
+        std::vector<uint8_t> iv;
+        std::vector<uint8_t> input;
+    };
+
+    /*!
+    Called on a worker thread with the result of a task, or with the
+    exception it threw (the result is then empty). It shall not throw.
+    */
+    typedef std::function<void(std::vector<uint8_t>, std::exception_ptr)>
+        TaskCallback;
+
+    /*!
+    Runs Cipher and Cmac tasks on a fixed pool of worker threads, off the
+    callers' threads. Every worker keeps its own contexts, one per algorithm
+    and mode, and rekeys them from task to task instead of allocating new
+    ones. Tasks wait in a queue of bounded depth: submitting to a full queue
+    blocks the caller until a worker frees a slot, which throttles producers
+    to the pace of the pool.
+    */
+    class Executor {
+        public:
+            /*!
+            workerCount of 0 picks one worker per hardware thread; queueDepth
+            is the number of tasks that may be waiting (at least 1).
+            */
+            explicit Executor(unsigned int workerCount = 0,
+                              size_t       queueDepth  = 256);
+
+            /*!
+            Queue a task, blocking while the queue is full. The result (or the
+            exception thrown by the task) is delivered through the future or
+            the callback.
+            */
+            std::future<std::vector<uint8_t>> submit(CipherTask task);
+            std::future<std::vector<uint8_t>> submit(MacTask task);
+            void submit(CipherTask task, TaskCallback callback);
+            void submit(MacTask task, TaskCallback callback);
+
+            unsigned int workerCount() const;
+            size_t queueDepth() const;
+
+            /*!
+            Runs the tasks still queued, then joins the workers.
+            */
+            ~Executor();
+
+            Executor(const Executor&)             = delete;
+            Executor& operator= (const Executor&) = delete;
+
+        private:
+            struct WorkerContexts;
+            typedef std::function<void(WorkerContexts&)> QueuedTask;
+
+            void enqueue(QueuedTask task);
+            void workerLoop();
+
+            std::vector<std::thread> workers;
+            std::deque<QueuedTask>   queue;
+            size_t                   maxQueued;
+            std::mutex               queueMutex;
+            std::condition_variable  notEmpty;
+            std::condition_variable  notFull;
+            bool                     stopping;
+    };
+}
+
+#endif
@@ -1,6 +1,9 @@
 
 #include "Mac.h"
 #include "Base.h"
+#include "Registry.h"
+#include "Profiler.h"
+#include "MessageBatch.h"
 #include "error.h"
 
 #include <openssl/evp.h>
@@ -10,52 +13,36 @@
 #include <string>
 #include <map>
 
-const std::map<RippaSSL::Algo, std::string> cmacAlgoMap {
-    {RippaSSL::Algo::AES128CBC, "aes-128-cbc"},
-    {RippaSSL::Algo::AES256CBC, "aes-256-cbc"}
-};
-
 RippaSSL::Cmac::Cmac(Algo                        algo,
                      MacMode                     mode,
                      const std::vector<uint8_t>& key,
                      const uint8_t*              iv,
                      bool                        padding)
-: SymCryptoBase(algo, padding)
+: Cmac(algo, mode, key.data(), key.size(), iv, padding)
 {
-    std::string fetchedMac;
-    // throws std::out_of_range if algo doesn't map to a valid key!
-    const std::string macAlgo {cmacAlgoMap.at(algo)};
-
-    // fetches the required mode of operation (TODO: only CMAC supported now):
-    switch (mode)
-    {
-        case RippaSSL::MacMode::CMAC:
-            fetchedMac =  "cmac";
-
-            break;
-    }
+    // nothing required.
+}
 
-    this->handle = EVP_MAC_fetch(NULL, fetchedMac.c_str(), NULL);
-
-    // prepares the parameters to be passed to the OpenSSL init function:
-    OSSL_PARAM params[] = {
-                            // array element 0:
-                            OSSL_PARAM_construct_utf8_string(
-                                "cipher",
-                                const_cast<char*>(macAlgo.c_str()),
-                                0),
-                            // array element 1 (ending one):
-                            OSSL_PARAM_construct_end()
-                          };
-
-    if ((NULL == this->handle)                                               ||
-        (NULL == (this->context =
-                    EVP_MAC_CTX_new(const_cast<CmacHandle*>(this->handle)))) ||
-        !EVP_MAC_init(this->context,
-                      (const unsigned char *) key.data(), key.size(),
-                      params)
-       )
+RippaSSL::Cmac::Cmac(Algo                        algo,
+                     MacMode                     mode,
+                     const uint8_t*              key,
+                     size_t                      keyLen,
+                     const uint8_t*              iv,
+                     bool                        padding)
+: SymCryptoBase(algo, padding)
+{
+    // the mode of operation is fetched once per process by the registry,
+    // which also hands out contexts already set up with the cipher. Throws
+    // std::out_of_range if algo doesn't map to a CMAC cipher!
+    this->handle  = fetchMac(mode);
+    this->context = newMacContext(mode, algo);
+
+    // a NULL key would restart the context with the template's one:
+    if ((NULL == key) ||
+        !EVP_MAC_init(this->context, (const unsigned char *) key, keyLen,
+                      NULL))
     {
+        EVP_MAC_CTX_free(this->context);
         throw InputError_NULLPTR {};
     }
 
@@ -68,50 +55,129 @@ RippaSSL::Cmac::Cmac(Algo                        algo,
 int RippaSSL::Cmac::update(      std::vector<uint8_t>& output,
                            const std::vector<uint8_t>& input)
 {
-    // prepares output buffer. This is sufficient as the update function does
-    // not apply padding:
-    if ( output.size() < input.size())
+    return update(output.data(), input.data(), input.size());
+}
+
+int RippaSSL::Cmac::finalize(      std::vector<uint8_t>& output,
+                             const std::vector<uint8_t>& input)
+{
+    // input is absorbed before resizing output, as they might be the same
+    // object:
+    if (input.size())
     {
-        output.resize(input.size());
+        try {
+            this->update(output.data(), input.data(), input.size());
+        } catch (OpenSSLError_CryptoUpdate& cu) {
+            throw OpenSSLError_CryptoFinalize {};
+        }
     }
 
-    if (!EVP_MAC_update(this->context, input.data(), input.size()))
+    output.resize(blockSizes.at(this->currentAlgorithm));
+
+    return finalize(output.data(), nullptr, 0);
+}
+
+size_t RippaSSL::Cmac::update(uint8_t*       output,
+                              const uint8_t* input,
+                              size_t         inputLen)
+{
+    ProfileScope profile {this->currentAlgorithm,
+                          KernelOperation::MacUpdate, inputLen};
+
+    if (!EVP_MAC_update(this->context, input, inputLen))
         throw OpenSSLError_CryptoUpdate {};
 
-    this->alreadyUpdatedData += input.size();
+    this->alreadyUpdatedData += inputLen;
 
     return 0;
 }
 
-int RippaSSL::Cmac::finalize(      std::vector<uint8_t>& output,
-                             const std::vector<uint8_t>& input)
+size_t RippaSSL::Cmac::finalize(uint8_t*       output,
+                                const uint8_t* input,
+                                size_t         inputLen)
 {
+    ProfileScope profile {this->currentAlgorithm,
+                          KernelOperation::MacFinalize, inputLen};
+
     size_t finalizeLen = 0;
 
-    if (input.size())
+    if (inputLen)
     {
         try {
-            this->update(output, input);
+            this->update(output, input, inputLen);
         } catch (OpenSSLError_CryptoUpdate& cu) {
             throw OpenSSLError_CryptoFinalize {};
         }
     }
 
     if (!EVP_MAC_final(this->context,
-                       output.data(), &finalizeLen, input.size()))
+                       output, &finalizeLen,
+                       blockSizes.at(this->currentAlgorithm)))
     {
         throw OpenSSLError_CryptoFinalize {};
     }
 
-    return 0;
+    return finalizeLen;
+}
+
+void RippaSSL::Cmac::rekey(const uint8_t* key, size_t keyLen)
+{
+    // the underlying cipher set at construction is kept by the context:
+    if ((NULL == key) ||
+        !EVP_MAC_init(this->context, (const unsigned char *) key, keyLen, NULL))
+    {
+        throw OpenSSLError_CryptoInit {};
+    }
+
+    this->alreadyUpdatedData = 0;
+}
+
+void RippaSSL::Cmac::reset()
+{
+    // a NULL key restarts the computation with the one already set:
+    if (!EVP_MAC_init(this->context, NULL, 0, NULL))
+        throw OpenSSLError_CryptoInit {};
+
+    this->alreadyUpdatedData = 0;
+}
+
+void RippaSSL::Cmac::finalizeBatch(MessageBatch& batch)
+{
+    if (batch.algorithm() != this->currentAlgorithm)
+        throw InputError_UNSUPPORTED_MODE {};
+
+    const size_t records = batch.size();
+    size_t currentKey = MessageBatch::noKey;
+
+    for (size_t i = 0; i < records; ++i)
+    {
+        // the next record is contiguous, so its loads overlap this one's work:
+        if (i + 1 < records)
+            __builtin_prefetch(batch.payload(i + 1));
+
+        if (batch.keyIndex(i) == currentKey)
+        {
+            reset();
+        }
+        else
+        {
+            rekey(batch.key(i), batch.keyLength(i));
+            currentKey = batch.keyIndex(i);
+        }
+
+        if (nullptr != batch.iv(i))
+            update(nullptr, batch.iv(i), blockSizes.at(this->currentAlgorithm));
+
+        batch.setOutputLength(i, finalize(batch.output(i), batch.payload(i),
+                                          batch.payloadLength(i)));
+    }
 }
 
 RippaSSL::Cmac::~Cmac()
 {
+    // the handle belongs to the registry, only the context is released:
     if (nullptr != this->context)
         EVP_MAC_CTX_free(this->context);
-    if (nullptr != this->handle)
-        EVP_MAC_free(const_cast<CmacHandle*>(this->handle));
 }
 
 RippaSSL::Cmac& RippaSSL::Cmac::operator= (Cmac&& prev)
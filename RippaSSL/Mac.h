@@ -10,6 +10,8 @@
 #include <map>
 
 namespace RippaSSL {
+    class MessageBatch;
+
     enum class MacMode
     {
         CMAC
@@ -23,11 +25,52 @@ namespace RippaSSL {
                           const uint8_t*              iv,
                           bool                        padding = false);
 
+            explicit Cmac(Algo                        algo,
+                          MacMode                     mode,
+                          const uint8_t*              key,
+                          size_t                      keyLen,
+                          const uint8_t*              iv,
+                          bool                        padding = false);
+
+            /*!
+            finalize resizes output to the MAC length.
+            */
             int update(      std::vector<uint8_t>& output,
                        const std::vector<uint8_t>& input);
             int finalize(      std::vector<uint8_t>& output,
                          const std::vector<uint8_t>& input);
 
+            /*!
+            update only absorbs the input and writes nothing, so output may be
+            nullptr. finalize writes the MAC, which is one block long.
+            */
+            size_t update(uint8_t*       output,
+                          const uint8_t* input,
+                          size_t         inputLen);
+            size_t finalize(uint8_t*       output,
+                            const uint8_t* input,
+                            size_t         inputLen);
+
+            /*!
+            Restarts the MAC computation with a new key (of the algorithm given
+            at construction), reusing the context.
+            */
+            void rekey(const uint8_t* key, size_t keyLen);
+
+            /*!
+            Restarts the MAC computation with the current key.
+            */
+            void reset();
+
+            /*!
+            Computes the MAC of every record of "batch" (prefixed by its IV, if
+            any, as the constructor does) into its output slot. Consecutive
+            records sharing a key skip the rekeying. The batch shall be for
+            the algorithm given at construction, else
+            InputError_UNSUPPORTED_MODE is thrown.
+            */
+            void finalizeBatch(MessageBatch& batch);
+
             ~Cmac();
 
             // explicitly disables copy semantics:
@@ -0,0 +1,135 @@
+#include "MessageBatch.h"
+#include "Base.h"
+
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+RippaSSL::MessageBatch::MessageBatch(Algo algo)
+: currentAlgorithm {algo}
+{
+    // throws std::out_of_range early for unknown algorithms:
+    blockSizes.at(algo);
+    ivSizes.at(algo);
+}
+
+void RippaSSL::MessageBatch::reserve(size_t records, size_t payloadBytes)
+{
+    this->records.reserve(records);
+    payloadArena.reserve(payloadBytes);
+    outputArena.reserve(payloadBytes +
+                        records * blockSizes.at(currentAlgorithm));
+}
+
+size_t RippaSSL::MessageBatch::addKey(const uint8_t* key, size_t keyLen)
+{
+    keys.push_back({keyArena.size(), keyLen});
+    keyArena.insert(keyArena.end(), key, key + keyLen);
+
+    return keys.size() - 1;
+}
+
+size_t RippaSSL::MessageBatch::addIv(const uint8_t* iv)
+{
+    size_t ivLen = ivSizes.at(currentAlgorithm);
+
+    ivArena.insert(ivArena.end(), iv, iv + ivLen);
+
+    return ivArena.size() / ivLen - 1;
+}
+
+size_t RippaSSL::MessageBatch::add(const uint8_t* payload,
+                                   size_t         payloadLen,
+                                   size_t         keyIndex,
+                                   size_t         ivIndex)
+{
+    if ((keyIndex >= keys.size()) ||
+        ((noIv != ivIndex) &&
+         (ivIndex >= ivArena.size() / ivSizes.at(currentAlgorithm))))
+    {
+        throw std::out_of_range {"MessageBatch: unknown key or IV index"};
+    }
+
+    records.push_back({payloadArena.size(), payloadLen,
+                       outputArena.size(), 0, keyIndex, ivIndex});
+    payloadArena.insert(payloadArena.end(), payload, payload + payloadLen);
+    outputArena.resize(outputArena.size() + payloadLen +
+                       blockSizes.at(currentAlgorithm));
+
+    return records.size() - 1;
+}
+
+void RippaSSL::MessageBatch::clear()
+{
+    payloadArena.clear();
+    outputArena.clear();
+    keyArena.clear();
+    ivArena.clear();
+    records.clear();
+    keys.clear();
+}
+
+RippaSSL::Algo RippaSSL::MessageBatch::algorithm() const
+{
+    return currentAlgorithm;
+}
+
+size_t RippaSSL::MessageBatch::size() const
+{
+    return records.size();
+}
+
+const uint8_t* RippaSSL::MessageBatch::payload(size_t record) const
+{
+    return payloadArena.data() + records[record].offset;
+}
+
+size_t RippaSSL::MessageBatch::payloadLength(size_t record) const
+{
+    return records[record].length;
+}
+
+size_t RippaSSL::MessageBatch::keyIndex(size_t record) const
+{
+    return records[record].keyIndex;
+}
+
+const uint8_t* RippaSSL::MessageBatch::key(size_t record) const
+{
+    return keyArena.data() + keys[records[record].keyIndex].offset;
+}
+
+size_t RippaSSL::MessageBatch::keyLength(size_t record) const
+{
+    return keys[records[record].keyIndex].length;
+}
+
+const uint8_t* RippaSSL::MessageBatch::iv(size_t record) const
+{
+    if (noIv == records[record].ivIndex)
+        return nullptr;
+
+    return ivArena.data() +
+           records[record].ivIndex * ivSizes.at(currentAlgorithm);
+}
+
+uint8_t* RippaSSL::MessageBatch::output(size_t record)
+{
+    return outputArena.data() + records[record].outputOffset;
+}
+
+const uint8_t* RippaSSL::MessageBatch::output(size_t record) const
+{
+    return outputArena.data() + records[record].outputOffset;
+}
+
+size_t RippaSSL::MessageBatch::outputLength(size_t record) const
+{
+    return records[record].outputLength;
+}
+
+void RippaSSL::MessageBatch::setOutputLength(size_t record, size_t len)
+{
+    records[record].outputLength = len;
+}
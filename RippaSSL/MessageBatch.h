@@ -0,0 +1,102 @@
+#ifndef RIPPASSL_MESSAGEBATCH_H
+#define RIPPASSL_MESSAGEBATCH_H
+
+#include "Base.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    /*!
+    Many messages for one algorithm, laid out for bulk processing: payloads
+    sit back to back in a single arena, described by an offset/length table,
+    and so do keys and IVs, which records refer to by index (several records
+    may share a key). Every record owns an output slot in a second arena,
+    sized for its payload plus one block of padding, so batch calls never
+    allocate.
+    */
+    class MessageBatch {
+        public:
+            // IV index of the records that don't take one:
+            static constexpr size_t noIv = static_cast<size_t>(-1);
+
+            // never a key index, for batch loops that have none selected yet:
+            static constexpr size_t noKey = static_cast<size_t>(-1);
+
+            explicit MessageBatch(Algo algo);
+
+            /*!
+            Reserves room for "records" messages totalling payloadBytes.
+            */
+            void reserve(size_t records, size_t payloadBytes);
+
+            /*!
+            Store a key (of any length, checked when it's used) or an IV
+            (ivSizes bytes for the batch's algorithm), returning its index.
+            */
+            size_t addKey(const uint8_t* key, size_t keyLen);
+            size_t addIv(const uint8_t* iv);
+
+            /*!
+            Appends a message, copied into the arena, to be processed with the
+            given key and IV; only ECB records shall go without an IV. Throws
+            std::out_of_range on unknown indexes. Returns the index of the
+            record.
+            */
+            size_t add(const uint8_t* payload,
+                       size_t         payloadLen,
+                       size_t         keyIndex,
+                       size_t         ivIndex = noIv);
+
+            /*!
+            Drops every record, key and IV, keeping the memory.
+            */
+            void clear();
+
+            Algo algorithm() const;
+            size_t size() const;
+
+            const uint8_t* payload(size_t record) const;
+            size_t payloadLength(size_t record) const;
+            size_t keyIndex(size_t record) const;
+            const uint8_t* key(size_t record) const;
+            size_t keyLength(size_t record) const;
+            // nullptr if the record has no IV:
+            const uint8_t* iv(size_t record) const;
+
+            /*!
+            The output slot of a record, whose capacity is its payload length
+            plus one block; outputLength is what the last batch call wrote.
+            */
+            uint8_t* output(size_t record);
+            const uint8_t* output(size_t record) const;
+            size_t outputLength(size_t record) const;
+            void setOutputLength(size_t record, size_t len);
+
+        private:
+            struct Record {
+                size_t offset;
+                size_t length;
+                size_t outputOffset;
+                size_t outputLength;
+                size_t keyIndex;
+                size_t ivIndex;
+            };
+
+            struct KeyEntry {
+                size_t offset;
+                size_t length;
+            };
+
+            Algo                  currentAlgorithm;
+            std::vector<uint8_t>  payloadArena;
+            std::vector<uint8_t>  outputArena;
+            std::vector<uint8_t>  keyArena;
+            std::vector<uint8_t>  ivArena;
+            std::vector<Record>   records;
+            std::vector<KeyEntry> keys;
+    };
+}
+
+#endif
@@ -0,0 +1,359 @@
+#include "MultiBuffer.h"
+#include "AesNi.h"
+#include "Base.h"
+#include "Cipher.h"
+#include "Mac.h"
+#include "error.h"
+
+#include <openssl/crypto.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RIPPASSL_AESNI
+#endif
+
+namespace {
+    constexpr size_t aesBlock = 16;
+
+    size_t keyLength(RippaSSL::Algo algo)
+    {
+        if (RippaSSL::Algo::AES128CBC == algo)
+            return 16;
+        if (RippaSSL::Algo::AES256CBC == algo)
+            return 32;
+
+        throw RippaSSL::InputError_UNSUPPORTED_MODE {};
+    }
+
+    // CMAC subkey derivation: multiplication by x in GF(2^128), on a
+    // big-endian block:
+    void doubleBlock(uint8_t* out, const uint8_t* in)
+    {
+        uint8_t carry = 0;
+
+        for (size_t i = aesBlock; i-- > 0; )
+        {
+            out[i] = static_cast<uint8_t>((in[i] << 1) | carry);
+            carry = in[i] >> 7;
+        }
+
+        if (in[0] & 0x80)
+            out[aesBlock - 1] ^= 0x87;
+    }
+
+#ifdef RIPPASSL_AESNI
+    struct CbcLane {
+        RippaSSL::AesKeySchedule schedule;
+        __m128i                  chain;
+        const uint8_t*           input;
+        uint8_t*                 output;
+        size_t                   remaining;
+    };
+
+    struct CmacLane {
+        RippaSSL::AesKeySchedule schedule;
+        __m128i                  chain;
+        // the last block, already padded and masked with its subkey:
+        __m128i                  lastBlock;
+        const uint8_t*           input;
+        size_t                   fullBlocks;
+        uint8_t*                 tag;
+    };
+
+    __attribute__((target("aes,sse2")))
+    __m128i encryptBlock(const RippaSSL::AesKeySchedule& schedule,
+                         __m128i                         block)
+    {
+        const __m128i* rk =
+            reinterpret_cast<const __m128i*>(schedule.roundKeys);
+
+        block = _mm_xor_si128(block, rk[0]);
+        for (unsigned int r = 1; r < schedule.rounds; ++r)
+            block = _mm_aesenc_si128(block, rk[r]);
+
+        return _mm_aesenclast_si128(block, rk[schedule.rounds]);
+    }
+
+    // one round on every active lane: the instructions are independent of
+    // each other, so they overlap in the pipeline:
+    __attribute__((target("aes,sse2")))
+    inline void roundAcross(__m128i*              states,
+                            const size_t*         active,
+                            size_t                activeCount,
+                            const uint8_t* const* roundKeys,
+                            unsigned int          r,
+                            bool                  last)
+    {
+        for (size_t l = 0; l < activeCount; ++l)
+        {
+            __m128i rk = _mm_load_si128(reinterpret_cast<const __m128i*>(
+                                            roundKeys[active[l]] + r * 16));
+            states[l] = last ? _mm_aesenclast_si128(states[l], rk) :
+                               _mm_aesenc_si128(states[l], rk);
+        }
+    }
+
+    // loads the next non-empty job into "lane"; returns false when none is
+    // left:
+    __attribute__((target("aes,sse2")))
+    bool loadCbcLane(CbcLane&                  lane,
+                     const RippaSSL::CbcJob*   jobs,
+                     size_t                    count,
+                     size_t&                   next,
+                     size_t                    keyLen)
+    {
+        while ((next < count) && !jobs[next].length)
+            ++next;
+
+        if (next == count)
+            return false;
+
+        const RippaSSL::CbcJob& job = jobs[next++];
+        RippaSSL::expandAesKey(lane.schedule, job.key, keyLen);
+        lane.chain     = _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(job.iv));
+        lane.input     = job.input;
+        lane.output    = job.output;
+        lane.remaining = job.length / aesBlock;
+
+        return true;
+    }
+
+    __attribute__((target("aes,sse2")))
+    void cbcEncryptLanes(const RippaSSL::CbcJob* jobs,
+                         size_t                  count,
+                         size_t                  keyLen)
+    {
+        CbcLane lanes[RippaSSL::multiBufferLanes];
+        const uint8_t* roundKeys[RippaSSL::multiBufferLanes];
+        size_t active[RippaSSL::multiBufferLanes];
+        size_t activeCount = 0;
+        size_t next = 0;
+
+        for (size_t l = 0; l < RippaSSL::multiBufferLanes; ++l)
+        {
+            roundKeys[l] = lanes[l].schedule.roundKeys;
+            if (loadCbcLane(lanes[l], jobs, count, next, keyLen))
+                active[activeCount++] = l;
+        }
+
+        while (activeCount)
+        {
+            __m128i states[RippaSSL::multiBufferLanes];
+            // all the keys have the same length:
+            unsigned int rounds = lanes[active[0]].schedule.rounds;
+
+            for (size_t l = 0; l < activeCount; ++l)
+            {
+                CbcLane& lane = lanes[active[l]];
+                __m128i block = _mm_loadu_si128(
+                                    reinterpret_cast<const __m128i*>(
+                                        lane.input));
+                states[l] = _mm_xor_si128(
+                                _mm_xor_si128(block, lane.chain),
+                                _mm_load_si128(
+                                    reinterpret_cast<const __m128i*>(
+                                        roundKeys[active[l]])));
+            }
+
+            for (unsigned int r = 1; r < rounds; ++r)
+                roundAcross(states, active, activeCount, roundKeys, r, false);
+            roundAcross(states, active, activeCount, roundKeys, rounds, true);
+
+            for (size_t l = activeCount; l-- > 0; )
+            {
+                CbcLane& lane = lanes[active[l]];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lane.output),
+                                 states[l]);
+                lane.chain   = states[l];
+                lane.input  += aesBlock;
+                lane.output += aesBlock;
+
+                // a finished lane takes the next job, or leaves the set:
+                if (!--lane.remaining &&
+                    !loadCbcLane(lane, jobs, count, next, keyLen))
+                {
+                    active[l] = active[--activeCount];
+                }
+            }
+        }
+
+        // the key schedules don't outlive the call, as in Cipher:
+        OPENSSL_cleanse(lanes, sizeof(lanes));
+    }
+
+    __attribute__((target("aes,sse2")))
+    bool loadCmacLane(CmacLane&                 lane,
+                      const RippaSSL::CmacJob*  jobs,
+                      size_t                    count,
+                      size_t&                   next,
+                      size_t                    keyLen)
+    {
+        if (next == count)
+            return false;
+
+        const RippaSSL::CmacJob& job = jobs[next++];
+        RippaSSL::expandAesKey(lane.schedule, job.key, keyLen);
+
+        alignas(16) uint8_t subkey1[aesBlock];
+        alignas(16) uint8_t subkey2[aesBlock];
+        alignas(16) uint8_t last[aesBlock] {};
+
+        _mm_store_si128(reinterpret_cast<__m128i*>(subkey2),
+                        encryptBlock(lane.schedule, _mm_setzero_si128()));
+        doubleBlock(subkey1, subkey2);
+        doubleBlock(subkey2, subkey1);
+
+        // the empty message is one padded block:
+        size_t blocks = job.length ? (job.length + aesBlock - 1) / aesBlock :
+                                     1;
+        size_t lastLen = job.length - (blocks - 1) * aesBlock;
+
+        if (lastLen)
+            std::memcpy(last, job.input + (blocks - 1) * aesBlock, lastLen);
+        if (aesBlock != lastLen)
+            last[lastLen] = 0x80;
+
+        lane.lastBlock  = _mm_xor_si128(
+                            _mm_load_si128(
+                                reinterpret_cast<const __m128i*>(last)),
+                            _mm_load_si128(
+                                reinterpret_cast<const __m128i*>(
+                                    (aesBlock == lastLen) ? subkey1 :
+                                                            subkey2)));
+        lane.chain      = _mm_setzero_si128();
+        lane.input      = job.input;
+        lane.fullBlocks = blocks - 1;
+        lane.tag        = job.tag;
+
+        OPENSSL_cleanse(subkey1, sizeof(subkey1));
+        OPENSSL_cleanse(subkey2, sizeof(subkey2));
+        OPENSSL_cleanse(last, sizeof(last));
+
+        return true;
+    }
+
+    __attribute__((target("aes,sse2")))
+    void cmacLanes(const RippaSSL::CmacJob* jobs,
+                   size_t                   count,
+                   size_t                   keyLen)
+    {
+        CmacLane lanes[RippaSSL::multiBufferLanes];
+        const uint8_t* roundKeys[RippaSSL::multiBufferLanes];
+        size_t active[RippaSSL::multiBufferLanes];
+        size_t activeCount = 0;
+        size_t next = 0;
+
+        for (size_t l = 0; l < RippaSSL::multiBufferLanes; ++l)
+        {
+            roundKeys[l] = lanes[l].schedule.roundKeys;
+            if (loadCmacLane(lanes[l], jobs, count, next, keyLen))
+                active[activeCount++] = l;
+        }
+
+        while (activeCount)
+        {
+            __m128i states[RippaSSL::multiBufferLanes];
+            unsigned int rounds = lanes[active[0]].schedule.rounds;
+
+            for (size_t l = 0; l < activeCount; ++l)
+            {
+                CmacLane& lane = lanes[active[l]];
+                __m128i block = lane.fullBlocks ?
+                                    _mm_loadu_si128(
+                                        reinterpret_cast<const __m128i*>(
+                                            lane.input)) :
+                                    lane.lastBlock;
+                states[l] = _mm_xor_si128(
+                                _mm_xor_si128(block, lane.chain),
+                                _mm_load_si128(
+                                    reinterpret_cast<const __m128i*>(
+                                        roundKeys[active[l]])));
+            }
+
+            for (unsigned int r = 1; r < rounds; ++r)
+                roundAcross(states, active, activeCount, roundKeys, r, false);
+            roundAcross(states, active, activeCount, roundKeys, rounds, true);
+
+            for (size_t l = activeCount; l-- > 0; )
+            {
+                CmacLane& lane = lanes[active[l]];
+                lane.chain = states[l];
+
+                if (lane.fullBlocks)
+                {
+                    --lane.fullBlocks;
+                    lane.input += aesBlock;
+                    continue;
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(lane.tag),
+                                 states[l]);
+                if (!loadCmacLane(lane, jobs, count, next, keyLen))
+                    active[l] = active[--activeCount];
+            }
+        }
+
+        // the key schedules and the subkey-masked last blocks:
+        OPENSSL_cleanse(lanes, sizeof(lanes));
+    }
+#endif
+}
+
+void RippaSSL::cbcEncryptMulti(Algo algo, const CbcJob* jobs, size_t count)
+{
+    size_t keyLen = keyLength(algo);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (jobs[i].length % aesBlock)
+            throw InputError_MISALIGNED_DATA {};
+    }
+
+    if (!count)
+        return;
+
+#ifdef RIPPASSL_AESNI
+    if (aesNiAvailable())
+    {
+        cbcEncryptLanes(jobs, count, keyLen);
+        return;
+    }
+#endif
+
+    // scalar fallback: one context, rekeyed for every job:
+    Cipher cipher {algo, BcmMode::Bcm_CBC_Encrypt,
+                   jobs[0].key, keyLen, jobs[0].iv};
+    for (size_t i = 0; i < count; ++i)
+    {
+        cipher.rekey(jobs[i].key, keyLen, jobs[i].iv);
+        cipher.finalize(jobs[i].output, jobs[i].input, jobs[i].length);
+    }
+}
+
+void RippaSSL::cmacMulti(Algo algo, const CmacJob* jobs, size_t count)
+{
+    size_t keyLen = keyLength(algo);
+
+    if (!count)
+        return;
+
+#ifdef RIPPASSL_AESNI
+    if (aesNiAvailable())
+    {
+        cmacLanes(jobs, count, keyLen);
+        return;
+    }
+#endif
+
+    Cmac mac {algo, MacMode::CMAC, jobs[0].key, keyLen, nullptr};
+    for (size_t i = 0; i < count; ++i)
+    {
+        mac.rekey(jobs[i].key, keyLen);
+        mac.finalize(jobs[i].tag, jobs[i].input, jobs[i].length);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef RIPPASSL_MULTIBUFFER_H
+#define RIPPASSL_MULTIBUFFER_H
+
+#include "Base.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    // number of independent messages advanced in lock-step: enough to cover
+    // the latency of the AES rounds on current cores:
+    constexpr size_t multiBufferLanes = 8;
+
+    /*!
+    One CBC encryption (no padding) of a whole message: length shall be a
+    multiple of the block size. output may point to input, and has room for
+    length bytes. The key is 16 bytes long for AES128CBC, 32 for AES256CBC.
+    */
+    struct CbcJob {
+        const uint8_t* key;
+        const uint8_t* iv;
+        const uint8_t* input;
+        uint8_t*       output;
+        size_t         length;
+    };
+
+    /*!
+    One CMAC of a whole message, of any length; the tag is one block long.
+    */
+    struct CmacJob {
+        const uint8_t* key;
+        const uint8_t* input;
+        size_t         length;
+        uint8_t*       tag;
+    };
+
+    /*!
+    Runs count independent jobs, each with its own key, interleaving the
+    blocks of up to multiBufferLanes messages at a time so that the AES-NI
+    pipeline never waits on the serial chaining of a single message. A lane
+    is refilled with the next job as soon as its message ends. Without AES-NI,
+    the jobs run one after the other through OpenSSL.
+    algo is AES128CBC or AES256CBC, else InputError_UNSUPPORTED_MODE is
+    thrown; cbcEncryptMulti throws InputError_MISALIGNED_DATA if any length
+    isn't a multiple of the block size. Both checks precede any output.
+    */
+    void cbcEncryptMulti(Algo algo, const CbcJob* jobs, size_t count);
+    void cmacMulti(Algo algo, const CmacJob* jobs, size_t count);
+}
+
+#endif
@@ -0,0 +1,240 @@
+#include "Profiler.h"
+#include "Base.h"
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define RIPPASSL_TSC
+#endif
+
+std::atomic<bool> RippaSSL::profilingFlag {false};
+
+namespace {
+    enum Counter
+    {
+        Cycles,
+        Instructions,
+        CacheMisses,
+        CounterCount
+    };
+
+    /*!
+    The counters of one thread: a perf_event_open group, read in a single
+    system call, or nothing if the kernel refuses it.
+    */
+    class ThreadCounters {
+        public:
+            ThreadCounters() : leader {-1}, members {-1, -1}
+            {
+#ifdef __linux__
+                static const uint64_t configs[CounterCount] = {
+                    PERF_COUNT_HW_CPU_CYCLES,
+                    PERF_COUNT_HW_INSTRUCTIONS,
+                    PERF_COUNT_HW_CACHE_MISSES
+                };
+
+                for (int c = 0; c < CounterCount; ++c)
+                {
+                    perf_event_attr attr;
+                    std::memset(&attr, 0, sizeof(attr));
+                    attr.size           = sizeof(attr);
+                    attr.type           = PERF_TYPE_HARDWARE;
+                    attr.config         = configs[c];
+                    attr.read_format    = PERF_FORMAT_GROUP;
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv     = 1;
+
+                    // the calling thread, on any CPU:
+                    int fd = static_cast<int>(
+                                syscall(SYS_perf_event_open, &attr, 0, -1,
+                                        leader, 0));
+                    if (fd < 0)
+                    {
+                        close();
+                        return;
+                    }
+
+                    if (Cycles == c)
+                        leader = fd;
+                    else
+                        members[c - 1] = fd;
+                }
+#endif
+            }
+
+            ~ThreadCounters()
+            {
+                close();
+            }
+
+            bool available() const
+            {
+                return leader >= 0;
+            }
+
+            /*!
+            Fills values with the current counts; without counters, cycles
+            come from the time stamp counter.
+            */
+            void read(uint64_t* values) const
+            {
+                std::memset(values, 0, CounterCount * sizeof(uint64_t));
+#ifdef __linux__
+                struct {
+                    uint64_t count;
+                    uint64_t values[CounterCount];
+                } group;
+
+                if (available() &&
+                    (sizeof(group) == ::read(leader, &group, sizeof(group))))
+                {
+                    std::memcpy(values, group.values, sizeof(group.values));
+                    return;
+                }
+#endif
+#ifdef RIPPASSL_TSC
+                values[Cycles] = __rdtsc();
+#endif
+            }
+
+        private:
+            void close()
+            {
+#ifdef __linux__
+                for (int& fd : members)
+                {
+                    if (fd >= 0)
+                        ::close(fd);
+                    fd = -1;
+                }
+
+                if (leader >= 0)
+                    ::close(leader);
+#endif
+                leader = -1;
+            }
+
+            int leader;
+            int members[CounterCount - 1];
+    };
+
+    ThreadCounters& threadCounters()
+    {
+        thread_local ThreadCounters counters;
+        return counters;
+    }
+
+    // nesting depth of the profiled calls on this thread:
+    thread_local unsigned int scopeDepth = 0;
+
+    struct Totals {
+        std::mutex mutex;
+        std::map<std::pair<RippaSSL::Algo, RippaSSL::KernelOperation>,
+                 RippaSSL::KernelProfile> profiles;
+    };
+
+    Totals& totals()
+    {
+        static Totals instance;
+        return instance;
+    }
+
+    uint64_t nowNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+    }
+}
+
+void RippaSSL::enableProfiling(bool enable)
+{
+    profilingFlag.store(enable, std::memory_order_relaxed);
+}
+
+std::vector<RippaSSL::KernelProfile> RippaSSL::profileReport()
+{
+    std::vector<KernelProfile> report;
+    std::lock_guard<std::mutex> lock {totals().mutex};
+
+    for (const auto& entry : totals().profiles)
+        report.push_back(entry.second);
+
+    return report;
+}
+
+void RippaSSL::resetProfile()
+{
+    std::lock_guard<std::mutex> lock {totals().mutex};
+    totals().profiles.clear();
+}
+
+const char* RippaSSL::operationName(KernelOperation operation)
+{
+    switch (operation)
+    {
+        case KernelOperation::CipherUpdate:   return "cipher.update";
+        case KernelOperation::CipherFinalize: return "cipher.finalize";
+        case KernelOperation::MacUpdate:      return "cmac.update";
+        case KernelOperation::MacFinalize:    return "cmac.finalize";
+    }
+
+    return "unknown";
+}
+
+void RippaSSL::ProfileScope::begin(Algo            algo,
+                                   KernelOperation operation,
+                                   size_t          bytes)
+{
+    // the outermost scope accounts for the nested ones:
+    if (scopeDepth)
+        return;
+
+    ++scopeDepth;
+    active           = true;
+    currentAlgorithm = algo;
+    currentOperation = operation;
+    currentBytes     = bytes;
+
+    startNanoseconds = nowNanoseconds();
+    threadCounters().read(startCounters);
+}
+
+void RippaSSL::ProfileScope::end()
+{
+    uint64_t counters[CounterCount];
+
+    threadCounters().read(counters);
+    uint64_t elapsed = nowNanoseconds() - startNanoseconds;
+    --scopeDepth;
+
+    std::lock_guard<std::mutex> lock {totals().mutex};
+    KernelProfile& profile =
+        totals().profiles.emplace(
+            std::make_pair(currentAlgorithm, currentOperation),
+            KernelProfile {currentAlgorithm, currentOperation, 0, 0, 0, 0, 0,
+                           0, threadCounters().available()}).first->second;
+
+    profile.calls        += 1;
+    profile.bytes        += currentBytes;
+    profile.nanoseconds  += elapsed;
+    profile.cycles       += counters[Cycles] - startCounters[Cycles];
+    profile.instructions += counters[Instructions] -
+                            startCounters[Instructions];
+    profile.cacheMisses  += counters[CacheMisses] - startCounters[CacheMisses];
+}
@@ -0,0 +1,104 @@
+#ifndef RIPPASSL_PROFILER_H
+#define RIPPASSL_PROFILER_H
+
+#include "Base.h"
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    // the calls the profiler wraps:
+    enum class KernelOperation
+    {
+        CipherUpdate,
+        CipherFinalize,
+        MacUpdate,
+        MacFinalize
+    };
+
+    /*!
+    Totals of one operation on one algorithm. With hardware counters, cycles
+    are core cycles; without them (no PMU, or perf_event_open forbidden),
+    cycles fall back to time stamp counter ticks where there is one (0
+    elsewhere), and instructions and cache misses stay 0.
+    Only the calling thread is counted: the helper threads of a parallel
+    update show up in the wall-clock time only.
+    */
+    struct KernelProfile {
+        Algo            algo;
+        KernelOperation operation;
+        uint64_t        calls;
+        uint64_t        bytes;
+        uint64_t        nanoseconds;
+        uint64_t        cycles;
+        uint64_t        instructions;
+        uint64_t        cacheMisses;
+        bool            hardwareCounters;
+    };
+
+    /*!
+    Turns the profiling of Cipher and Cmac calls on or off, process-wide.
+    While it's off, which is the default, a wrapped call only pays for one
+    relaxed atomic load.
+    */
+    void enableProfiling(bool enable);
+
+    // the state behind the two functions, for inlining's sake only:
+    extern std::atomic<bool> profilingFlag;
+
+    inline bool profilingEnabled()
+    {
+        return profilingFlag.load(std::memory_order_relaxed);
+    }
+
+    /*!
+    Returns the totals collected so far, one entry per algorithm and
+    operation that ran, and clears them, respectively.
+    */
+    std::vector<KernelProfile> profileReport();
+    void resetProfile();
+
+    /*!
+    Returns e.g. "cipher.update" for KernelOperation::CipherUpdate.
+    */
+    const char* operationName(KernelOperation operation);
+
+    /*!
+    Measures the enclosing scope as one call of "operation" over "bytes",
+    when profiling is on. Nested scopes (e.g. finalize calling update) are
+    counted in the outermost one only.
+    */
+    class ProfileScope {
+        public:
+            ProfileScope(Algo algo, KernelOperation operation, size_t bytes)
+            : active {false}
+            {
+                if (profilingEnabled())
+                    begin(algo, operation, bytes);
+            }
+
+            ~ProfileScope()
+            {
+                if (active)
+                    end();
+            }
+
+            ProfileScope(const ProfileScope&)             = delete;
+            ProfileScope& operator= (const ProfileScope&) = delete;
+
+        private:
+            void begin(Algo algo, KernelOperation operation, size_t bytes);
+            void end();
+
+            bool            active;
+            Algo            currentAlgorithm;
+            KernelOperation currentOperation;
+            size_t          currentBytes;
+            uint64_t        startNanoseconds;
+            uint64_t        startCounters[3];
+    };
+}
+
+#endif
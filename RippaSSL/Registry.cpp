@@ -0,0 +1,161 @@
+
+#include "Registry.h"
+#include "Base.h"
+#include "Mac.h"
+#include "error.h"
+
+#include <openssl/evp.h>
+#include <openssl/params.h>
+
+#include <map>
+#include <utility>
+
+namespace {
+    const std::map<RippaSSL::Algo, const char*> cipherNames {
+        {RippaSSL::Algo::AES128CBC, "AES-128-CBC"},
+        {RippaSSL::Algo::AES128ECB, "AES-128-ECB"},
+        {RippaSSL::Algo::AES256CBC, "AES-256-CBC"},
+        {RippaSSL::Algo::AES256ECB, "AES-256-ECB"},
+        {RippaSSL::Algo::AES128CTR, "AES-128-CTR"},
+        {RippaSSL::Algo::AES256CTR, "AES-256-CTR"},
+        {RippaSSL::Algo::AES128GCM, "AES-128-GCM"},
+        {RippaSSL::Algo::AES256GCM, "AES-256-GCM"}
+    };
+
+    const std::map<RippaSSL::MacMode, const char*> macNames {
+        {RippaSSL::MacMode::CMAC, "CMAC"}
+    };
+
+    typedef std::pair<RippaSSL::MacMode, RippaSSL::Algo> MacKind;
+
+    // the block ciphers the MAC templates are set up with:
+    const std::map<MacKind, const char*> macCipherNames {
+        {{RippaSSL::MacMode::CMAC, RippaSSL::Algo::AES128CBC}, "AES-128-CBC"},
+        {{RippaSSL::MacMode::CMAC, RippaSSL::Algo::AES256CBC}, "AES-256-CBC"}
+    };
+
+    /*
+    Holds the fetched handles. All of them are fetched by the constructor, so
+    the maps are read-only once the (thread-safe) static initialisation of the
+    instance is over, and lookups need no locking.
+    */
+    class Registry {
+        public:
+            static const Registry& instance()
+            {
+                static const Registry registry;
+                return registry;
+            }
+
+            const CipherHandle* cipher(RippaSSL::Algo algo) const
+            {
+                auto entry = ciphers.find(algo);
+                if ((ciphers.end() == entry) || (nullptr == entry->second))
+                    throw RippaSSL::InputError_NULLPTR {};
+
+                return entry->second;
+            }
+
+            const CmacHandle* mac(RippaSSL::MacMode mode) const
+            {
+                auto entry = macs.find(mode);
+                if ((macs.end() == entry) || (nullptr == entry->second))
+                    throw RippaSSL::InputError_NULLPTR {};
+
+                return entry->second;
+            }
+
+            CmacCtx* macContext(RippaSSL::MacMode mode,
+                                RippaSSL::Algo    algo) const
+            {
+                CmacCtx* context = nullptr;
+                const CmacCtx* prototype = macTemplates.at(MacKind {mode,
+                                                                    algo});
+
+                if ((nullptr == prototype) ||
+                    (nullptr == (context = EVP_MAC_CTX_dup(prototype))))
+                {
+                    throw RippaSSL::InputError_NULLPTR {};
+                }
+
+                return context;
+            }
+
+            Registry(const Registry&)             = delete;
+            Registry& operator= (const Registry&) = delete;
+
+        private:
+            Registry()
+            {
+                // unavailable algorithms are stored as nullptr, and reported
+                // only when requested:
+                for (const auto& name : cipherNames)
+                    ciphers[name.first] = EVP_CIPHER_fetch(NULL, name.second,
+                                                           NULL);
+
+                for (const auto& name : macNames)
+                    macs[name.first] = EVP_MAC_fetch(NULL, name.second, NULL);
+
+                // setting the cipher makes the provider fetch it, once here
+                // rather than for every context. OpenSSL only duplicates
+                // keyed CMAC contexts, so the templates get an all-zero key,
+                // which the copies replace:
+                for (const auto& name : macCipherNames)
+                {
+                    CmacHandle* mac = macs[name.first.first];
+                    CipherHandle* cipher = ciphers[name.first.second];
+                    CmacCtx* context = ((nullptr == mac) ||
+                                        (nullptr == cipher)) ?
+                                       nullptr : EVP_MAC_CTX_new(mac);
+                    const unsigned char zeroKey[EVP_MAX_KEY_LENGTH] = {};
+                    OSSL_PARAM params[] = {
+                        OSSL_PARAM_construct_utf8_string(
+                            "cipher", const_cast<char*>(name.second), 0),
+                        OSSL_PARAM_construct_end()
+                    };
+
+                    if ((nullptr != context) &&
+                        !EVP_MAC_init(context, zeroKey,
+                                      EVP_CIPHER_get_key_length(cipher),
+                                      params))
+                    {
+                        EVP_MAC_CTX_free(context);
+                        context = nullptr;
+                    }
+
+                    macTemplates[name.first] = context;
+                }
+            }
+
+            ~Registry()
+            {
+                for (const auto& context : macTemplates)
+                    EVP_MAC_CTX_free(context.second);
+
+                for (const auto& handle : ciphers)
+                    EVP_CIPHER_free(handle.second);
+
+                for (const auto& handle : macs)
+                    EVP_MAC_free(handle.second);
+            }
+
+            std::map<RippaSSL::Algo,    CipherHandle*> ciphers;
+            std::map<RippaSSL::MacMode, CmacHandle*>   macs;
+            std::map<MacKind,           CmacCtx*>      macTemplates;
+    };
+}
+
+const CipherHandle* RippaSSL::fetchCipher(Algo algo)
+{
+    return Registry::instance().cipher(algo);
+}
+
+const CmacHandle* RippaSSL::fetchMac(MacMode mode)
+{
+    return Registry::instance().mac(mode);
+}
+
+CmacCtx* RippaSSL::newMacContext(MacMode mode, Algo algo)
+{
+    return Registry::instance().macContext(mode, algo);
+}
@@ -0,0 +1,35 @@
+#ifndef RIPPASSL_REGISTRY_H
+#define RIPPASSL_REGISTRY_H
+
+#include "Base.h"
+#include "Mac.h"
+
+#include <openssl/evp.h>
+
+namespace RippaSSL {
+    /*!
+    Returns the OpenSSL cipher implementing algo. Every algorithm is fetched
+    from the providers once per process, on first use, and the handles are
+    shared afterwards: objects built on them skip the provider lookup and its
+    locks. The registry owns the handles, so callers shall not free them.
+    Throws InputError_NULLPTR if no provider offers the algorithm.
+    */
+    const CipherHandle* fetchCipher(Algo algo);
+
+    /*!
+    Same as above, for the MAC implementing mode.
+    */
+    const CmacHandle* fetchMac(MacMode mode);
+
+    /*!
+    Returns a new context for the MAC implementing mode over the block cipher
+    of algo, duplicated from a template the registry sets up once with that
+    cipher: only the key is left to the caller, who owns the context. Throws
+    std::out_of_range if algo has no such MAC, InputError_NULLPTR if no
+    provider offers it.
+    */
+    CmacCtx* newMacContext(MacMode mode, Algo algo);
+}
+
+#endif
+
@@ -0,0 +1,330 @@
+#ifndef RIPPASSL_STATICCIPHER_H
+#define RIPPASSL_STATICCIPHER_H
+
+#include "Base.h"
+#include "Cipher.h"
+#include "Registry.h"
+#include "error.h"
+
+#include <openssl/evp.h>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace RippaSSL {
+    // the chaining family of an Algo or a BcmMode, which shall agree:
+    enum class BcmFamily
+    {
+        CBC,
+        ECB,
+        CTR,
+        GCM
+    };
+
+    /*!
+    Compile-time properties of an algorithm: the counterpart of the
+    blockSizes and ivSizes maps, plus the key length. ivLength is the length
+    of the IV actually taken, so it's 0 for ECB, where ivSizes lists 16.
+    */
+    template<Algo A> struct AlgoTraits;
+
+    template<> struct AlgoTraits<Algo::AES128CBC> {
+        static constexpr BcmFamily family = BcmFamily::CBC;
+        static constexpr size_t blockSize = 16, keyLength = 16, ivLength = 16;
+    };
+    template<> struct AlgoTraits<Algo::AES256CBC> {
+        static constexpr BcmFamily family = BcmFamily::CBC;
+        static constexpr size_t blockSize = 16, keyLength = 32, ivLength = 16;
+    };
+    template<> struct AlgoTraits<Algo::AES128ECB> {
+        static constexpr BcmFamily family = BcmFamily::ECB;
+        static constexpr size_t blockSize = 16, keyLength = 16, ivLength = 0;
+    };
+    template<> struct AlgoTraits<Algo::AES256ECB> {
+        static constexpr BcmFamily family = BcmFamily::ECB;
+        static constexpr size_t blockSize = 16, keyLength = 32, ivLength = 0;
+    };
+    template<> struct AlgoTraits<Algo::AES128CTR> {
+        static constexpr BcmFamily family = BcmFamily::CTR;
+        static constexpr size_t blockSize = 16, keyLength = 16, ivLength = 16;
+    };
+    template<> struct AlgoTraits<Algo::AES256CTR> {
+        static constexpr BcmFamily family = BcmFamily::CTR;
+        static constexpr size_t blockSize = 16, keyLength = 32, ivLength = 16;
+    };
+    template<> struct AlgoTraits<Algo::AES128GCM> {
+        static constexpr BcmFamily family = BcmFamily::GCM;
+        static constexpr size_t blockSize = 16, keyLength = 16, ivLength = 12;
+    };
+    template<> struct AlgoTraits<Algo::AES256GCM> {
+        static constexpr BcmFamily family = BcmFamily::GCM;
+        static constexpr size_t blockSize = 16, keyLength = 32, ivLength = 12;
+    };
+
+    /*!
+    Compile-time properties of a mode: its family and its direction.
+    */
+    template<BcmMode M> struct ModeTraits;
+
+    template<BcmFamily F, bool E> struct ModeTraitsBase {
+        static constexpr BcmFamily family  = F;
+        static constexpr bool      encrypt = E;
+    };
+
+    template<> struct ModeTraits<BcmMode::Bcm_CBC_Encrypt>
+        : ModeTraitsBase<BcmFamily::CBC, true> {};
+    template<> struct ModeTraits<BcmMode::Bcm_CBC_Decrypt>
+        : ModeTraitsBase<BcmFamily::CBC, false> {};
+    template<> struct ModeTraits<BcmMode::Bcm_ECB_Encrypt>
+        : ModeTraitsBase<BcmFamily::ECB, true> {};
+    template<> struct ModeTraits<BcmMode::Bcm_ECB_Decrypt>
+        : ModeTraitsBase<BcmFamily::ECB, false> {};
+    template<> struct ModeTraits<BcmMode::Bcm_CTR_Encrypt>
+        : ModeTraitsBase<BcmFamily::CTR, true> {};
+    template<> struct ModeTraits<BcmMode::Bcm_CTR_Decrypt>
+        : ModeTraitsBase<BcmFamily::CTR, false> {};
+    template<> struct ModeTraits<BcmMode::Bcm_GCM_Encrypt>
+        : ModeTraitsBase<BcmFamily::GCM, true> {};
+    template<> struct ModeTraits<BcmMode::Bcm_GCM_Decrypt>
+        : ModeTraitsBase<BcmFamily::GCM, false> {};
+
+    /*!
+    Cipher with the algorithm and the direction fixed at compile time: the
+    EVP functions are called directly, sizes are constants, and there are no
+    virtual calls, so the per-call overhead of short messages goes down to
+    OpenSSL's own. Mismatched A and M don't compile.
+    The interface and the exceptions thrown follow Cipher's, minus the
+    parallel update. Keys are AlgoTraits<A>::keyLength bytes long.
+    */
+    template<Algo A, BcmMode M>
+    class StaticCipher final {
+        public:
+            typedef AlgoTraits<A> Traits;
+
+            static constexpr size_t blockSize = Traits::blockSize;
+            static constexpr size_t keyLength = Traits::keyLength;
+            static constexpr size_t ivLength  = Traits::ivLength;
+            static constexpr bool   encrypt   = ModeTraits<M>::encrypt;
+
+            static_assert(Traits::family == ModeTraits<M>::family,
+                          "the algorithm and the mode belong to different "
+                          "families");
+
+            explicit StaticCipher(const uint8_t* key,
+                                  const uint8_t* iv,
+                                  bool           padding = false)
+            : context {EVP_CIPHER_CTX_new()}, requirePadding {padding}
+            {
+                if (NULL == context)
+                    throw InputError_NULLPTR {};
+
+                if (NULL == key)
+                {
+                    EVP_CIPHER_CTX_free(context);
+                    throw InputError_KEY_LENGTH {};
+                }
+
+                if (!EVP_CipherInit_ex(context, fetchCipher(A), NULL, key, iv,
+                                       encrypt ? 1 : 0))
+                {
+                    EVP_CIPHER_CTX_free(context);
+                    throw OpenSSLError_CryptoInit {};
+                }
+
+                EVP_CIPHER_CTX_set_padding(context, requirePadding);
+            }
+
+            explicit StaticCipher(const std::vector<uint8_t>& key,
+                                  const uint8_t*              iv,
+                                  bool                        padding = false)
+            : StaticCipher(checkedKey(key), iv, padding)
+            {
+                // nothing required.
+            }
+
+            /*!
+            Same contract as Cipher::update: output shall have room for
+            inputLen bytes plus one block.
+            */
+            size_t update(uint8_t*       output,
+                          const uint8_t* input,
+                          size_t         inputLen)
+            {
+                size_t written = 0;
+
+                // the EVP interface takes int lengths, so longer inputs go in
+                // block-aligned pieces:
+                while (inputLen)
+                {
+                    int chunkLen = (inputLen > (1u << 30)) ? (1 << 30) :
+                                   static_cast<int>(inputLen);
+                    int outLen = 0;
+
+                    if (!evpUpdate(output + written, &outLen, input, chunkLen))
+                        throw OpenSSLError_CryptoUpdate {};
+
+                    written  += outLen;
+                    input    += chunkLen;
+                    inputLen -= chunkLen;
+                }
+
+                return written;
+            }
+
+            size_t finalize(uint8_t*       output,
+                            const uint8_t* input,
+                            size_t         inputLen)
+            {
+                size_t written = 0;
+                int finalLen = 0;
+
+                if (inputLen)
+                {
+                    try {
+                        written = update(output, input, inputLen);
+                    } catch (OpenSSLError_CryptoUpdate& cu) {
+                        throw OpenSSLError_CryptoFinalize {};
+                    }
+                }
+
+                if (!evpFinal(output + written, &finalLen))
+                    throw OpenSSLError_CryptoFinalize {};
+
+                return written + finalLen;
+            }
+
+            /*!
+            GCM only, as in Cipher: additional data, then the tag.
+            */
+            void updateAad(const uint8_t* aad, size_t aadLen)
+            {
+                static_assert(BcmFamily::GCM == Traits::family,
+                              "AAD requires an AEAD mode");
+
+                // int lengths again, hence the pieces:
+                while (aadLen)
+                {
+                    int chunkLen = (aadLen > (1u << 30)) ? (1 << 30) :
+                                   static_cast<int>(aadLen);
+                    int outLen = 0;
+
+                    if (!evpUpdate(NULL, &outLen, aad, chunkLen))
+                        throw OpenSSLError_CryptoUpdate {};
+
+                    aad    += chunkLen;
+                    aadLen -= chunkLen;
+                }
+            }
+
+            size_t finalizeTag(uint8_t*       output,
+                               const uint8_t* input,
+                               size_t         inputLen,
+                               uint8_t*       tag,
+                               size_t         tagLen = aeadTagSize)
+            {
+                static_assert((BcmFamily::GCM == Traits::family) && encrypt,
+                              "tags are output by AEAD encryption only");
+
+                if (tagLen > aeadTagSize)
+                    throw InputError_UNSUPPORTED_MODE {};
+
+                size_t written = finalize(output, input, inputLen);
+
+                if (!EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_AEAD_GET_TAG,
+                                         static_cast<int>(tagLen), tag))
+                {
+                    throw OpenSSLError_CryptoFinalize {};
+                }
+
+                return written;
+            }
+
+            size_t finalizeVerify(uint8_t*       output,
+                                  const uint8_t* input,
+                                  size_t         inputLen,
+                                  const uint8_t* tag,
+                                  size_t         tagLen = aeadTagSize)
+            {
+                static_assert((BcmFamily::GCM == Traits::family) && !encrypt,
+                              "tags are verified by AEAD decryption only");
+
+                if (!tagLen || (tagLen > aeadTagSize))
+                    throw InputError_UNSUPPORTED_MODE {};
+
+                size_t written = inputLen ? update(output, input, inputLen) :
+                                            0;
+                int finalLen = 0;
+
+                if (!EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_AEAD_SET_TAG,
+                                         static_cast<int>(tagLen),
+                                         const_cast<uint8_t*>(tag)))
+                {
+                    throw OpenSSLError_CryptoFinalize {};
+                }
+
+                if (!evpFinal(output + written, &finalLen))
+                    throw OpenSSLError_Authentication {};
+
+                return written + finalLen;
+            }
+
+            /*!
+            Restarts the operation with a new IV (nullptr for ECB), or with
+            a new key and IV, keeping the context.
+            */
+            void reset(const uint8_t* iv)
+            {
+                rekey(NULL, iv);
+            }
+
+            void rekey(const uint8_t* key, const uint8_t* iv)
+            {
+                if (!EVP_CipherInit_ex(context, NULL, NULL, key, iv, -1))
+                    throw OpenSSLError_CryptoInit {};
+
+                EVP_CIPHER_CTX_set_padding(context, requirePadding);
+            }
+
+            ~StaticCipher()
+            {
+                EVP_CIPHER_CTX_free(context);
+            }
+
+            StaticCipher(const StaticCipher&)             = delete;
+            StaticCipher& operator= (const StaticCipher&) = delete;
+
+        private:
+            static const uint8_t* checkedKey(const std::vector<uint8_t>& key)
+            {
+                if (key.size() != keyLength)
+                    throw InputError_KEY_LENGTH {};
+
+                return key.data();
+            }
+
+            int evpUpdate(uint8_t*       out,
+                          int*           outLen,
+                          const uint8_t* in,
+                          int            inLen)
+            {
+                if constexpr (encrypt)
+                    return EVP_EncryptUpdate(context, out, outLen, in, inLen);
+                else
+                    return EVP_DecryptUpdate(context, out, outLen, in, inLen);
+            }
+
+            int evpFinal(uint8_t* out, int* outLen)
+            {
+                if constexpr (encrypt)
+                    return EVP_EncryptFinal_ex(context, out, outLen);
+                else
+                    return EVP_DecryptFinal_ex(context, out, outLen);
+            }
+
+            CipherCtx* context;
+            bool       requirePadding;
+    };
+}
+
+#endif
@@ -6,9 +6,12 @@ namespace RippaSSL {
     // errors thrown by this
     struct InputError_NULLPTR {};
     struct InputError_MISALIGNED_DATA {};
+    struct InputError_KEY_LENGTH {};
+    struct InputError_UNSUPPORTED_MODE {};
     struct OpenSSLError_CryptoInit {};
     struct OpenSSLError_CryptoUpdate {};
     struct OpenSSLError_CryptoFinalize {};
+    struct OpenSSLError_Authentication {};
 }
 
 #endif
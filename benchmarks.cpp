@@ -0,0 +1,607 @@
+#include "binIO.h"
+#include "RippaSSL/Base.h"
+#include "RippaSSL/Cipher.h"
+#include "RippaSSL/Mac.h"
+#include "RippaSSL/StaticCipher.h"
+#include "RippaSSL/ContextCache.h"
+#include "RippaSSL/error.h"
+
+#include <openssl/crypto.h>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <functional>
+#include <algorithm>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+// every heap allocation made by the process, C++ and OpenSSL ones alike:
+static std::atomic<size_t> allocationCount {0};
+
+// false when OpenSSL's allocator couldn't be hooked: the counts would miss
+// its allocations, so they are reported as unavailable, i.e. negative:
+static bool allocationsCounted = true;
+static constexpr double allocationsUnavailable = -1.0;
+
+void* operator new(size_t size)
+{
+    ++allocationCount;
+
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+static void* countingMalloc(size_t size, const char*, int)
+{
+    ++allocationCount;
+    return std::malloc(size);
+}
+
+static void* countingRealloc(void* p, size_t size, const char*, int)
+{
+    ++allocationCount;
+    return std::realloc(p, size);
+}
+
+static void countingFree(void* p, const char*, int)
+{
+    std::free(p);
+}
+
+struct BenchResult {
+    std::string name;
+    size_t      size;
+    size_t      iterations;
+    double      nsPerOp;
+    double      mbPerS;
+    double      allocsPerOp;
+};
+
+struct BenchOptions {
+    size_t      maxSize     = 16 * 1024 * 1024;
+    double      minTime     = 0.1;
+    unsigned    workers     = 1;
+    double      threshold   = 5.0;
+    const char* filter      = NULL;
+    const char* jsonPath    = NULL;
+    const char* comparePath = NULL;
+};
+
+// the cipher cases, with the direction pair of each mode:
+struct CipherCase {
+    const char*       name;
+    RippaSSL::Algo    algo;
+    RippaSSL::BcmMode encrypt;
+    RippaSSL::BcmMode decrypt;
+};
+
+static const CipherCase cipherCases[] = {
+    {"AES128CBC", RippaSSL::Algo::AES128CBC,
+     RippaSSL::BcmMode::Bcm_CBC_Encrypt, RippaSSL::BcmMode::Bcm_CBC_Decrypt},
+    {"AES256CBC", RippaSSL::Algo::AES256CBC,
+     RippaSSL::BcmMode::Bcm_CBC_Encrypt, RippaSSL::BcmMode::Bcm_CBC_Decrypt},
+    {"AES128ECB", RippaSSL::Algo::AES128ECB,
+     RippaSSL::BcmMode::Bcm_ECB_Encrypt, RippaSSL::BcmMode::Bcm_ECB_Decrypt},
+    {"AES256ECB", RippaSSL::Algo::AES256ECB,
+     RippaSSL::BcmMode::Bcm_ECB_Encrypt, RippaSSL::BcmMode::Bcm_ECB_Decrypt},
+    {"AES128CTR", RippaSSL::Algo::AES128CTR,
+     RippaSSL::BcmMode::Bcm_CTR_Encrypt, RippaSSL::BcmMode::Bcm_CTR_Decrypt},
+    {"AES256CTR", RippaSSL::Algo::AES256CTR,
+     RippaSSL::BcmMode::Bcm_CTR_Encrypt, RippaSSL::BcmMode::Bcm_CTR_Decrypt},
+    {"AES128GCM", RippaSSL::Algo::AES128GCM,
+     RippaSSL::BcmMode::Bcm_GCM_Encrypt, RippaSSL::BcmMode::Bcm_GCM_Decrypt},
+    {"AES256GCM", RippaSSL::Algo::AES256GCM,
+     RippaSSL::BcmMode::Bcm_GCM_Encrypt, RippaSSL::BcmMode::Bcm_GCM_Decrypt}
+};
+
+static bool isGcm(RippaSSL::Algo algo)
+{
+    return (algo == RippaSSL::Algo::AES128GCM) ||
+           (algo == RippaSSL::Algo::AES256GCM);
+}
+
+static size_t keyLength(RippaSSL::Algo algo)
+{
+    return ((algo == RippaSSL::Algo::AES128CBC) ||
+            (algo == RippaSSL::Algo::AES128ECB) ||
+            (algo == RippaSSL::Algo::AES128CTR) ||
+            (algo == RippaSSL::Algo::AES128GCM)) ? 16 : 32;
+}
+
+/*!
+Parses a byte count with an optional K, M or G (binary) suffix.
+*/
+static bool parseSize(const char* text, size_t& size)
+{
+    char* end;
+    unsigned long long value = strtoull(text, &end, 10);
+
+    switch (*end)
+    {
+        case 'K': value <<= 10; ++end; break;
+        case 'M': value <<= 20; ++end; break;
+        case 'G': value <<= 30; ++end; break;
+        default: break;
+    }
+
+    size = static_cast<size_t>(value);
+
+    return ('\0' == *end) && value;
+}
+
+/*!
+Times "op", which processes size bytes per call: the number of calls doubles
+until a run lasts at least minTime seconds, and that run is the one reported.
+*/
+static BenchResult measure(const std::string&           name,
+                           size_t                       size,
+                           double                       minTime,
+                           const std::function<void()>& op)
+{
+    // the first call warms up caches, lazily created handles and buffers:
+    op();
+
+    for (size_t iterations = 1; ; iterations *= 2)
+    {
+        size_t allocationsBefore = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < iterations; ++i)
+            op();
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        size_t allocations = allocationCount - allocationsBefore;
+
+        if (elapsed.count() >= minTime)
+        {
+            double seconds = elapsed.count() / iterations;
+
+            return BenchResult {name, size, iterations, seconds * 1e9,
+                                size / seconds / 1e6,
+                                allocationsCounted ?
+                                static_cast<double>(allocations) / iterations :
+                                allocationsUnavailable};
+        }
+    }
+}
+
+static void report(std::vector<BenchResult>& results, BenchResult result)
+{
+    if (result.allocsPerOp < 0)
+        printf("%-28s %11zu B %14.1f ns/op %10.1f MB/s      n/a allocs/op\n",
+               result.name.c_str(), result.size, result.nsPerOp,
+               result.mbPerS);
+    else
+        printf("%-28s %11zu B %14.1f ns/op %10.1f MB/s %8.2f allocs/op\n",
+               result.name.c_str(), result.size, result.nsPerOp,
+               result.mbPerS, result.allocsPerOp);
+    fflush(stdout);
+
+    results.push_back(std::move(result));
+}
+
+static bool selected(const BenchOptions& options, const std::string& name)
+{
+    return (NULL == options.filter) ||
+           (std::string::npos != name.find(options.filter));
+}
+
+static void benchCodec(const BenchOptions&       options,
+                       size_t                    size,
+                       std::vector<BenchResult>& results)
+{
+    std::vector<uint8_t> binary (size);
+    for (size_t i = 0; i < size; ++i)
+        binary[i] = static_cast<uint8_t>(i * 31);
+
+    std::string text;
+    BinIO::hexBinaryToString(text, binary);
+
+    if (selected(options, "hex.decode"))
+    {
+        std::vector<uint8_t> decoded;
+        report(results, measure("hex.decode", size, options.minTime, [&] {
+            decoded.clear();
+            BinIO::readHexBinary(decoded, text.data(), text.size());
+        }));
+    }
+
+    if (selected(options, "hex.encode"))
+    {
+        std::string encoded;
+        report(results, measure("hex.encode", size, options.minTime, [&] {
+            BinIO::hexBinaryToString(encoded, binary);
+        }));
+    }
+}
+
+static void benchCiphers(const BenchOptions&       options,
+                         size_t                    size,
+                         std::vector<BenchResult>& results)
+{
+    std::vector<uint8_t> plainText (size, 0xA5);
+    std::vector<uint8_t> cipherText (size + 16);
+    std::vector<uint8_t> output (size + 16);
+    std::vector<uint8_t> iv (16, 0x42);
+    uint8_t tag[RippaSSL::aeadTagSize];
+
+    for (const CipherCase& c : cipherCases)
+    {
+        std::string encName = std::string {"cipher."} + c.name + ".encrypt";
+        std::string decName = std::string {"cipher."} + c.name + ".decrypt";
+        const uint8_t* ivPtr = (c.algo == RippaSSL::Algo::AES128ECB ||
+                                c.algo == RippaSSL::Algo::AES256ECB) ?
+                               nullptr : iv.data();
+
+        if (!selected(options, encName) && !selected(options, decName))
+            continue;
+
+        std::vector<uint8_t> key (keyLength(c.algo), 0x3C);
+        RippaSSL::Cipher enc {c.algo, c.encrypt, key, ivPtr};
+        RippaSSL::Cipher dec {c.algo, c.decrypt, key, ivPtr};
+        enc.setWorkers(options.workers);
+        dec.setWorkers(options.workers);
+
+        // the decryption cases run on genuine ciphertext (and tag):
+        if (isGcm(c.algo))
+            enc.finalizeTag(cipherText.data(), plainText.data(), size, tag);
+        else
+            enc.finalize(cipherText.data(), plainText.data(), size);
+
+        if (selected(options, encName))
+        {
+            report(results, measure(encName, size, options.minTime, [&] {
+                enc.reset(ivPtr);
+                if (isGcm(c.algo))
+                    enc.finalizeTag(output.data(), plainText.data(), size,
+                                    tag);
+                else
+                    enc.finalize(output.data(), plainText.data(), size);
+            }));
+        }
+
+        if (selected(options, decName))
+        {
+            report(results, measure(decName, size, options.minTime, [&] {
+                dec.reset(ivPtr);
+                if (isGcm(c.algo))
+                    dec.finalizeVerify(output.data(), cipherText.data(), size,
+                                       tag);
+                else
+                    dec.finalize(output.data(), cipherText.data(), size);
+            }));
+        }
+    }
+}
+
+/*!
+The compile-time specialized cipher, on the modes whose short messages are
+most sensitive to per-call overhead, for comparison with the cipher cases.
+*/
+template<RippaSSL::Algo A, RippaSSL::BcmMode M>
+static void benchStaticCipher(const char*               name,
+                              const BenchOptions&       options,
+                              size_t                    size,
+                              std::vector<BenchResult>& results)
+{
+    if (!selected(options, name))
+        return;
+
+    std::vector<uint8_t> plainText (size, 0xA5);
+    std::vector<uint8_t> output (size + 16);
+    std::vector<uint8_t> key (RippaSSL::AlgoTraits<A>::keyLength, 0x3C);
+    std::vector<uint8_t> iv (16, 0x42);
+    const uint8_t* ivPtr = RippaSSL::AlgoTraits<A>::ivLength ? iv.data() :
+                                                               nullptr;
+    RippaSSL::StaticCipher<A, M> cipher {key, ivPtr};
+
+    report(results, measure(name, size, options.minTime, [&] {
+        cipher.reset(ivPtr);
+        cipher.finalize(output.data(), plainText.data(), size);
+    }));
+}
+
+/*!
+Per-message key setup over a rotating set of keys: building a Cipher from
+scratch each time, against taking a copy from the context cache.
+*/
+static void benchKeySetup(const BenchOptions&       options,
+                          size_t                    size,
+                          std::vector<BenchResult>& results)
+{
+    constexpr size_t keyCount = 8;
+
+    std::vector<uint8_t> plainText (size, 0xA5);
+    std::vector<uint8_t> output (size + 16);
+    std::vector<std::vector<uint8_t>> keys;
+    std::vector<uint8_t> iv (16, 0x42);
+    size_t next = 0;
+
+    for (size_t k = 0; k < keyCount; ++k)
+        keys.emplace_back(16, static_cast<uint8_t>(k));
+
+    if (selected(options, "setup.AES128CBC.fresh"))
+    {
+        report(results, measure("setup.AES128CBC.fresh", size,
+                                options.minTime, [&] {
+            RippaSSL::Cipher cipher {RippaSSL::Algo::AES128CBC,
+                                     RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                     keys[next++ % keyCount], iv.data()};
+            cipher.finalize(output.data(), plainText.data(), size);
+        }));
+    }
+
+    if (selected(options, "setup.AES128CBC.cached"))
+    {
+        RippaSSL::ContextCache cache {keyCount};
+
+        report(results, measure("setup.AES128CBC.cached", size,
+                                options.minTime, [&] {
+            RippaSSL::Cipher cipher = cache.acquire(
+                RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                keys[next++ % keyCount], iv.data());
+            cipher.finalize(output.data(), plainText.data(), size);
+        }));
+    }
+}
+
+static void benchMacs(const BenchOptions&       options,
+                      size_t                    size,
+                      std::vector<BenchResult>& results)
+{
+    std::vector<uint8_t> message (size, 0x5A);
+    uint8_t tag[16];
+
+    for (RippaSSL::Algo algo : {RippaSSL::Algo::AES128CBC,
+                                RippaSSL::Algo::AES256CBC})
+    {
+        std::string name = (RippaSSL::Algo::AES128CBC == algo) ?
+                           "cmac.AES128" : "cmac.AES256";
+
+        if (!selected(options, name))
+            continue;
+
+        RippaSSL::Cmac mac {algo, RippaSSL::MacMode::CMAC,
+                            std::vector<uint8_t> (keyLength(algo), 0x17),
+                            nullptr};
+
+        report(results, measure(name, size, options.minTime, [&] {
+            mac.reset();
+            mac.finalize(tag, message.data(), size);
+        }));
+    }
+}
+
+static bool writeJson(const char*                     path,
+                      const BenchOptions&             options,
+                      const std::vector<BenchResult>& results)
+{
+    FILE* os = strcmp(path, "-") ? fopen(path, "w") : stdout;
+
+    if (NULL == os)
+        return false;
+
+    // one result per line, which is what the compare mode reads back;
+    // allocs_per_op is negative when unavailable:
+    fprintf(os, "{\n  \"workers\": %u,\n  \"benchmarks\": [\n",
+            options.workers);
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult& r = results[i];
+        fprintf(os, "    {\"name\": \"%s\", \"size\": %zu, "
+                    "\"iterations\": %zu, \"ns_per_op\": %.1f, "
+                    "\"mb_per_s\": %.2f, \"allocs_per_op\": %.2f}%s\n",
+                r.name.c_str(), r.size, r.iterations, r.nsPerOp, r.mbPerS,
+                r.allocsPerOp, (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(os, "  ]\n}\n");
+
+    return (stdout == os) ? !fflush(os) : !fclose(os);
+}
+
+/*!
+Checks the results against a baseline written by --json: a case regresses
+when its throughput drops by more than threshold percent, or when it
+allocates more per operation. Returns the number of regressions, or -1 if
+the baseline can't be read.
+*/
+static int compareBaseline(const char*                     path,
+                           double                          threshold,
+                           const std::vector<BenchResult>& results)
+{
+    FILE* is = fopen(path, "r");
+    char line[512];
+    int regressions = 0;
+
+    if (NULL == is)
+        return -1;
+
+    while (fgets(line, sizeof(line), is))
+    {
+        char name[128];
+        size_t size;
+        double mbPerS;
+        double allocsPerOp;
+
+        if (4 != sscanf(line, " {\"name\": \"%127[^\"]\", \"size\": %zu, "
+                              "\"iterations\": %*u, \"ns_per_op\": %*f, "
+                              "\"mb_per_s\": %lf, \"allocs_per_op\": %lf",
+                        name, &size, &mbPerS, &allocsPerOp))
+        {
+            continue;
+        }
+
+        for (const BenchResult& r : results)
+        {
+            if ((r.name != name) || (r.size != size))
+                continue;
+
+            double change = (r.mbPerS - mbPerS) / mbPerS * 100.0;
+            bool slower = change < -threshold;
+            // the counts are averages, so allows for rounding; unavailable
+            // ones compare to nothing:
+            bool allocates = (r.allocsPerOp >= 0) && (allocsPerOp >= 0) &&
+                             (r.allocsPerOp > allocsPerOp + 0.5);
+
+            if (slower || allocates)
+            {
+                ++regressions;
+                printf("REGRESSION %-28s %11zu B %10.1f -> %10.1f MB/s "
+                       "(%+.1f%%) %8.2f -> %8.2f allocs/op\n",
+                       name, size, mbPerS, r.mbPerS, change, allocsPerOp,
+                       r.allocsPerOp);
+            }
+        }
+    }
+
+    fclose(is);
+
+    return regressions;
+}
+
+static void printUsage()
+{
+    printf("Usage: bench [--max-size BYTES[K|M|G]] [--min-time SECONDS]\n"
+           "             [--threads N] [--filter SUBSTRING] [--json FILE|-]\n"
+           "             [--compare BASELINE] [--threshold PERCENT]\n"
+           "    Measures the HEX codec, every cipher mode and CMAC over "
+           "messages from 16 B\n"
+           "    up to --max-size (16M by default, 1G at most), growing by 4x."
+           "\n"
+           "    --json writes the results, --compare flags the cases slower "
+           "than BASELINE\n"
+           "    (a --json output) by more than PERCENT (5 by default), or "
+           "allocating more;\n"
+           "    the exit code is then 1.\n");
+}
+
+int main(int argc, char* argv[])
+{
+    // shall precede any allocation made by OpenSSL, else it's refused:
+    if (!CRYPTO_set_mem_functions(countingMalloc, countingRealloc,
+                                  countingFree))
+    {
+        allocationsCounted = false;
+        fprintf(stderr, "Warning: OpenSSL allocations can't be counted, "
+                        "allocs/op is unavailable.\n");
+    }
+
+    BenchOptions options;
+    bool badOption = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--max-size") && (i + 1 < argc))
+        {
+            badOption = !parseSize(argv[++i], options.maxSize) ||
+                        (options.maxSize > (size_t {1} << 30));
+        }
+        else if (!strcmp(argv[i], "--min-time") && (i + 1 < argc))
+        {
+            options.minTime = atof(argv[++i]);
+            badOption = !(options.minTime > 0);
+        }
+        else if (!strcmp(argv[i], "--threads") && (i + 1 < argc))
+        {
+            options.workers = static_cast<unsigned>(atoi(argv[++i]));
+            badOption = !options.workers || (options.workers > 1024);
+        }
+        else if (!strcmp(argv[i], "--threshold") && (i + 1 < argc))
+        {
+            options.threshold = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--filter") && (i + 1 < argc))
+        {
+            options.filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--json") && (i + 1 < argc))
+        {
+            options.jsonPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--compare") && (i + 1 < argc))
+        {
+            options.comparePath = argv[++i];
+        }
+        else
+        {
+            badOption = true;
+        }
+
+        if (badOption)
+        {
+            printUsage();
+            return 1;
+        }
+    }
+
+    std::vector<BenchResult> results;
+
+    try {
+        for (size_t size = 16; size <= options.maxSize; size *= 4)
+        {
+            benchCodec(options, size, results);
+            benchCiphers(options, size, results);
+            benchStaticCipher<RippaSSL::Algo::AES128CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt>(
+                "static.AES128CBC.encrypt", options, size, results);
+            benchStaticCipher<RippaSSL::Algo::AES128ECB,
+                              RippaSSL::BcmMode::Bcm_ECB_Encrypt>(
+                "static.AES128ECB.encrypt", options, size, results);
+            benchKeySetup(options, size, results);
+            benchMacs(options, size, results);
+        }
+    }
+    catch (std::bad_alloc& ba) {
+        printf("Error: not enough memory for the requested sizes!\n");
+        return 1;
+    }
+    catch (...) {
+        printf("Error: a benchmark failed to run!\n");
+        return 1;
+    }
+
+    if ((NULL != options.jsonPath) &&
+        !writeJson(options.jsonPath, options, results))
+    {
+        printf("Error: can't write %s!\n", options.jsonPath);
+        return 1;
+    }
+
+    if (NULL != options.comparePath)
+    {
+        int regressions = compareBaseline(options.comparePath,
+                                          options.threshold, results);
+
+        if (regressions < 0)
+        {
+            printf("Error: can't read %s!\n", options.comparePath);
+            return 1;
+        }
+
+        printf("%d regression(s) against %s\n", regressions,
+               options.comparePath);
+
+        return regressions ? 1 : 0;
+    }
+
+    return 0;
+}
@@ -1,107 +1,522 @@
-
 #include "binIO.h"
 
 #include <string>
 #include <vector>
+#include <array>
 #include <iostream>
-#include <charconv>
-#include <algorithm>
 
 #include <cstring>
+#include <cctype>
 #include <cstdio>
 #include <cstdint>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BINIO_X86_SIMD
+#endif
+
+namespace {
+    // instruction set extensions the codecs can take advantage of, detected
+    // once at runtime through CPUID:
+    enum class SimdLevel
+    {
+        Scalar,
+        SSSE3,
+        AVX2
+    };
+
+    SimdLevel detectSimdLevel()
+    {
+#ifdef BINIO_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return SimdLevel::AVX2;
+        if (__builtin_cpu_supports("ssse3"))
+            return SimdLevel::SSSE3;
+#endif
+        return SimdLevel::Scalar;
+    }
+
+    SimdLevel simdLevel()
+    {
+        static const SimdLevel level {detectSimdLevel()};
+        return level;
+    }
+
+    // maps every character to its nibble value, or to 0xFF if it isn't a
+    // valid HEX digit:
+    constexpr std::array<uint8_t, 256> buildNibbleTable()
+    {
+        std::array<uint8_t, 256> table {};
+        for (size_t c = 0; c < table.size(); ++c)
+        {
+            if (c >= '0' && c <= '9')
+                table[c] = c - '0';
+            else if (c >= 'A' && c <= 'F')
+                table[c] = c - 'A' + 10;
+            else if (c >= 'a' && c <= 'f')
+                table[c] = c - 'a' + 10;
+            else
+                table[c] = 0xFF;
+        }
+        return table;
+    }
+
+    constexpr std::array<uint8_t, 256> nibbleTable {buildNibbleTable()};
+
+    // decodes "pairs" couples of characters into bytes; invalid characters
+    // set the high bits of the accumulator, so validation costs a single
+    // test at the end:
+    bool decodeHexScalar(uint8_t* out, const char* in, size_t pairs)
+    {
+        uint8_t invalid = 0;
+
+        for (size_t i = 0; i < pairs; ++i)
+        {
+            uint8_t hi = nibbleTable[static_cast<uint8_t>(in[2 * i])];
+            uint8_t lo = nibbleTable[static_cast<uint8_t>(in[2 * i + 1])];
+
+            invalid |= hi | lo;
+            out[i] = (hi << 4) | lo;
+        }
+
+        return !(invalid & 0xF0);
+    }
+
+#ifdef BINIO_X86_SIMD
+    // converts 16 characters into 16 nibbles, accumulating the lanes holding
+    // non-hex characters into "invalid":
+    __attribute__((target("ssse3")))
+    inline __m128i hexNibbles128(__m128i chars, __m128i& invalid)
+    {
+        const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+        const __m128i alpha = _mm_sub_epi8(_mm_or_si128(chars,
+                                                        _mm_set1_epi8(0x20)),
+                                           _mm_set1_epi8('a'));
+
+        // unsigned "x <= max" is computed as "min(x, max) == x":
+        const __m128i isDigit =
+            _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+        const __m128i isAlpha =
+            _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+
+        invalid = _mm_or_si128(invalid,
+                               _mm_cmpeq_epi8(_mm_or_si128(isDigit, isAlpha),
+                                              _mm_setzero_si128()));
+
+        return _mm_or_si128(
+                    _mm_and_si128(isDigit, digit),
+                    _mm_and_si128(isAlpha,
+                                  _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+    }
+
+    // 32 characters per iteration:
+    __attribute__((target("ssse3")))
+    bool decodeHexSsse3(uint8_t* out, const char* in, size_t pairs)
+    {
+        // multiplies the even (high) nibbles by 16 and adds the odd ones:
+        const __m128i weights = _mm_set1_epi16(0x0110);
+        __m128i invalid = _mm_setzero_si128();
+        size_t i = 0;
+
+        for (; i + 16 <= pairs; i += 16)
+        {
+            const char* src = in + 2 * i;
+            __m128i a = hexNibbles128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)),
+                invalid);
+            __m128i b = hexNibbles128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)),
+                invalid);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                             _mm_packus_epi16(_mm_maddubs_epi16(a, weights),
+                                              _mm_maddubs_epi16(b, weights)));
+        }
+
+        if (_mm_movemask_epi8(invalid))
+            return false;
+
+        return decodeHexScalar(out + i, in + 2 * i, pairs - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline __m256i hexNibbles256(__m256i chars, __m256i& invalid)
+    {
+        const __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+        const __m256i alpha =
+            _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)),
+                            _mm256_set1_epi8('a'));
+
+        const __m256i isDigit =
+            _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)),
+                              digit);
+        const __m256i isAlpha =
+            _mm256_cmpeq_epi8(_mm256_min_epu8(alpha, _mm256_set1_epi8(5)),
+                              alpha);
+
+        invalid = _mm256_or_si256(
+                    invalid,
+                    _mm256_cmpeq_epi8(_mm256_or_si256(isDigit, isAlpha),
+                                      _mm256_setzero_si256()));
+
+        return _mm256_or_si256(
+                    _mm256_and_si256(isDigit, digit),
+                    _mm256_and_si256(isAlpha,
+                                     _mm256_add_epi8(alpha,
+                                                     _mm256_set1_epi8(10))));
+    }
+
+    // 64 characters per iteration:
+    __attribute__((target("avx2")))
+    bool decodeHexAvx2(uint8_t* out, const char* in, size_t pairs)
+    {
+        const __m256i weights = _mm256_set1_epi16(0x0110);
+        __m256i invalid = _mm256_setzero_si256();
+        size_t i = 0;
+
+        for (; i + 32 <= pairs; i += 32)
+        {
+            const char* src = in + 2 * i;
+            __m256i a = hexNibbles256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)),
+                invalid);
+            __m256i b = hexNibbles256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32)),
+                invalid);
+
+            // packus works within 128-bit lanes, so the quadwords come out as
+            // a0 b0 a1 b1 and need to be put back in order:
+            __m256i packed =
+                _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights),
+                                    _mm256_maddubs_epi16(b, weights));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                                _mm256_permute4x64_epi64(packed,
+                                                         _MM_SHUFFLE(3, 1,
+                                                                     2, 0)));
+        }
+
+        if (_mm256_movemask_epi8(invalid))
+            return false;
+
+        return decodeHexSsse3(out + i, in + 2 * i, pairs - i);
+    }
+#endif
+
+    constexpr char upperDigits[] {"0123456789ABCDEF"};
+    constexpr char lowerDigits[] {"0123456789abcdef"};
+
+    // every byte value mapped to its two HEX characters:
+    constexpr std::array<char, 512> buildByteTable(const char* digits)
+    {
+        std::array<char, 512> table {};
+        for (size_t b = 0; b < 256; ++b)
+        {
+            table[2 * b]     = digits[b >> 4];
+            table[2 * b + 1] = digits[b & 0x0F];
+        }
+        return table;
+    }
+
+    constexpr std::array<char, 512> upperByteTable {
+        buildByteTable(upperDigits)};
+    constexpr std::array<char, 512> lowerByteTable {
+        buildByteTable(lowerDigits)};
+
+    void encodeHexScalar(char* out, const uint8_t* in, size_t len,
+                         bool upperCase)
+    {
+        const char* table = upperCase ? upperByteTable.data() :
+                                        lowerByteTable.data();
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            std::memcpy(out + 2 * i, table + 2 * in[i], 2);
+        }
+    }
+
+#ifdef BINIO_X86_SIMD
+    // 16 bytes per iteration: the nibbles index the digits through pshufb,
+    // then get interleaved back high/low:
+    __attribute__((target("ssse3")))
+    void encodeHexSsse3(char* out, const uint8_t* in, size_t len,
+                        bool upperCase)
+    {
+        const __m128i digits = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(upperCase ? upperDigits :
+                                                         lowerDigits));
+        const __m128i mask = _mm_set1_epi8(0x0F);
+        size_t i = 0;
+
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i bytes =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i hi = _mm_shuffle_epi8(
+                digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+            __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, mask));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i),
+                             _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16),
+                             _mm_unpackhi_epi8(hi, lo));
+        }
+
+        encodeHexScalar(out + 2 * i, in + i, len - i, upperCase);
+    }
+
+    // 32 bytes per iteration:
+    __attribute__((target("avx2")))
+    void encodeHexAvx2(char* out, const uint8_t* in, size_t len,
+                       bool upperCase)
+    {
+        const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(upperCase ? upperDigits :
+                                                         lowerDigits)));
+        const __m256i mask = _mm256_set1_epi8(0x0F);
+        size_t i = 0;
+
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i bytes =
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+            __m256i hi = _mm256_shuffle_epi8(
+                digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+            __m256i lo = _mm256_shuffle_epi8(digits,
+                                             _mm256_and_si256(bytes, mask));
+
+            // the unpacks work within 128-bit lanes, so the halves get
+            // reassembled in order before storing:
+            __m256i first  = _mm256_unpacklo_epi8(hi, lo);
+            __m256i second = _mm256_unpackhi_epi8(hi, lo);
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i),
+                                _mm256_permute2x128_si256(first, second,
+                                                          0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32),
+                                _mm256_permute2x128_si256(first, second,
+                                                          0x31));
+        }
+
+        encodeHexSsse3(out + 2 * i, in + i, len - i, upperCase);
+    }
+#endif
+
+    void encodeHex(char* out, const uint8_t* in, size_t len, bool upperCase)
+    {
+        switch (simdLevel())
+        {
+#ifdef BINIO_X86_SIMD
+            case SimdLevel::AVX2:
+                return encodeHexAvx2(out, in, len, upperCase);
+            case SimdLevel::SSSE3:
+                return encodeHexSsse3(out, in, len, upperCase);
+#endif
+            default:
+                return encodeHexScalar(out, in, len, upperCase);
+        }
+    }
+
+    bool decodeHex(uint8_t* out, const char* in, size_t pairs)
+    {
+        switch (simdLevel())
+        {
+#ifdef BINIO_X86_SIMD
+            case SimdLevel::AVX2:
+                return decodeHexAvx2(out, in, pairs);
+            case SimdLevel::SSSE3:
+                return decodeHexSsse3(out, in, pairs);
+#endif
+            default:
+                return decodeHexScalar(out, in, pairs);
+        }
+    }
+}
+
+size_t BinIO::hexToBinary(uint8_t* binOut, const char* is, size_t len)
+{
+    if (!len || (len % 2) || !decodeHex(binOut, is, len / 2))
+        return 0;
+
+    return len / 2;
+}
+
 size_t BinIO::readHexBinary(std::vector<uint8_t>& binOut, const char* is)
 {
-    // builds a string outta the input char array from stdin:
-    std::string argString {is};
+    return BinIO::readHexBinary(binOut, is, std::strlen(is));
+}
 
+size_t BinIO::readHexBinary(std::vector<uint8_t>& binOut,
+                            const char*           is,
+                            size_t                len)
+{
     // consistency checks on the input: the string shall be non-empty and
     // made up of an even number of characters:
-    size_t inputLen = argString.length();
-    if (!inputLen || (inputLen % 2))
+    if (!len || (len % 2))
     {
         std::cerr << "BinIO::readHexBinary: Invalid Hex string in input - "
                      "please check that input is correctly populated and the "
-                     "number of characters is even!\n"
-                  << argString
-                  << std::endl;
+                     "number of characters is even!\n";
+        std::cerr.write(is, len) << std::endl;
 
         return 0;
     }
 
-    for (size_t i = 0; i < argString.length(); i += 2)
-    {
-        size_t digitNumberOfChars = 2;
-        std::string argHexDigit {argString.substr(i, 2)};
-        int curByte;
-
-        try {
-            curByte = stoi(argHexDigit, &digitNumberOfChars, 16);
-        } catch (...) {
-            std::cerr << "BinIO::readHexBinary: invalid HEX characters in input"
-                         "stream!\n"
-                      << argString
-                      << ".\n";
+    // the output is appended to whatever the caller already placed in binOut,
+    // sizing it once for the whole input:
+    size_t prevLen = binOut.size();
+    binOut.resize(prevLen + len / 2);
 
-            binOut.clear();
-            return 0;
-        }
+    if (!BinIO::hexToBinary(binOut.data() + prevLen, is, len))
+    {
+        std::cerr << "BinIO::readHexBinary: invalid HEX characters in input"
+                     "stream!\n";
+        std::cerr.write(is, len) << ".\n";
 
-        binOut.push_back(curByte);
+        binOut.clear();
+        return 0;
     }
 
     return binOut.size();
 }
 
-size_t BinIO::hexBinaryToString(std::string&         outStr,
-                                std::vector<uint8_t> inHex)
+size_t BinIO::binaryToHex(char*          os,
+                          const uint8_t* binIn,
+                          size_t         len,
+                          bool           upperCase)
+{
+    encodeHex(os, binIn, len, upperCase);
+
+    return 2 * len;
+}
+
+size_t BinIO::hexBinaryToString(std::string&                outStr,
+                                const std::vector<uint8_t>& inHex,
+                                bool                        upperCase)
+{
+    // sizes the output once, overwriting whatever the caller placed there:
+    outStr.resize(2 * inHex.size());
+
+    return BinIO::binaryToHex(outStr.data(), inHex.data(), inHex.size(),
+                              upperCase);
+}
+
+int BinIO::printHexBinary(const std::vector<uint8_t>& binIn)
+{
+    std::string stringInput;
+    BinIO::hexBinaryToString(stringInput, binIn);
+    std::cout << stringInput << std::endl;
+
+    return 0;
+}
+
+BinIO::StreamReader::StreamReader(FILE* is, Format fmt)
+: stream {is}, format {fmt}, textBuffer {}
 {
-    // initializes the output to the empty string, in case the caller didn't:
-    outStr = "";
+    // nothing required.
+}
 
-    if (!inHex.size())
+size_t BinIO::StreamReader::read(uint8_t* binOut, size_t maxLen)
+{
+    size_t textLen = 0;
+
+    if (!maxLen)
         return 0;
 
-    for (size_t i = 0; i < inHex.size(); ++i)
+    if (Format::Raw == format)
+    {
+        size_t readLen = std::fread(binOut, 1, maxLen, stream);
+
+        if (std::ferror(stream))
+            throw InputError_StreamRead {};
+
+        return readLen;
+    }
+
+    if (textBuffer.size() < 2 * maxLen)
+        textBuffer.resize(2 * maxLen);
+
+    // keeps reading until some HEX digits show up, as a chunk might be made of
+    // whitespace only:
+    while (!textLen)
     {
-        int offset = 0;
-        std::string tmp {"00"};
+        size_t readLen = std::fread(textBuffer.data(), 1, 2 * maxLen, stream);
 
-        // if the number is smaller than 16, we need to add a leading 0 to keep
-        // a byte representation:
-        // TODO: we might make this a parameter and choose whether to also offer
-        //       word alignment!
-        if (inHex[i] < 0x10u)
+        if (std::ferror(stream))
+            throw InputError_StreamRead {};
+
+        if (!readLen)
+            return 0;
+
+        // compacts the digits, skipping whitespace:
+        for (size_t i = 0; i < readLen; ++i)
         {
-            ++offset;
+            if (!std::isspace(static_cast<unsigned char>(textBuffer[i])))
+                textBuffer[textLen++] = textBuffer[i];
         }
+    }
 
-        auto rc = std::to_chars(tmp.data() + offset,
-                                tmp.data() + tmp.length(),
-                                inHex[i],
-                                16);
+    // a chunk boundary might split a byte: completes it with the next digit.
+    // An odd length is always shorter than the buffer, so there is room:
+    if (textLen % 2)
+    {
+        int c;
+        while ((EOF != (c = std::fgetc(stream))) && std::isspace(c))
+            ;
 
-        if (std::errc::value_too_large == rc.ec)
+        if (EOF == c)
         {
+            if (std::ferror(stream))
+                throw InputError_StreamRead {};
+
             throw InputError_IllegalConversion {};
         }
 
-        outStr += tmp;
+        textBuffer[textLen++] = static_cast<char>(c);
     }
 
-    std::transform(outStr.begin(), outStr.end(),
-                   outStr.begin(),
-                   [](char c){return std::toupper(c);});
+    if (!BinIO::hexToBinary(binOut, textBuffer.data(), textLen))
+        throw InputError_IllegalConversion {};
 
-    return outStr.length();
+    return textLen / 2;
 }
 
-int BinIO::printHexBinary(const std::vector<uint8_t>& binIn)
+BinIO::StreamWriter::StreamWriter(FILE* os, Format fmt)
+: stream {os}, format {fmt}, textBuffer {}, wroteData {false}
 {
-    std::string stringInput;
-    BinIO::hexBinaryToString(stringInput, binIn);
-    std::cout << stringInput << std::endl;
+    // nothing required.
+}
 
-    return 0;
+void BinIO::StreamWriter::write(const uint8_t* binIn, size_t len)
+{
+    if (!len)
+        return;
+
+    if (Format::Raw == format)
+    {
+        if (std::fwrite(binIn, 1, len, stream) != len)
+            throw OutputError_StreamWrite {};
+
+        return;
+    }
+
+    if (textBuffer.size() < 2 * len)
+        textBuffer.resize(2 * len);
+
+    size_t textLen = BinIO::binaryToHex(textBuffer.data(), binIn, len);
+
+    if (std::fwrite(textBuffer.data(), 1, textLen, stream) != textLen)
+        throw OutputError_StreamWrite {};
+
+    wroteData = true;
+}
+
+void BinIO::StreamWriter::finish()
+{
+    if (wroteData && (EOF == std::fputc('\n', stream)))
+        throw OutputError_StreamWrite {};
+
+    if (std::fflush(stream))
+        throw OutputError_StreamWrite {};
 }
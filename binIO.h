@@ -15,8 +15,40 @@ namespace BinIO
     */
     size_t readHexBinary(std::vector<uint8_t>& binOut, const char* is);
 
-    size_t hexBinaryToString(std::string&         outStr,
-                             std::vector<uint8_t> inHex);
+    /*!
+    Same as above, but reads exactly len characters from "is", which doesn't
+    need to be NULL-terminated.
+    */
+    size_t readHexBinary(std::vector<uint8_t>& binOut,
+                         const char*           is,
+                         size_t                len);
+
+    /*!
+    Decodes len hex characters (either case) from "is" into binOut, which
+    shall provide room for at least len / 2 bytes. Nothing is allocated and
+    nothing is printed: this is the raw codec the functions above rely upon.
+    Returns the number of bytes written, or 0 if len is zero or odd, or if
+    "is" contains non-hex characters (binOut contents are then unspecified).
+    */
+    size_t hexToBinary(uint8_t* binOut, const char* is, size_t len);
+
+    /*!
+    Encodes len bytes from binIn into 2 * len HEX characters written to "os",
+    which is NOT NULL-terminated. Digits are uppercase unless upperCase is
+    false. Returns the number of characters written.
+    */
+    size_t binaryToHex(char*          os,
+                       const uint8_t* binIn,
+                       size_t         len,
+                       bool           upperCase = true);
+
+    /*!
+    Replaces the contents of outStr with the HEX representation of inHex.
+    Returns the length of outStr.
+    */
+    size_t hexBinaryToString(std::string&                outStr,
+                             const std::vector<uint8_t>& inHex,
+                             bool                        upperCase = true);
 
     /*!
     Prints a binary array in its HEX representation.
@@ -24,8 +56,70 @@ namespace BinIO
     */
     int printHexBinary(const std::vector<uint8_t>& binIn);
 
+    /*!
+    Encodings of binary data on streams: HEX text, or the raw bytes as-is.
+    */
+    enum class Format
+    {
+        Hex,
+        Raw
+    };
+
+    /*!
+    Reads binary data from a stream in chunks, so that inputs of any size can
+    be processed in constant memory. Raw data is read straight into the
+    caller's buffer; with HEX data, whitespace (e.g. line breaks) between
+    digits is skipped.
+    */
+    class StreamReader {
+        public:
+            explicit StreamReader(FILE* is, Format fmt = Format::Hex);
+
+            /*!
+            Places up to maxLen bytes in binOut. Returns the number of bytes
+            read, which is 0 only once the stream is exhausted.
+            Throws InputError_IllegalConversion on malformed HEX input and
+            InputError_StreamRead on I/O errors.
+            */
+            size_t read(uint8_t* binOut, size_t maxLen);
+
+        private:
+            FILE*             stream;
+            Format            format;
+            std::vector<char> textBuffer;
+    };
+
+    /*!
+    Counterpart of StreamReader: writes binary data to a stream, chunk by
+    chunk, either raw or in its HEX representation.
+    */
+    class StreamWriter {
+        public:
+            explicit StreamWriter(FILE* os, Format fmt = Format::Hex);
+
+            /*!
+            Writes len bytes from binIn. Throws OutputError_StreamWrite on I/O
+            errors.
+            */
+            void write(const uint8_t* binIn, size_t len);
+
+            /*!
+            Terminates HEX output with a newline and flushes the stream.
+            */
+            void finish();
+
+        private:
+            FILE*             stream;
+            Format            format;
+            std::vector<char> textBuffer;
+            bool              wroteData;
+    };
+
     // exception types:
     struct InputError_IllegalConversion {};
+    struct InputError_StreamRead {};
+    struct OutputError_StreamWrite {};
 }
 
 #endif
+
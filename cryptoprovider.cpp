@@ -1,6 +1,7 @@
 
 #include "cryptoprovider.h"
 #include "RippaSSL/Base.h"
+#include "RippaSSL/Registry.h"
 #include "RippaSSL/error.h"
 #include <openssl/evp.h>
 #include <openssl/params.h>
@@ -23,8 +24,9 @@ int RippaSSL::performCmacOp(const char*          subAlg,
     int rc = 1;
     EVP_MAC_CTX* ctx = NULL;
 
-    // fetches the CMAC mode of operation:
-    EVP_MAC* mac = EVP_MAC_fetch(NULL, "cmac", NULL);
+    // the CMAC mode of operation is shared through the registry:
+    EVP_MAC* mac = const_cast<EVP_MAC*>(
+                        RippaSSL::fetchMac(RippaSSL::MacMode::CMAC));
 
     do
     {
@@ -85,7 +87,6 @@ int RippaSSL::performCmacOp(const char*          subAlg,
 
     // calling destructors:
     EVP_MAC_CTX_free(ctx);
-    EVP_MAC_free(mac);
 
     return rc;
 }
@@ -2,18 +2,747 @@
 #include "RippaSSL/error.h"
 #include "RippaSSL/Base.h"
 #include "RippaSSL/Cipher.h"
+#include "RippaSSL/Profiler.h"
+#include "server.h"
+#include "shmring.h"
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 #include <cstdarg>
 #include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 #include <ios>
 #include <iostream>
 #include <sstream>
+#include <csignal>
 
 #include <openssl/evp.h>
 #include <openssl/params.h>
 
+// size of the chunks pushed through the cipher when streaming, in bytes:
+static constexpr size_t streamChunkSize = 64 * 1024;
+
+// the phases --stats breaks a run down into:
+enum class Phase
+{
+    Parse,
+    Setup,
+    Input,
+    Cipher,
+    Output
+};
+
+static const char* const phaseNames[] {"parse", "setup", "input", "cipher",
+                                       "output"};
+
+/*!
+Accumulates the time and the bytes spent in each phase, when --stats is
+given. Disabled, every call reduces to a test of "enabled": the clock isn't
+even read.
+*/
+class PhaseStats {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        explicit PhaseStats(bool enable) : enabled {enable}, entries {} {}
+
+        Clock::time_point start() const
+        {
+            return enabled ? Clock::now() : Clock::time_point {};
+        }
+
+        void stop(Phase phase, Clock::time_point started, size_t bytes)
+        {
+            if (!enabled)
+                return;
+
+            Entry& entry = entries[static_cast<size_t>(phase)];
+            entry.nanoseconds += std::chrono::duration_cast<
+                                     std::chrono::nanoseconds>(
+                                         Clock::now() - started).count();
+            entry.bytes += bytes;
+            ++entry.calls;
+        }
+
+        /*!
+        Prints the breakdown to stderr, with the throughput of the phases
+        that processed data.
+        */
+        void print() const
+        {
+            if (!enabled)
+                return;
+
+            uint64_t totalNanoseconds = 0;
+
+            fprintf(stderr, "%-8s %8s %14s %14s %12s\n",
+                    "phase", "calls", "time [us]", "bytes", "MB/s");
+            for (size_t i = 0; i < phaseCount; ++i)
+            {
+                const Entry& entry = entries[i];
+                totalNanoseconds += entry.nanoseconds;
+
+                if (!entry.calls)
+                    continue;
+
+                fprintf(stderr, "%-8s %8llu %14.3f %14llu ", phaseNames[i],
+                        static_cast<unsigned long long>(entry.calls),
+                        entry.nanoseconds / 1e3,
+                        static_cast<unsigned long long>(entry.bytes));
+                if (entry.bytes && entry.nanoseconds)
+                    fprintf(stderr, "%12.1f\n",
+                            entry.bytes * 1e3 / entry.nanoseconds);
+                else
+                    fprintf(stderr, "%12s\n", "-");
+            }
+            fprintf(stderr, "%-8s %8s %14.3f\n", "total", "",
+                    totalNanoseconds / 1e3);
+        }
+
+    private:
+        static constexpr size_t phaseCount = sizeof(phaseNames) /
+                                             sizeof(phaseNames[0]);
+
+        struct Entry {
+            uint64_t nanoseconds;
+            uint64_t bytes;
+            uint64_t calls;
+        };
+
+        bool  enabled;
+        Entry entries[phaseCount];
+};
+
+// the MODE values accepted on the command line and in batch records:
+struct ModeEntry {
+    const char*       name;
+    RippaSSL::Algo    algo;
+    RippaSSL::BcmMode bcm;
+};
+
+static const ModeEntry modeTable[] {
+    {"AES128CBC", RippaSSL::Algo::AES128CBC,
+     RippaSSL::BcmMode::Bcm_CBC_Encrypt},
+    {"AES128ECB", RippaSSL::Algo::AES128ECB,
+     RippaSSL::BcmMode::Bcm_ECB_Encrypt},
+    {"AES256CBC", RippaSSL::Algo::AES256CBC,
+     RippaSSL::BcmMode::Bcm_CBC_Encrypt},
+    {"AES256ECB", RippaSSL::Algo::AES256ECB,
+     RippaSSL::BcmMode::Bcm_ECB_Encrypt},
+    {"AES128CTR", RippaSSL::Algo::AES128CTR,
+     RippaSSL::BcmMode::Bcm_CTR_Encrypt},
+    {"AES256CTR", RippaSSL::Algo::AES256CTR,
+     RippaSSL::BcmMode::Bcm_CTR_Encrypt},
+    {"AES128GCM", RippaSSL::Algo::AES128GCM,
+     RippaSSL::BcmMode::Bcm_GCM_Encrypt},
+    {"AES256GCM", RippaSSL::Algo::AES256GCM,
+     RippaSSL::BcmMode::Bcm_GCM_Encrypt}
+};
+
+// maps an encryption mode to its decryption counterpart:
+static RippaSSL::BcmMode decryptionMode(RippaSSL::BcmMode bcm)
+{
+    switch (bcm)
+    {
+        case RippaSSL::BcmMode::Bcm_CBC_Encrypt:
+            return RippaSSL::BcmMode::Bcm_CBC_Decrypt;
+        case RippaSSL::BcmMode::Bcm_ECB_Encrypt:
+            return RippaSSL::BcmMode::Bcm_ECB_Decrypt;
+        case RippaSSL::BcmMode::Bcm_CTR_Encrypt:
+            return RippaSSL::BcmMode::Bcm_CTR_Decrypt;
+        case RippaSSL::BcmMode::Bcm_GCM_Encrypt:
+            return RippaSSL::BcmMode::Bcm_GCM_Decrypt;
+        default:
+            return bcm;
+    }
+}
+
+/*!
+Looks MODE up in the mode table, switching to the decryption direction if
+requested. Returns false if it is unknown.
+*/
+static bool parseMode(const char*        name,
+                      bool               decrypt,
+                      RippaSSL::Algo&    algo,
+                      RippaSSL::BcmMode& bcm)
+{
+    for (const auto& entry : modeTable)
+    {
+        if (!strcmp(name, entry.name))
+        {
+            algo = entry.algo;
+            bcm  = decrypt ? decryptionMode(entry.bcm) : entry.bcm;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*!
+Same as parseMode, for the numeric algorithm of the --serve requests.
+*/
+static bool parseAlgo(uint8_t            value,
+                      bool               decrypt,
+                      RippaSSL::Algo&    algo,
+                      RippaSSL::BcmMode& bcm)
+{
+    for (const auto& entry : modeTable)
+    {
+        if (static_cast<uint8_t>(entry.algo) == value)
+        {
+            algo = entry.algo;
+            bcm  = decrypt ? decryptionMode(entry.bcm) : entry.bcm;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool requiresIv(RippaSSL::Algo algo)
+{
+    return (algo != RippaSSL::Algo::AES128ECB) &&
+           (algo != RippaSSL::Algo::AES256ECB);
+}
+
+static bool isAead(RippaSSL::Algo algo)
+{
+    return (algo == RippaSSL::Algo::AES128GCM) ||
+           (algo == RippaSSL::Algo::AES256GCM);
+}
+
+static bool isDecryption(RippaSSL::BcmMode bcm)
+{
+    return (bcm == RippaSSL::BcmMode::Bcm_CBC_Decrypt) ||
+           (bcm == RippaSSL::BcmMode::Bcm_ECB_Decrypt) ||
+           (bcm == RippaSSL::BcmMode::Bcm_CTR_Decrypt) ||
+           (bcm == RippaSSL::BcmMode::Bcm_GCM_Decrypt);
+}
+
+// the room the result of a message of msgLen bytes may need:
+static size_t resultCapacity(RippaSSL::Algo algo, size_t msgLen)
+{
+    return msgLen + RippaSSL::blockSizes.at(algo) + RippaSSL::aeadTagSize;
+}
+
+/*!
+Runs a whole message through "cipher" into output, which shall have room for
+resultCapacity() bytes and may be msg itself, and returns the output length.
+In AEAD modes, encryption appends the tag to the output, and decryption
+expects it at the end of msg.
+*/
+static size_t cipherMessage(RippaSSL::Cipher& cipher,
+                            RippaSSL::Algo    algo,
+                            RippaSSL::BcmMode bcm,
+                            const uint8_t*    msg,
+                            size_t            msgLen,
+                            uint8_t*          output)
+{
+    if (!isAead(algo))
+    {
+        return cipher.finalize(output, msg, msgLen);
+    }
+    else if (!isDecryption(bcm))
+    {
+        size_t written = cipher.finalizeTag(output, msg, msgLen,
+                                            output + msgLen);
+        return written + RippaSSL::aeadTagSize;
+    }
+    else if (msgLen < RippaSSL::aeadTagSize)
+    {
+        throw RippaSSL::OpenSSLError_Authentication {};
+    }
+    else
+    {
+        msgLen -= RippaSSL::aeadTagSize;
+        return cipher.finalizeVerify(output, msg, msgLen, msg + msgLen);
+    }
+}
+
+/*!
+Same as above, into result, which is resized to the output length.
+*/
+static void cipherMessage(RippaSSL::Cipher&     cipher,
+                          RippaSSL::Algo        algo,
+                          RippaSSL::BcmMode     bcm,
+                          const uint8_t*        msg,
+                          size_t                msgLen,
+                          std::vector<uint8_t>& result)
+{
+    result.resize(resultCapacity(algo, msgLen));
+    result.resize(cipherMessage(cipher, algo, bcm, msg, msgLen,
+                                result.data()));
+}
+
+/*!
+Ciphers, one per MODE, reused from message to message: a context whose key
+matches only gets a new IV, any other is rekeyed in place, so that algorithm
+handles and contexts stay warm.
+*/
+class CipherCache {
+    public:
+        RippaSSL::Cipher& acquire(RippaSSL::Algo              algo,
+                                  RippaSSL::BcmMode           bcm,
+                                  const std::vector<uint8_t>& key,
+                                  const uint8_t*              iv)
+        {
+            Entry& entry = entries[{algo, bcm}];
+
+            if (!entry.cipher)
+            {
+                entry.cipher.reset(new RippaSSL::Cipher {algo, bcm, key, iv});
+                entry.key = key;
+            }
+            else if (entry.key == key)
+            {
+                entry.cipher->reset(iv);
+            }
+            else
+            {
+                entry.cipher->rekey(key, iv);
+                entry.key = key;
+            }
+
+            return *entry.cipher;
+        }
+
+    private:
+        struct Entry {
+            std::unique_ptr<RippaSSL::Cipher> cipher;
+            std::vector<uint8_t>              key;
+        };
+
+        std::map<std::pair<RippaSSL::Algo, RippaSSL::BcmMode>, Entry> entries;
+};
+
+/*!
+Prints the per-kernel counters collected with --perf to stderr. Without
+hardware counters, cycles are time stamp counter ticks, and the columns that
+need the PMU show "-".
+*/
+static void printProfile()
+{
+    std::vector<RippaSSL::KernelProfile> report = RippaSSL::profileReport();
+
+    fprintf(stderr, "%-16s %-10s %8s %12s %10s %8s %8s %12s\n",
+            "operation", "algo", "calls", "bytes", "MB/s", "cyc/B", "IPC",
+            "miss/call");
+    for (const RippaSSL::KernelProfile& p : report)
+    {
+        const char* algoName = "?";
+        for (const auto& entry : modeTable)
+        {
+            if (entry.algo == p.algo)
+                algoName = entry.name;
+        }
+
+        fprintf(stderr, "%-16s %-10s %8llu %12llu %10.1f ",
+                RippaSSL::operationName(p.operation), algoName,
+                static_cast<unsigned long long>(p.calls),
+                static_cast<unsigned long long>(p.bytes),
+                p.nanoseconds ? p.bytes * 1e3 / p.nanoseconds : 0.0);
+
+        if (p.bytes && p.cycles)
+            fprintf(stderr, "%8.2f ", static_cast<double>(p.cycles) / p.bytes);
+        else
+            fprintf(stderr, "%8s ", "-");
+
+        if (p.hardwareCounters && p.cycles)
+            fprintf(stderr, "%8.2f %12.1f\n",
+                    static_cast<double>(p.instructions) / p.cycles,
+                    static_cast<double>(p.cacheMisses) / p.calls);
+        else
+            fprintf(stderr, "%8s %12s\n", "-", "-");
+    }
+
+    if (!report.empty() && !report.front().hardwareCounters)
+        fprintf(stderr, "(no hardware counters: cycles are TSC ticks)\n");
+}
+
+/*!
+Parses a stream format name ("hex" or "raw") into fmt.
+Returns false if the name is unknown.
+*/
+static bool parseFormat(const char* name, BinIO::Format& fmt)
+{
+    if (!strcmp(name, "hex"))
+        fmt = BinIO::Format::Hex;
+    else if (!strcmp(name, "raw"))
+        fmt = BinIO::Format::Raw;
+    else
+        return false;
+
+    return true;
+}
+
+/*!
+Encrypts the whole content of "reader" into "writer", one chunk at a time, so
+that memory usage doesn't depend on the input size.
+In AEAD modes (tagSize != 0), encryption appends the tag to the output, while
+decryption holds the last tagSize bytes of the input back and verifies them
+as the tag. The plaintext streamed out before a verification failure shall
+then be discarded.
+*/
+static void streamCipher(RippaSSL::Cipher&    cipher,
+                         BinIO::StreamReader& reader,
+                         BinIO::StreamWriter& writer,
+                         size_t               blockSize,
+                         size_t               chunkSize,
+                         size_t               tagSize,
+                         bool                 decrypt,
+                         PhaseStats&          stats)
+{
+    // the held back bytes lead the input buffer:
+    std::vector<uint8_t> inBuf(chunkSize + tagSize);
+    // the update function may output up to one block more than its input:
+    std::vector<uint8_t> outBuf(chunkSize + tagSize + blockSize);
+    size_t heldLen = 0;
+    size_t readLen;
+    size_t finalizeLen;
+    auto started = stats.start();
+
+    while ((readLen = reader.read(inBuf.data() + heldLen, chunkSize)))
+    {
+        stats.stop(Phase::Input, started, readLen);
+
+        size_t availableLen = heldLen + readLen;
+        size_t feedLen = availableLen;
+
+        if (decrypt && tagSize)
+        {
+            feedLen = (availableLen > tagSize) ? availableLen - tagSize : 0;
+        }
+
+        started = stats.start();
+        size_t outLen = cipher.update(outBuf.data(), inBuf.data(), feedLen);
+        stats.stop(Phase::Cipher, started, feedLen);
+
+        started = stats.start();
+        writer.write(outBuf.data(), outLen);
+        stats.stop(Phase::Output, started, outLen);
+
+        heldLen = availableLen - feedLen;
+        std::copy(inBuf.begin() + feedLen, inBuf.begin() + availableLen,
+                  inBuf.begin());
+        started = stats.start();
+    }
+
+    // the reader hit the end of the stream:
+    stats.stop(Phase::Input, started, 0);
+    started = stats.start();
+
+    if (!tagSize)
+    {
+        finalizeLen = cipher.finalize(outBuf.data(), nullptr, 0);
+    }
+    else if (!decrypt)
+    {
+        finalizeLen = cipher.finalizeTag(outBuf.data(), nullptr, 0,
+                                         inBuf.data());
+        std::copy(inBuf.begin(), inBuf.begin() + tagSize,
+                  outBuf.begin() + finalizeLen);
+        finalizeLen += tagSize;
+    }
+    else if (heldLen < tagSize)
+    {
+        throw RippaSSL::OpenSSLError_Authentication {};
+    }
+    else
+    {
+        finalizeLen = cipher.finalizeVerify(outBuf.data(), nullptr, 0,
+                                            inBuf.data());
+    }
+
+    stats.stop(Phase::Cipher, started, 0);
+
+    started = stats.start();
+    writer.write(outBuf.data(), finalizeLen);
+    writer.finish();
+    stats.stop(Phase::Output, started, finalizeLen);
+}
+
+/*!
+Processes a file of records, one per line, each made of the same fields as
+the command line: "MODE KEY [IV] MESSAGE", HEX-encoded and separated by
+blanks. Empty lines and lines starting with '#' are skipped. For every record,
+a line is written to "out", in input order: "OK" followed by the HEX result,
+or "ERR" followed by the reason of the failure.
+Contexts are cached per MODE and reused across records, switching key and IV
+in place. Returns the number of failed records.
+*/
+static size_t runBatch(FILE* in, FILE* out, bool decrypt, PhaseStats& stats)
+{
+    CipherCache cache;
+    std::vector<uint8_t> key;
+    std::vector<uint8_t> iv;
+    std::vector<uint8_t> msg;
+    std::vector<uint8_t> result;
+    BinIO::StreamWriter writer {out};
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    size_t failedRecords = 0;
+
+    // decodes a HEX field into a reusable buffer:
+    auto decodeField = [] (std::vector<uint8_t>& field, const char* text) {
+        size_t len = strlen(text);
+        field.resize(len / 2);
+        return (0 != BinIO::hexToBinary(field.data(), text, len));
+    };
+
+    ssize_t lineLen;
+    auto started = stats.start();
+
+    while (-1 != (lineLen = getline(&line, &lineCapacity, in)))
+    {
+        stats.stop(Phase::Input, started, lineLen);
+        started = stats.start();
+
+        char* fields[5];
+        size_t fieldCount = 0;
+        char* savePtr = NULL;
+        const char* status = NULL;
+        RippaSSL::Algo    algo;
+        RippaSSL::BcmMode bcm;
+
+        for (char* token = strtok_r(line, " \t\r\n", &savePtr);
+             (NULL != token) && (fieldCount < 5);
+             token = strtok_r(NULL, " \t\r\n", &savePtr))
+        {
+            fields[fieldCount++] = token;
+        }
+
+        if (!fieldCount || ('#' == fields[0][0]))
+        {
+            stats.stop(Phase::Parse, started, lineLen);
+            started = stats.start();
+            continue;
+        }
+
+        bool hasIv = (4 == fieldCount);
+
+        if ((fieldCount < 3) || (fieldCount > 4))
+            status = "ERR record";
+        else if (!parseMode(fields[0], decrypt, algo, bcm))
+            status = "ERR mode";
+        else if (!decodeField(key, fields[1]) ||
+                 ((16 != key.size()) && (32 != key.size())))
+            status = "ERR key";
+        else if (hasIv ? (!decodeField(iv, fields[2]) ||
+                          (RippaSSL::ivSizes.at(algo) != iv.size())) :
+                         requiresIv(algo))
+            status = "ERR iv";
+        else if (!decodeField(msg, fields[fieldCount - 1]))
+            status = "ERR message";
+
+        stats.stop(Phase::Parse, started, lineLen);
+
+        if (NULL == status)
+        {
+            const uint8_t* ivPtr = hasIv ? iv.data() : nullptr;
+
+            try {
+                started = stats.start();
+                RippaSSL::Cipher& cipher = cache.acquire(algo, bcm, key, ivPtr);
+                stats.stop(Phase::Setup, started, 0);
+
+                started = stats.start();
+                cipherMessage(cipher, algo, bcm, msg.data(), msg.size(),
+                              result);
+                stats.stop(Phase::Cipher, started, msg.size());
+                status = "OK";
+            }
+            catch (RippaSSL::InputError_KEY_LENGTH& kl) {
+                status = "ERR key";
+            }
+            catch (RippaSSL::OpenSSLError_CryptoFinalize& cf) {
+                status = "ERR finalize";
+            }
+            catch (RippaSSL::OpenSSLError_Authentication& au) {
+                status = "ERR authentication";
+            }
+            catch (...) {
+                status = "ERR crypto";
+            }
+        }
+
+        started = stats.start();
+        fputs(status, out);
+        if ('O' == status[0])
+        {
+            fputc(' ', out);
+            writer.write(result.data(), result.size());
+        }
+        else
+        {
+            ++failedRecords;
+        }
+        fputc('\n', out);
+        stats.stop(Phase::Output, started,
+                   ('O' == status[0]) ? result.size() : 0);
+        started = stats.start();
+    }
+
+    free(line);
+
+    return failedRecords;
+}
+
+/*!
+Serves a --serve or --shm request with the ciphers of "cache", writing the
+result to output, which has room for "capacity" bytes and may be the
+payload itself. "key" is scratch space kept across requests.
+*/
+static BinServer::Status serveRequest(CipherCache&              cache,
+                                      std::vector<uint8_t>&     key,
+                                      const BinServer::Request& request,
+                                      uint8_t*                  output,
+                                      size_t                    capacity,
+                                      size_t&                   resultLen)
+{
+    typedef BinServer::Status Status;
+
+    RippaSSL::Algo    algo;
+    RippaSSL::BcmMode bcm;
+
+    if (!parseAlgo(request.algo, request.decrypt, algo, bcm))
+        return Status::Mode;
+    if ((16 != request.keyLen) && (32 != request.keyLen))
+        return Status::Key;
+    if (request.ivLen ? (RippaSSL::ivSizes.at(algo) != request.ivLen) :
+                        requiresIv(algo))
+        return Status::Iv;
+    if ((request.aadLen && !isAead(algo)) ||
+        (resultCapacity(algo, request.payloadLen) > capacity))
+        return Status::Malformed;
+
+    key.assign(request.key, request.key + request.keyLen);
+
+    try {
+        RippaSSL::Cipher& cipher =
+            cache.acquire(algo, bcm, key, request.ivLen ? request.iv : nullptr);
+
+        if (request.aadLen)
+            cipher.updateAad(request.aad, request.aadLen);
+
+        resultLen = cipherMessage(cipher, algo, bcm, request.payload,
+                                  request.payloadLen, output);
+    }
+    catch (RippaSSL::InputError_KEY_LENGTH& kl) {
+        return Status::Key;
+    }
+    catch (RippaSSL::OpenSSLError_Authentication& au) {
+        return Status::Authentication;
+    }
+    catch (...) {
+        return Status::Crypto;
+    }
+
+    return Status::Ok;
+}
+
+// the --serve or --shm loop that SIGINT and SIGTERM stop:
+static BinServer::Server* runningServer = nullptr;
+static ShmRing::Worker*   runningWorker = nullptr;
+
+static void stopOnSignal(int)
+{
+    if (nullptr != runningServer)
+        runningServer->stop();
+    if (nullptr != runningWorker)
+        runningWorker->stop();
+}
+
+// installs stopOnSignal for SIGINT and SIGTERM, or restores the defaults:
+static void catchStopSignals(bool enable)
+{
+    struct sigaction action {};
+
+    action.sa_handler = enable ? stopOnSignal : SIG_DFL;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+/*!
+Answers --serve requests on socketPath until SIGINT or SIGTERM, with the
+ciphers cached across requests and clients. Returns false if the socket
+cannot be set up.
+*/
+static bool runServer(const char* socketPath)
+{
+    CipherCache cache;
+    std::vector<uint8_t> key;
+
+    auto handler = [&cache, &key] (const BinServer::Request& request,
+                                   std::vector<uint8_t>&     result) {
+        size_t resultLen = 0;
+
+        // room for a padding block and a tag, whatever the mode:
+        result.resize(request.payloadLen + RippaSSL::aeadTagSize + 16);
+        BinServer::Status status = serveRequest(cache, key, request,
+                                                result.data(), result.size(),
+                                                resultLen);
+        result.resize(resultLen);
+
+        return status;
+    };
+
+    try {
+        BinServer::Server server {socketPath, handler};
+
+        runningServer = &server;
+        catchStopSignals(true);
+        server.run();
+        catchStopSignals(false);
+        runningServer = nullptr;
+    }
+    catch (BinServer::ServerError_Setup& se) {
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+Serves the requests of the shared memory segment "name", ciphering them in
+place, until SIGINT or SIGTERM. Returns false if the segment cannot be set
+up.
+*/
+static bool runShmWorker(const char* name, uint32_t slotCount, size_t slotSize)
+{
+    CipherCache cache;
+    std::vector<uint8_t> key;
+
+    auto handler = [&cache, &key] (const BinServer::Request& request,
+                                   uint8_t*                  output,
+                                   size_t                    capacity,
+                                   size_t&                   resultLen) {
+        return serveRequest(cache, key, request, output, capacity, resultLen);
+    };
+
+    try {
+        ShmRing::Worker worker {name, slotCount, slotSize};
+
+        runningWorker = &worker;
+        catchStopSignals(true);
+        worker.run(handler);
+        catchStopSignals(false);
+        runningWorker = nullptr;
+    }
+    catch (ShmRing::ShmError_Setup& se) {
+        return false;
+    }
+
+    return true;
+}
 
 int main(int argc, char* argv[])
 {
@@ -22,86 +751,321 @@ int main(int argc, char* argv[])
     std::vector<uint8_t> key;
     RippaSSL::Algo     algo;
     RippaSSL::BcmMode  bcm;
-    int msgIdx;
+    std::vector<char*> args;
+    const char* inPath  = NULL;
+    const char* outPath   = NULL;
+    const char* batchPath = NULL;
+    const char* servePath = NULL;
+    const char* shmName   = NULL;
+    unsigned long shmSlots    = 16;
+    unsigned long shmSlotSize = 1024 * 1024;
+    FILE* inFile  = stdin;
+    FILE* outFile = stdout;
+    BinIO::Format inFormat  = BinIO::Format::Hex;
+    BinIO::Format outFormat = BinIO::Format::Hex;
+    bool formatGiven = false;
+    bool badOption   = false;
+    unsigned int workers = 1;
+    bool decrypt = false;
+    const char* aadText = NULL;
+    bool statsRequested = false;
+    bool perfRequested  = false;
 
-    if ((argc < 4) || (argc > 5))
+    // separates the options from the positional arguments:
+    for (int i = 1; i < argc; ++i)
     {
-        printf("Usage: binenc MODE KEY [IV] MESSAGE\n"
-               "    The key shall be provided without spaces. The same applies"
-               " to the message and IV.\n"
-               "    An example usage:\n"
-               "    $ ./binenc AES128CBC 000102030405060708090A0B0C0D0E0F "
-               "00000000000000000000000000000000 000102030405060708090A0B0C0D0E"
-               "0F000102030405060708090A0B0C0D0E0F\n");
-        return 1;
-    }
+        if (!strcmp(argv[i], "--in") && (i + 1 < argc))
+        {
+            inPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--out") && (i + 1 < argc))
+        {
+            outPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--batch") && (i + 1 < argc))
+        {
+            batchPath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--serve") && (i + 1 < argc))
+        {
+            servePath = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--shm") && (i + 1 < argc))
+        {
+            shmName = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--slots") && (i + 1 < argc))
+        {
+            char* end;
+            shmSlots  = strtoul(argv[++i], &end, 10);
+            badOption = ('\0' != *end) || !shmSlots ||
+                        (shmSlots > ShmRing::maxSlotCount) ||
+                        (shmSlots & (shmSlots - 1));
+        }
+        else if (!strcmp(argv[i], "--slot-size") && (i + 1 < argc))
+        {
+            char* end;
+            shmSlotSize = strtoul(argv[++i], &end, 10);
+            badOption   = ('\0' != *end) || !shmSlotSize ||
+                          (shmSlotSize > ShmRing::maxSlotSize);
+        }
+        else if (!strcmp(argv[i], "--decrypt"))
+        {
+            decrypt = true;
+        }
+        else if (!strcmp(argv[i], "--aad") && (i + 1 < argc))
+        {
+            aadText = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--stats"))
+        {
+            statsRequested = true;
+        }
+        else if (!strcmp(argv[i], "--perf"))
+        {
+            perfRequested = true;
+        }
+        else if (!strcmp(argv[i], "--threads") && (i + 1 < argc))
+        {
+            char* end;
+            unsigned long requested = strtoul(argv[++i], &end, 10);
 
-    {
-        char* myMode = argv[1];
+            // 0 picks one worker per hardware thread:
+            if (!requested)
+                requested = std::thread::hardware_concurrency();
 
-        if (!strcmp(myMode, "AES128CBC"))
+            badOption = ('\0' != *end) || (requested > 1024);
+            workers   = std::max(1ul, requested);
+        }
+        else if (!strcmp(argv[i], "--format") && (i + 1 < argc))
         {
-            bcm  = RippaSSL::BcmMode::Bcm_CBC_Encrypt;
-            algo = RippaSSL::Algo::AES128CBC;
+            badOption   = !parseFormat(argv[++i], inFormat);
+            outFormat   = inFormat;
+            formatGiven = true;
         }
-        else if(!strcmp(myMode, "AES256CBC"))
+        else if (!strcmp(argv[i], "--in-format") && (i + 1 < argc))
         {
-            bcm  = RippaSSL::BcmMode::Bcm_CBC_Encrypt;
-            algo = RippaSSL::Algo::AES256CBC;
+            badOption   = !parseFormat(argv[++i], inFormat);
+            formatGiven = true;
         }
-        else if (!strcmp(myMode, "AES128ECB"))
+        else if (!strcmp(argv[i], "--out-format") && (i + 1 < argc))
         {
-            bcm  = RippaSSL::BcmMode::Bcm_ECB_Encrypt;
-            algo = RippaSSL::Algo::AES128ECB;
+            badOption   = !parseFormat(argv[++i], outFormat);
+            formatGiven = true;
         }
-        else if (!strcmp(myMode, "AES256ECB"))
+        else if (!strncmp(argv[i], "--", 2))
         {
-            bcm  = RippaSSL::BcmMode::Bcm_ECB_Encrypt;
-            algo = RippaSSL::Algo::AES256ECB;
+            badOption = true;
         }
         else
         {
-            printf("Check your MODE input!\nPossible values are:\n"
-            "   AES128CBC, AES128ECB, AES256CBC, AES256ECB\n");
+            args.push_back(argv[i]);
+        }
+
+        if (badOption)
+        {
+            args.clear();
+            break;
+        }
+    }
+
+    PhaseStats stats {statsRequested};
+    RippaSSL::enableProfiling(perfRequested);
+
+    // the message is read from argv unless an input stream is given:
+    size_t minArgs = (NULL == inPath) ? 3 : 2;
+
+    if ((NULL != servePath) && !badOption && args.empty() &&
+        (NULL == inPath) && (NULL == batchPath))
+    {
+        if (!runServer(servePath))
+        {
+            printf("Cannot listen on socket %s!\n", servePath);
             return 1;
         }
+
+        if (perfRequested)
+            printProfile();
+
+        return 0;
     }
 
+    if ((NULL != shmName) && !badOption && args.empty() &&
+        (NULL == inPath) && (NULL == batchPath) && (NULL == servePath))
+    {
+        if (!runShmWorker(shmName, shmSlots, shmSlotSize))
+        {
+            printf("Cannot create shared memory segment %s!\n", shmName);
+            return 1;
+        }
+
+        if (perfRequested)
+            printProfile();
+
+        return 0;
+    }
+
+    if ((NULL != batchPath) && !badOption && args.empty() && (NULL == inPath))
+    {
+        if (strcmp(batchPath, "-") &&
+            (NULL == (inFile = fopen(batchPath, "r"))))
+        {
+            printf("Cannot open batch file %s!\n", batchPath);
+            return 1;
+        }
+
+        if ((NULL != outPath) && strcmp(outPath, "-") &&
+            (NULL == (outFile = fopen(outPath, "w"))))
+        {
+            printf("Cannot open output file %s!\n", outPath);
+            return 1;
+        }
+
+        size_t failedRecords = runBatch(inFile, outFile, decrypt, stats);
+
+        if (stdin != inFile)
+            fclose(inFile);
+        if ((stdout != outFile) ? fclose(outFile) : fflush(outFile))
+        {
+            printf("Error! Failed to write the output stream!\n");
+            return 1;
+        }
+
+        stats.print();
+        if (perfRequested)
+            printProfile();
+
+        return failedRecords ? 1 : 0;
+    }
 
-    BinIO::readHexBinary(key, argv[2]);
+    if ((args.size() < minArgs) || (args.size() > minArgs + 1) ||
+        (NULL != batchPath) || (NULL != servePath) || (NULL != shmName))
+    {
+        printf("Usage: binenc [--in FILE|-] [--out FILE|-] [--format raw|hex] "
+               "[--threads N]\n"
+               "              [--decrypt] [--aad AAD] [--stats] [--perf] "
+               "MODE KEY [IV] [MESSAGE]\n"
+               "       binenc --batch FILE|- [--out FILE|-] [--decrypt] "
+               "[--stats] [--perf]\n"
+               "       binenc --serve SOCKET [--perf]\n"
+               "       binenc --shm NAME [--slots N] [--slot-size BYTES] "
+               "[--perf]\n"
+               "    The key shall be provided without spaces. The same applies"
+               " to the message and IV.\n"
+               "    MESSAGE is required unless --in is given, in which case "
+               "the message is\n"
+               "    streamed from FILE (or stdin for -). --out writes the "
+               "result to FILE (or\n"
+               "    stdout for -) instead of printing it.\n"
+               "    --format selects whether streams carry HEX text (default) "
+               "or raw bytes;\n"
+               "    --in-format and --out-format set it for one direction "
+               "only.\n"
+               "    --decrypt runs MODE in the decryption direction.\n"
+               "    GCM modes append the 16 bytes tag to the ciphertext, and "
+               "expect it there\n"
+               "    when decrypting; --aad passes HEX additional authenticated"
+               " data.\n"
+               "    --threads N splits large ECB and CTR operations and CBC "
+               "decryption across\n"
+               "    N threads (0: one per CPU).\n"
+               "    --batch processes a file of records, one per line, made of"
+               " the fields\n"
+               "    MODE KEY [IV] MESSAGE, and writes \"OK RESULT\" or "
+               "\"ERR REASON\" for each.\n"
+               "    --serve answers binary requests on the Unix domain socket"
+               " SOCKET until\n"
+               "    interrupted; see server.h for the wire format.\n"
+               "    --shm serves the same requests, ciphered in place, through"
+               " the shared\n"
+               "    memory segment NAME (e.g. /binenc) of N slots (default 16,"
+               " a power of\n"
+               "    two) of BYTES each (default 1 MiB); see shmring.h.\n"
+               "    --stats prints the time and bytes spent per phase to "
+               "stderr; --perf prints\n"
+               "    the cycles per byte, IPC and cache misses of the cipher "
+               "calls.\n"
+               "    An example usage:\n"
+               "    $ ./binenc AES128CBC 000102030405060708090A0B0C0D0E0F "
+               "00000000000000000000000000000000 000102030405060708090A0B0C0D0E"
+               "0F000102030405060708090A0B0C0D0E0F\n");
+        return 1;
+    }
+
+    auto started = stats.start();
+    size_t parsedChars = strlen(args[0]) + strlen(args[1]);
+
+    if (!parseMode(args[0], decrypt, algo, bcm))
+    {
+        printf("Check your MODE input!\nPossible values are:\n  ");
+        for (const auto& entry : modeTable)
+            printf(" %s", entry.name);
+        printf("\n");
+        return 1;
+    }
+
+
+    BinIO::readHexBinary(key, args[1]);
     if ((16 != key.size()) && (32 != key.size()))
     {
         printf("Wrong key length: %lu!\n", key.size());
         return 1;
     }
 
-    if (argc == 5)
+    if (args.size() > minArgs)
     {
-        BinIO::readHexBinary(iv, argv[3]);
+        BinIO::readHexBinary(iv, args[2]);
+        parsedChars += strlen(args[2]);
 
-        if (RippaSSL::blockSizes.at(algo) != iv.size())
+        if (RippaSSL::ivSizes.at(algo) != iv.size())
         {
             printf("Wrong iv length!\n");
             return 1;
         }
 
         iv_ptr = iv.data();
-        msgIdx = 4;
     }
-    else if ((algo == RippaSSL::Algo::AES128CBC) ||
-             (algo == RippaSSL::Algo::AES256CBC))
+    else if (requiresIv(algo))
     {
-        printf("CBC modes require an IV for correct operation!\n");
+        printf("CBC, CTR and GCM modes require an IV for correct "
+               "operation!\n");
         return 1;
     }
-    else
+
+    std::vector<uint8_t> aad;
+    if ((NULL != aadText) &&
+        (!isAead(algo) || !BinIO::readHexBinary(aad, aadText)))
+    {
+        printf("AAD requires a GCM mode and a valid HEX array!\n");
+        return 1;
+    }
+    parsedChars += (NULL != aadText) ? strlen(aadText) : 0;
+    stats.stop(Phase::Parse, started, parsedChars);
+
+    // opens the streams, "-" standing for stdin/stdout:
+    if ((NULL != inPath) && strcmp(inPath, "-") &&
+        (NULL == (inFile = fopen(inPath, "rb"))))
+    {
+        printf("Cannot open input file %s!\n", inPath);
+        return 1;
+    }
+
+    if ((NULL != outPath) && strcmp(outPath, "-") &&
+        (NULL == (outFile = fopen(outPath, "wb"))))
     {
-        msgIdx = 3;
+        printf("Cannot open output file %s!\n", outPath);
+        return 1;
     }
 
-    // reads the input message and places it into buf:
+    // reads the input message (if passed on the command line) and places it
+    // into buf:
     std::vector<uint8_t> msgVector;
-    BinIO::readHexBinary(msgVector, argv[msgIdx]);
+    if (NULL == inPath)
+    {
+        started = stats.start();
+        BinIO::readHexBinary(msgVector, args.back());
+        stats.stop(Phase::Parse, started, strlen(args.back()));
+    }
 
     // optionally prints the input message:
     //for (size_t i = 0; i < msgVector.size(); ++i)
@@ -112,8 +1076,47 @@ int main(int argc, char* argv[])
 
     // creates the relevant object:
     try {
+        started = stats.start();
         RippaSSL::Cipher myCbc {algo, bcm, key, iv_ptr};
-        myCbc.finalize(msgVector, msgVector);
+        myCbc.setWorkers(workers);
+
+        if (!aad.empty())
+        {
+            myCbc.updateAad(aad.data(), aad.size());
+        }
+        BinIO::StreamWriter writer {outFile, outFormat};
+        stats.stop(Phase::Setup, started, 0);
+
+        if (NULL != inPath)
+        {
+            BinIO::StreamReader reader {inFile, inFormat};
+            // parallel updates need chunks large enough to be split:
+            size_t chunkSize = (workers > 1) ?
+                std::max(streamChunkSize,
+                         4 * workers * RippaSSL::parallelMinSlice) :
+                streamChunkSize;
+
+            streamCipher(myCbc, reader, writer, RippaSSL::blockSizes.at(algo),
+                         chunkSize, isAead(algo) ? RippaSSL::aeadTagSize : 0,
+                         decrypt, stats);
+        }
+        else
+        {
+            std::vector<uint8_t> result;
+            started = stats.start();
+            cipherMessage(myCbc, algo, bcm, msgVector.data(),
+                          msgVector.size(), result);
+            stats.stop(Phase::Cipher, started, msgVector.size());
+            msgVector.swap(result);
+
+            if ((NULL != outPath) || formatGiven)
+            {
+                started = stats.start();
+                writer.write(msgVector.data(), msgVector.size());
+                writer.finish();
+                stats.stop(Phase::Output, started, msgVector.size());
+            }
+        }
     }
     catch (RippaSSL::InputError_NULLPTR& nullPtr) {
         printf("Error! The key pointer is invalid, or something nasty happened"
@@ -121,6 +1124,11 @@ int main(int argc, char* argv[])
 
         return 1;
     }
+    catch (RippaSSL::InputError_KEY_LENGTH& kl) {
+        printf("Error! The key is too short for the selected MODE!\n");
+
+        return 1;
+    }
     catch (RippaSSL::OpenSSLError_CryptoInit& ci) {
         printf("Error! OpenSSL failed to call its Init method!\n");
 
@@ -136,11 +1144,48 @@ int main(int argc, char* argv[])
 
         return 1;
     }
+    catch (RippaSSL::OpenSSLError_Authentication& au) {
+        printf("Error! Authentication failed: the data or the tag were "
+               "tampered with!\n");
+
+        return 1;
+    }
+    catch (BinIO::InputError_IllegalConversion& ic) {
+        printf("Error! The input stream is not a valid HEX array!\n");
 
-    // prints the result:
-    printf("Result: ");
-    BinIO::printHexBinary(msgVector);
+        return 1;
+    }
+    catch (BinIO::InputError_StreamRead& sr) {
+        printf("Error! Failed to read the input stream!\n");
+
+        return 1;
+    }
+    catch (BinIO::OutputError_StreamWrite& sw) {
+        printf("Error! Failed to write the output stream!\n");
+
+        return 1;
+    }
+
+    if (stdin != inFile)
+        fclose(inFile);
+    if ((stdout != outFile) ? fclose(outFile) : fflush(outFile))
+    {
+        printf("Error! Failed to write the output stream!\n");
+        return 1;
+    }
+
+    // prints the result, unless it was streamed already:
+    if ((NULL == inPath) && (NULL == outPath) && !formatGiven)
+    {
+        started = stats.start();
+        printf("Result: ");
+        BinIO::printHexBinary(msgVector);
+        stats.stop(Phase::Output, started, msgVector.size());
+    }
+
+    stats.print();
+    if (perfRequested)
+        printProfile();
 
     return 0;
 }
-
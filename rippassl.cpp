@@ -0,0 +1,527 @@
+#include "rippassl.h"
+
+#include "binIO.h"
+#include "RippaSSL/Base.h"
+#include "RippaSSL/Cipher.h"
+#include "RippaSSL/Mac.h"
+#include "RippaSSL/error.h"
+
+#include <new>
+#include <cstdint>
+#include <cstddef>
+
+struct rippassl_cipher {
+    RippaSSL::Cipher cipher;
+    RippaSSL::Algo   algo;
+    size_t           keyLen;
+};
+
+struct rippassl_cmac {
+    RippaSSL::Cmac cmac;
+    size_t         keyLen;
+};
+
+// the public algorithm numbers are cast straight to RippaSSL::Algo:
+static_assert(RIPPASSL_AES128CBC ==
+              static_cast<int>(RippaSSL::Algo::AES128CBC), "AES128CBC");
+static_assert(RIPPASSL_AES128ECB ==
+              static_cast<int>(RippaSSL::Algo::AES128ECB), "AES128ECB");
+static_assert(RIPPASSL_AES256CBC ==
+              static_cast<int>(RippaSSL::Algo::AES256CBC), "AES256CBC");
+static_assert(RIPPASSL_AES256ECB ==
+              static_cast<int>(RippaSSL::Algo::AES256ECB), "AES256ECB");
+static_assert(RIPPASSL_AES128CTR ==
+              static_cast<int>(RippaSSL::Algo::AES128CTR), "AES128CTR");
+static_assert(RIPPASSL_AES256CTR ==
+              static_cast<int>(RippaSSL::Algo::AES256CTR), "AES256CTR");
+static_assert(RIPPASSL_AES128GCM ==
+              static_cast<int>(RippaSSL::Algo::AES128GCM), "AES128GCM");
+static_assert(RIPPASSL_AES256GCM ==
+              static_cast<int>(RippaSSL::Algo::AES256GCM), "AES256GCM");
+
+namespace {
+    bool validAlgo(int algo)
+    {
+        return (algo >= RIPPASSL_AES128CBC) && (algo <= RIPPASSL_AES256GCM);
+    }
+
+    size_t keyLength(RippaSSL::Algo algo)
+    {
+        switch (algo)
+        {
+            case RippaSSL::Algo::AES256CBC:
+            case RippaSSL::Algo::AES256ECB:
+            case RippaSSL::Algo::AES256CTR:
+            case RippaSSL::Algo::AES256GCM:
+                return 32;
+            default:
+                return 16;
+        }
+    }
+
+    bool isEcb(RippaSSL::Algo algo)
+    {
+        return (RippaSSL::Algo::AES128ECB == algo) ||
+               (RippaSSL::Algo::AES256ECB == algo);
+    }
+
+    RippaSSL::BcmMode modeOf(RippaSSL::Algo algo, bool decrypt)
+    {
+        switch (algo)
+        {
+            case RippaSSL::Algo::AES128ECB:
+            case RippaSSL::Algo::AES256ECB:
+                return decrypt ? RippaSSL::BcmMode::Bcm_ECB_Decrypt :
+                                 RippaSSL::BcmMode::Bcm_ECB_Encrypt;
+            case RippaSSL::Algo::AES128CTR:
+            case RippaSSL::Algo::AES256CTR:
+                return decrypt ? RippaSSL::BcmMode::Bcm_CTR_Decrypt :
+                                 RippaSSL::BcmMode::Bcm_CTR_Encrypt;
+            case RippaSSL::Algo::AES128GCM:
+            case RippaSSL::Algo::AES256GCM:
+                return decrypt ? RippaSSL::BcmMode::Bcm_GCM_Decrypt :
+                                 RippaSSL::BcmMode::Bcm_GCM_Encrypt;
+            default:
+                return decrypt ? RippaSSL::BcmMode::Bcm_CBC_Decrypt :
+                                 RippaSSL::BcmMode::Bcm_CBC_Encrypt;
+        }
+    }
+
+    // an IV shall match the algorithm, and may only be omitted for ECB:
+    bool validIv(RippaSSL::Algo algo, const uint8_t* iv, size_t ivLen)
+    {
+        if (!ivLen)
+            return isEcb(algo);
+
+        return (NULL != iv) && (RippaSSL::ivSizes.at(algo) == ivLen);
+    }
+
+    /*!
+    Runs "operation", turning the exceptions of RippaSSL and BinIO into
+    status codes: nothing may unwind through the C interface.
+    */
+    template<typename Operation>
+    int guarded(Operation&& operation)
+    {
+        try {
+            operation();
+            return RIPPASSL_OK;
+        }
+        catch (RippaSSL::InputError_NULLPTR& np) {
+            return RIPPASSL_ERR_NULLPTR;
+        }
+        catch (RippaSSL::InputError_KEY_LENGTH& kl) {
+            return RIPPASSL_ERR_KEY_LENGTH;
+        }
+        catch (RippaSSL::InputError_MISALIGNED_DATA& md) {
+            return RIPPASSL_ERR_MISALIGNED_DATA;
+        }
+        catch (RippaSSL::InputError_UNSUPPORTED_MODE& um) {
+            return RIPPASSL_ERR_UNSUPPORTED_MODE;
+        }
+        catch (RippaSSL::OpenSSLError_CryptoInit& ci) {
+            return RIPPASSL_ERR_CRYPTO_INIT;
+        }
+        catch (RippaSSL::OpenSSLError_CryptoUpdate& cu) {
+            return RIPPASSL_ERR_CRYPTO_UPDATE;
+        }
+        catch (RippaSSL::OpenSSLError_CryptoFinalize& cf) {
+            return RIPPASSL_ERR_CRYPTO_FINALIZE;
+        }
+        catch (RippaSSL::OpenSSLError_Authentication& au) {
+            return RIPPASSL_ERR_AUTHENTICATION;
+        }
+        catch (std::bad_alloc& ba) {
+            return RIPPASSL_ERR_OUT_OF_MEMORY;
+        }
+        catch (...) {
+            return RIPPASSL_ERR_INTERNAL;
+        }
+    }
+
+    // the checks shared by the cipher calls producing output, which shall
+    // have room for inputLen bytes plus the given number of blocks:
+    int checkOutput(const rippassl_cipher* cipher,
+                    const uint8_t*         output,
+                    size_t                 outputCapacity,
+                    const uint8_t*         input,
+                    size_t                 inputLen,
+                    const size_t*          outputLen,
+                    size_t                 blocks)
+    {
+        if ((NULL == cipher) || (NULL == outputLen) ||
+            (inputLen && ((NULL == input) || (NULL == output))))
+        {
+            return RIPPASSL_ERR_NULLPTR;
+        }
+
+        // written so that a huge inputLen can't wrap around:
+        size_t reserved = blocks * RippaSSL::blockSizes.at(cipher->algo);
+        if ((outputCapacity < reserved) ||
+            (outputCapacity - reserved < inputLen))
+        {
+            return RIPPASSL_ERR_BUFFER_TOO_SMALL;
+        }
+
+        return RIPPASSL_OK;
+    }
+}
+
+int rippassl_api_version(void)
+{
+    return RIPPASSL_API_VERSION;
+}
+
+const char* rippassl_status_string(int status)
+{
+    switch (status)
+    {
+        case RIPPASSL_OK:                    return "success";
+        case RIPPASSL_ERR_NULLPTR:           return "null pointer";
+        case RIPPASSL_ERR_KEY_LENGTH:        return "wrong key length";
+        case RIPPASSL_ERR_IV_LENGTH:         return "wrong IV length";
+        case RIPPASSL_ERR_MISALIGNED_DATA:   return "misaligned data";
+        case RIPPASSL_ERR_UNSUPPORTED_MODE:  return "unsupported mode";
+        case RIPPASSL_ERR_CRYPTO_INIT:       return "OpenSSL init failed";
+        case RIPPASSL_ERR_CRYPTO_UPDATE:     return "OpenSSL update failed";
+        case RIPPASSL_ERR_CRYPTO_FINALIZE:   return "OpenSSL finalize failed";
+        case RIPPASSL_ERR_AUTHENTICATION:    return "authentication failed";
+        case RIPPASSL_ERR_BUFFER_TOO_SMALL:  return "output buffer too small";
+        case RIPPASSL_ERR_ENCODING:          return "invalid HEX encoding";
+        case RIPPASSL_ERR_OUT_OF_MEMORY:     return "out of memory";
+        case RIPPASSL_ERR_INTERNAL:          return "internal error";
+        default:                             return "unknown status";
+    }
+}
+
+int rippassl_algo_sizes(int algo, size_t* blockSize, size_t* ivSize)
+{
+    if (!validAlgo(algo))
+        return RIPPASSL_ERR_UNSUPPORTED_MODE;
+
+    RippaSSL::Algo value = static_cast<RippaSSL::Algo>(algo);
+
+    if (NULL != blockSize)
+        *blockSize = RippaSSL::blockSizes.at(value);
+    if (NULL != ivSize)
+        *ivSize = isEcb(value) ? 0 : RippaSSL::ivSizes.at(value);
+
+    return RIPPASSL_OK;
+}
+
+int rippassl_cipher_new(rippassl_cipher** cipher,
+                        int               algo,
+                        int               direction,
+                        const uint8_t*    key,
+                        size_t            keyLen,
+                        const uint8_t*    iv,
+                        size_t            ivLen,
+                        int               padding)
+{
+    if (NULL == cipher)
+        return RIPPASSL_ERR_NULLPTR;
+
+    *cipher = NULL;
+
+    if (!validAlgo(algo) ||
+        ((RIPPASSL_ENCRYPT != direction) && (RIPPASSL_DECRYPT != direction)))
+    {
+        return RIPPASSL_ERR_UNSUPPORTED_MODE;
+    }
+
+    RippaSSL::Algo value = static_cast<RippaSSL::Algo>(algo);
+
+    if (NULL == key)
+        return RIPPASSL_ERR_NULLPTR;
+    if (keyLength(value) != keyLen)
+        return RIPPASSL_ERR_KEY_LENGTH;
+    if (!validIv(value, iv, ivLen))
+        return RIPPASSL_ERR_IV_LENGTH;
+
+    return guarded([&] () {
+        *cipher = new rippassl_cipher {
+            RippaSSL::Cipher {value, modeOf(value, RIPPASSL_DECRYPT == direction),
+                              key, keyLen, ivLen ? iv : nullptr,
+                              0 != padding},
+            value, keyLen};
+    });
+}
+
+void rippassl_cipher_free(rippassl_cipher* cipher)
+{
+    delete cipher;
+}
+
+int rippassl_cipher_update(rippassl_cipher* cipher,
+                           uint8_t*         output,
+                           size_t           outputCapacity,
+                           const uint8_t*   input,
+                           size_t           inputLen,
+                           size_t*          outputLen)
+{
+    int status = checkOutput(cipher, output, outputCapacity, input, inputLen,
+                             outputLen, 1);
+    if (RIPPASSL_OK != status)
+        return status;
+
+    *outputLen = 0;
+
+    return guarded([&] () {
+        *outputLen = cipher->cipher.update(output, input, inputLen);
+    });
+}
+
+int rippassl_cipher_final(rippassl_cipher* cipher,
+                          uint8_t*         output,
+                          size_t           outputCapacity,
+                          const uint8_t*   input,
+                          size_t           inputLen,
+                          size_t*          outputLen)
+{
+    // a partial block held back by update comes out, then the padding:
+    int status = checkOutput(cipher, output, outputCapacity, input, inputLen,
+                             outputLen, 2);
+    if (RIPPASSL_OK != status)
+        return status;
+
+    *outputLen = 0;
+
+    return guarded([&] () {
+        *outputLen = cipher->cipher.finalize(output, input, inputLen);
+    });
+}
+
+int rippassl_cipher_update_aad(rippassl_cipher* cipher,
+                               const uint8_t*   aad,
+                               size_t           aadLen)
+{
+    if ((NULL == cipher) || (aadLen && (NULL == aad)))
+        return RIPPASSL_ERR_NULLPTR;
+
+    return guarded([&] () {
+        cipher->cipher.updateAad(aad, aadLen);
+    });
+}
+
+int rippassl_cipher_final_tag(rippassl_cipher* cipher,
+                              uint8_t*         output,
+                              size_t           outputCapacity,
+                              const uint8_t*   input,
+                              size_t           inputLen,
+                              size_t*          outputLen,
+                              uint8_t*         tag,
+                              size_t           tagLen)
+{
+    int status = checkOutput(cipher, output, outputCapacity, input, inputLen,
+                             outputLen, 1);
+    if (RIPPASSL_OK != status)
+        return status;
+    if (NULL == tag)
+        return RIPPASSL_ERR_NULLPTR;
+
+    *outputLen = 0;
+
+    return guarded([&] () {
+        *outputLen = cipher->cipher.finalizeTag(output, input, inputLen,
+                                                tag, tagLen);
+    });
+}
+
+int rippassl_cipher_final_verify(rippassl_cipher* cipher,
+                                 uint8_t*         output,
+                                 size_t           outputCapacity,
+                                 const uint8_t*   input,
+                                 size_t           inputLen,
+                                 size_t*          outputLen,
+                                 const uint8_t*   tag,
+                                 size_t           tagLen)
+{
+    int status = checkOutput(cipher, output, outputCapacity, input, inputLen,
+                             outputLen, 1);
+    if (RIPPASSL_OK != status)
+        return status;
+    if (NULL == tag)
+        return RIPPASSL_ERR_NULLPTR;
+
+    *outputLen = 0;
+
+    return guarded([&] () {
+        *outputLen = cipher->cipher.finalizeVerify(output, input, inputLen,
+                                                   tag, tagLen);
+    });
+}
+
+int rippassl_cipher_reset(rippassl_cipher* cipher,
+                          const uint8_t*   iv,
+                          size_t           ivLen)
+{
+    if (NULL == cipher)
+        return RIPPASSL_ERR_NULLPTR;
+    if (!validIv(cipher->algo, iv, ivLen))
+        return RIPPASSL_ERR_IV_LENGTH;
+
+    return guarded([&] () {
+        cipher->cipher.reset(ivLen ? iv : nullptr);
+    });
+}
+
+int rippassl_cipher_rekey(rippassl_cipher* cipher,
+                          const uint8_t*   key,
+                          size_t           keyLen,
+                          const uint8_t*   iv,
+                          size_t           ivLen)
+{
+    if ((NULL == cipher) || (NULL == key))
+        return RIPPASSL_ERR_NULLPTR;
+    if (cipher->keyLen != keyLen)
+        return RIPPASSL_ERR_KEY_LENGTH;
+    if (!validIv(cipher->algo, iv, ivLen))
+        return RIPPASSL_ERR_IV_LENGTH;
+
+    return guarded([&] () {
+        cipher->cipher.rekey(key, keyLen, ivLen ? iv : nullptr);
+    });
+}
+
+int rippassl_cmac_new(rippassl_cmac** cmac,
+                      int             algo,
+                      const uint8_t*  key,
+                      size_t          keyLen)
+{
+    if (NULL == cmac)
+        return RIPPASSL_ERR_NULLPTR;
+
+    *cmac = NULL;
+
+    if ((RIPPASSL_AES128CBC != algo) && (RIPPASSL_AES256CBC != algo))
+        return RIPPASSL_ERR_UNSUPPORTED_MODE;
+
+    RippaSSL::Algo value = static_cast<RippaSSL::Algo>(algo);
+
+    if (NULL == key)
+        return RIPPASSL_ERR_NULLPTR;
+    if (keyLength(value) != keyLen)
+        return RIPPASSL_ERR_KEY_LENGTH;
+
+    return guarded([&] () {
+        *cmac = new rippassl_cmac {
+            RippaSSL::Cmac {value, RippaSSL::MacMode::CMAC, key, keyLen,
+                            nullptr},
+            keyLen};
+    });
+}
+
+void rippassl_cmac_free(rippassl_cmac* cmac)
+{
+    delete cmac;
+}
+
+int rippassl_cmac_update(rippassl_cmac* cmac,
+                         const uint8_t* input,
+                         size_t         inputLen)
+{
+    if ((NULL == cmac) || (inputLen && (NULL == input)))
+        return RIPPASSL_ERR_NULLPTR;
+
+    return guarded([&] () {
+        cmac->cmac.update(nullptr, input, inputLen);
+    });
+}
+
+int rippassl_cmac_final(rippassl_cmac* cmac,
+                        const uint8_t* input,
+                        size_t         inputLen,
+                        uint8_t*       mac,
+                        size_t         macCapacity,
+                        size_t*        macLen)
+{
+    if ((NULL == cmac) || (NULL == mac) || (NULL == macLen) ||
+        (inputLen && (NULL == input)))
+    {
+        return RIPPASSL_ERR_NULLPTR;
+    }
+
+    // CMAC tags are one AES block long:
+    if (macCapacity < 16)
+        return RIPPASSL_ERR_BUFFER_TOO_SMALL;
+
+    *macLen = 0;
+
+    return guarded([&] () {
+        *macLen = cmac->cmac.finalize(mac, input, inputLen);
+    });
+}
+
+int rippassl_cmac_reset(rippassl_cmac* cmac)
+{
+    if (NULL == cmac)
+        return RIPPASSL_ERR_NULLPTR;
+
+    return guarded([&] () {
+        cmac->cmac.reset();
+    });
+}
+
+int rippassl_cmac_rekey(rippassl_cmac* cmac,
+                        const uint8_t* key,
+                        size_t         keyLen)
+{
+    if ((NULL == cmac) || (NULL == key))
+        return RIPPASSL_ERR_NULLPTR;
+    if (cmac->keyLen != keyLen)
+        return RIPPASSL_ERR_KEY_LENGTH;
+
+    return guarded([&] () {
+        cmac->cmac.rekey(key, keyLen);
+    });
+}
+
+int rippassl_hex_decode(uint8_t*    output,
+                        size_t      outputCapacity,
+                        const char* hex,
+                        size_t      hexLen,
+                        size_t*     outputLen)
+{
+    if ((NULL == outputLen) || (hexLen && ((NULL == hex) || (NULL == output))))
+        return RIPPASSL_ERR_NULLPTR;
+
+    *outputLen = 0;
+
+    if (hexLen % 2)
+        return RIPPASSL_ERR_ENCODING;
+    if (outputCapacity < hexLen / 2)
+        return RIPPASSL_ERR_BUFFER_TOO_SMALL;
+    if (!hexLen)
+        return RIPPASSL_OK;
+
+    size_t written = BinIO::hexToBinary(output, hex, hexLen);
+    if (!written)
+        return RIPPASSL_ERR_ENCODING;
+
+    *outputLen = written;
+
+    return RIPPASSL_OK;
+}
+
+int rippassl_hex_encode(char*          output,
+                        size_t         outputCapacity,
+                        const uint8_t* input,
+                        size_t         inputLen,
+                        int            upperCase,
+                        size_t*        outputLen)
+{
+    if ((NULL == outputLen) ||
+        (inputLen && ((NULL == input) || (NULL == output))))
+    {
+        return RIPPASSL_ERR_NULLPTR;
+    }
+
+    *outputLen = 0;
+
+    if (outputCapacity / 2 < inputLen)
+        return RIPPASSL_ERR_BUFFER_TOO_SMALL;
+
+    *outputLen = BinIO::binaryToHex(output, input, inputLen, 0 != upperCase);
+
+    return RIPPASSL_OK;
+}
@@ -0,0 +1,194 @@
+#ifndef RIPPASSL_C_H
+#define RIPPASSL_C_H
+
+/*
+C interface of librippassl: RippaSSL's Cipher and Cmac and BinIO's HEX codec
+behind opaque handles. Nothing here throws: every function returning int
+returns RIPPASSL_OK or one of the negative RIPPASSL_ERR_* codes. Output goes
+to caller-provided buffers, whose capacity is always passed along and
+checked. The numeric values of the constants below are part of the ABI and
+never change; new ones only get appended.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RIPPASSL_API __attribute__((visibility("default")))
+
+#define RIPPASSL_API_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* status codes: */
+#define RIPPASSL_OK                     0
+#define RIPPASSL_ERR_NULLPTR           -1
+#define RIPPASSL_ERR_KEY_LENGTH        -2
+#define RIPPASSL_ERR_IV_LENGTH         -3
+#define RIPPASSL_ERR_MISALIGNED_DATA   -4
+#define RIPPASSL_ERR_UNSUPPORTED_MODE  -5
+#define RIPPASSL_ERR_CRYPTO_INIT       -6
+#define RIPPASSL_ERR_CRYPTO_UPDATE     -7
+#define RIPPASSL_ERR_CRYPTO_FINALIZE   -8
+#define RIPPASSL_ERR_AUTHENTICATION    -9
+#define RIPPASSL_ERR_BUFFER_TOO_SMALL  -10
+#define RIPPASSL_ERR_ENCODING          -11
+#define RIPPASSL_ERR_OUT_OF_MEMORY     -12
+#define RIPPASSL_ERR_INTERNAL          -13
+
+/* algorithms, with the values of RippaSSL::Algo: */
+#define RIPPASSL_AES128CBC  0
+#define RIPPASSL_AES128ECB  1
+#define RIPPASSL_AES256CBC  2
+#define RIPPASSL_AES256ECB  3
+#define RIPPASSL_AES128CTR  4
+#define RIPPASSL_AES256CTR  5
+#define RIPPASSL_AES128GCM  6
+#define RIPPASSL_AES256GCM  7
+
+/* directions: */
+#define RIPPASSL_ENCRYPT    0
+#define RIPPASSL_DECRYPT    1
+
+/* the length of the GCM tags: */
+#define RIPPASSL_TAG_SIZE   16
+
+typedef struct rippassl_cipher rippassl_cipher;
+typedef struct rippassl_cmac   rippassl_cmac;
+
+/* Returns RIPPASSL_API_VERSION as built into the library. */
+RIPPASSL_API int rippassl_api_version(void);
+
+/* Returns a static description of a status code. */
+RIPPASSL_API const char* rippassl_status_string(int status);
+
+/*
+Writes the block and IV sizes of algo. Outputs shall have room for the input
+length plus one block, or plus two blocks for rippassl_cipher_final, which
+releases data held back by earlier updates and may add a block of padding.
+*/
+RIPPASSL_API int rippassl_algo_sizes(int     algo,
+                                     size_t* blockSize,
+                                     size_t* ivSize);
+
+/*
+Ciphers. ivLen shall be the IV size of algo, or 0 for ECB; padding is only
+meaningful for CBC and ECB. *cipher is set to NULL on failure.
+*/
+RIPPASSL_API int rippassl_cipher_new(rippassl_cipher** cipher,
+                                     int               algo,
+                                     int               direction,
+                                     const uint8_t*    key,
+                                     size_t            keyLen,
+                                     const uint8_t*    iv,
+                                     size_t            ivLen,
+                                     int               padding);
+
+RIPPASSL_API void rippassl_cipher_free(rippassl_cipher* cipher);
+
+RIPPASSL_API int rippassl_cipher_update(rippassl_cipher* cipher,
+                                        uint8_t*         output,
+                                        size_t           outputCapacity,
+                                        const uint8_t*   input,
+                                        size_t           inputLen,
+                                        size_t*          outputLen);
+
+RIPPASSL_API int rippassl_cipher_final(rippassl_cipher* cipher,
+                                       uint8_t*         output,
+                                       size_t           outputCapacity,
+                                       const uint8_t*   input,
+                                       size_t           inputLen,
+                                       size_t*          outputLen);
+
+/* GCM only: additional data, before any payload. */
+RIPPASSL_API int rippassl_cipher_update_aad(rippassl_cipher* cipher,
+                                            const uint8_t*   aad,
+                                            size_t           aadLen);
+
+/* GCM encryption: finalizes, then writes tagLen bytes of tag. */
+RIPPASSL_API int rippassl_cipher_final_tag(rippassl_cipher* cipher,
+                                           uint8_t*         output,
+                                           size_t           outputCapacity,
+                                           const uint8_t*   input,
+                                           size_t           inputLen,
+                                           size_t*          outputLen,
+                                           uint8_t*         tag,
+                                           size_t           tagLen);
+
+/*
+GCM decryption: finalizes, checking the tag. RIPPASSL_ERR_AUTHENTICATION
+means that the output shall be discarded.
+*/
+RIPPASSL_API int rippassl_cipher_final_verify(rippassl_cipher* cipher,
+                                              uint8_t*         output,
+                                              size_t           outputCapacity,
+                                              const uint8_t*   input,
+                                              size_t           inputLen,
+                                              size_t*          outputLen,
+                                              const uint8_t*   tag,
+                                              size_t           tagLen);
+
+/* Restarts with a new IV, or a new key and IV, keeping the handle. */
+RIPPASSL_API int rippassl_cipher_reset(rippassl_cipher* cipher,
+                                       const uint8_t*   iv,
+                                       size_t           ivLen);
+
+RIPPASSL_API int rippassl_cipher_rekey(rippassl_cipher* cipher,
+                                       const uint8_t*   key,
+                                       size_t           keyLen,
+                                       const uint8_t*   iv,
+                                       size_t           ivLen);
+
+/*
+CMAC over the block cipher of algo (AES128CBC or AES256CBC). The MAC is one
+block long.
+*/
+RIPPASSL_API int rippassl_cmac_new(rippassl_cmac** cmac,
+                                   int             algo,
+                                   const uint8_t*  key,
+                                   size_t          keyLen);
+
+RIPPASSL_API void rippassl_cmac_free(rippassl_cmac* cmac);
+
+RIPPASSL_API int rippassl_cmac_update(rippassl_cmac* cmac,
+                                      const uint8_t* input,
+                                      size_t         inputLen);
+
+RIPPASSL_API int rippassl_cmac_final(rippassl_cmac* cmac,
+                                     const uint8_t* input,
+                                     size_t         inputLen,
+                                     uint8_t*       mac,
+                                     size_t         macCapacity,
+                                     size_t*        macLen);
+
+/* Restarts with the current key, or with a new one. */
+RIPPASSL_API int rippassl_cmac_reset(rippassl_cmac* cmac);
+
+RIPPASSL_API int rippassl_cmac_rekey(rippassl_cmac* cmac,
+                                     const uint8_t* key,
+                                     size_t         keyLen);
+
+/*
+HEX codec. Decoding takes hexLen characters of either case, writing
+hexLen / 2 bytes; encoding writes 2 * binLen characters, without a NUL
+terminator, uppercase unless upperCase is 0.
+*/
+RIPPASSL_API int rippassl_hex_decode(uint8_t*    output,
+                                     size_t      outputCapacity,
+                                     const char* hex,
+                                     size_t      hexLen,
+                                     size_t*     outputLen);
+
+RIPPASSL_API int rippassl_hex_encode(char*          output,
+                                     size_t         outputCapacity,
+                                     const uint8_t* input,
+                                     size_t         inputLen,
+                                     int            upperCase,
+                                     size_t*        outputLen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,530 @@
+#include "server.h"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+    // size of the reads from a connection:
+    constexpr size_t receiveChunkSize = 64 * 1024;
+
+    uint32_t loadBigEndian(const uint8_t* p)
+    {
+        return (uint32_t {p[0]} << 24) | (uint32_t {p[1]} << 16) |
+               (uint32_t {p[2]} << 8)  |  uint32_t {p[3]};
+    }
+
+    void storeBigEndian(uint8_t* p, uint32_t value)
+    {
+        p[0] = static_cast<uint8_t>(value >> 24);
+        p[1] = static_cast<uint8_t>(value >> 16);
+        p[2] = static_cast<uint8_t>(value >> 8);
+        p[3] = static_cast<uint8_t>(value);
+    }
+
+    bool fillAddress(sockaddr_un& address, const char* socketPath)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+
+        if (std::strlen(socketPath) >= sizeof(address.sun_path))
+            return false;
+
+        std::strcpy(address.sun_path, socketPath);
+        return true;
+    }
+
+    /*!
+    Splits a request body into its fields; returns false if the lengths in
+    the header don't fit in the body.
+    */
+    bool decodeRequest(const uint8_t*       body,
+                       size_t               bodyLen,
+                       BinServer::Request&  request)
+    {
+        if (bodyLen < BinServer::requestHeaderSize)
+            return false;
+
+        request.algo    = body[0];
+        request.decrypt = body[1] & 0x01;
+        request.keyLen  = body[2];
+        request.ivLen   = body[3];
+        request.aadLen  = loadBigEndian(body + 4);
+
+        size_t fieldsLen = request.keyLen + request.ivLen + request.aadLen;
+        if (fieldsLen > bodyLen - BinServer::requestHeaderSize)
+            return false;
+
+        request.key        = body + BinServer::requestHeaderSize;
+        request.iv         = request.key + request.keyLen;
+        request.aad        = request.iv + request.ivLen;
+        request.payload    = request.aad + request.aadLen;
+        request.payloadLen = bodyLen - BinServer::requestHeaderSize -
+                             fieldsLen;
+
+        return true;
+    }
+
+    bool writeAll(int fd, const uint8_t* data, size_t len)
+    {
+        while (len)
+        {
+            ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+
+            if ((sent < 0) && (EINTR == errno))
+                continue;
+            if (sent <= 0)
+                return false;
+
+            data += sent;
+            len  -= sent;
+        }
+
+        return true;
+    }
+
+    bool readAll(int fd, uint8_t* data, size_t len)
+    {
+        while (len)
+        {
+            ssize_t got = recv(fd, data, len, 0);
+
+            if ((got < 0) && (EINTR == errno))
+                continue;
+            if (got <= 0)
+                return false;
+
+            data += got;
+            len  -= got;
+        }
+
+        return true;
+    }
+}
+
+/*!
+The state of a client: bytes received but not yet served, and responses
+not yet sent.
+*/
+struct BinServer::Server::Connection {
+    int                  fd;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    size_t               outputSent;
+    // the epoll events currently watched:
+    uint32_t             watched;
+};
+
+BinServer::Server::Server(const char* socketPath, Handler requestHandler)
+: path {socketPath, socketPath + std::strlen(socketPath) + 1},
+  handler {std::move(requestHandler)},
+  listenFd {-1}, epollFd {-1}, stopFd {-1}, listening {true}
+{
+    sockaddr_un address;
+    struct stat existing;
+    epoll_event event {};
+
+    // a socket file left behind by a previous run would make bind() fail,
+    // but one that still accepts connections belongs to a live server:
+    if ((0 == lstat(socketPath, &existing)) && S_ISSOCK(existing.st_mode))
+    {
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool stale = (probe >= 0) && fillAddress(address, socketPath) &&
+                     (0 > connect(probe,
+                                  reinterpret_cast<sockaddr*>(&address),
+                                  sizeof(address))) &&
+                     (ECONNREFUSED == errno);
+
+        if (probe >= 0)
+            ::close(probe);
+
+        if (!stale)
+            throw ServerError_Setup {};
+
+        unlink(socketPath);
+    }
+
+    if (!fillAddress(address, socketPath)                                ||
+        (0 > (listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK |
+                                         SOCK_CLOEXEC, 0)))               ||
+        (0 > bind(listenFd, reinterpret_cast<sockaddr*>(&address),
+                  sizeof(address)))                                       ||
+        (0 > listen(listenFd, SOMAXCONN))                                 ||
+        (0 > (epollFd = epoll_create1(EPOLL_CLOEXEC)))                    ||
+        (0 > (stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))))
+    {
+        release();
+        throw ServerError_Setup {};
+    }
+
+    event.events  = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+    event.data.fd = stopFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event);
+}
+
+void BinServer::Server::run()
+{
+    epoll_event events[64];
+
+    for (;;)
+    {
+        int ready = epoll_wait(epollFd, events, 64, -1);
+
+        if ((ready < 0) && (EINTR == errno))
+            continue;
+        if (ready < 0)
+            return;
+
+        for (int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+
+            if (fd == stopFd)
+            {
+                uint64_t count;
+                ssize_t drained = read(stopFd, &count, sizeof(count));
+                (void) drained;
+                return;
+            }
+
+            if (fd == listenFd)
+            {
+                accept();
+                continue;
+            }
+
+            auto found = std::find_if(connections.begin(), connections.end(),
+                                      [fd] (const Connection* c) {
+                                          return c->fd == fd;
+                                      });
+            if (connections.end() == found)
+                continue;
+
+            Connection& connection = **found;
+            bool alive = true;
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                alive = receive(connection);
+            if (alive && (events[i].events & EPOLLOUT))
+                alive = flush(connection);
+
+            if (!alive)
+                close(fd);
+        }
+    }
+}
+
+void BinServer::Server::stop()
+{
+    uint64_t one = 1;
+    ssize_t written = write(stopFd, &one, sizeof(one));
+    (void) written;
+}
+
+/*!
+Accepts every pending connection. When out of descriptors (or memory), the
+listening socket stays readable, so it's left out of the event loop until a
+connection closes, rather than waking it up over and over.
+*/
+void BinServer::Server::accept()
+{
+    int fd;
+
+    while (0 <= (fd = accept4(listenFd, NULL, NULL,
+                              SOCK_NONBLOCK | SOCK_CLOEXEC)))
+    {
+        epoll_event event {};
+        event.events  = EPOLLIN;
+        event.data.fd = fd;
+
+        if (0 > epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event))
+        {
+            ::close(fd);
+            continue;
+        }
+
+        connections.push_back(new Connection {fd, {}, {}, 0, EPOLLIN});
+    }
+
+    if ((EMFILE == errno) || (ENFILE == errno) ||
+        (ENOBUFS == errno) || (ENOMEM == errno))
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, NULL);
+        listening = false;
+    }
+}
+
+bool BinServer::Server::receive(Connection& connection)
+{
+    size_t previousLen = connection.input.size();
+    connection.input.resize(previousLen + receiveChunkSize);
+
+    ssize_t got = recv(connection.fd, connection.input.data() + previousLen,
+                       receiveChunkSize, 0);
+
+    if (got <= 0)
+    {
+        connection.input.resize(previousLen);
+        return (got < 0) && ((EAGAIN == errno) || (EINTR == errno));
+    }
+
+    connection.input.resize(previousLen + got);
+
+    return flush(connection);
+}
+
+/*!
+Serves the complete frames received, while the responses waiting to be sent
+stay within maxPendingOutput. Returns 1 if it stopped at that limit, 0 if it
+ran out of frames, -1 if the stream can't be framed.
+*/
+int BinServer::Server::serve(Connection& connection)
+{
+    size_t consumed = 0;
+    int outcome = 0;
+    std::vector<uint8_t> result;
+
+    // the responses already sent go once they're the larger part, so that
+    // output doesn't keep growing with them:
+    if (connection.outputSent > connection.output.size() / 2)
+    {
+        connection.output.erase(connection.output.begin(),
+                                connection.output.begin() +
+                                connection.outputSent);
+        connection.outputSent = 0;
+    }
+
+    while (connection.input.size() - consumed >= 4)
+    {
+        const uint8_t* frame = connection.input.data() + consumed;
+        size_t bodyLen = loadBigEndian(frame);
+
+        // a stream that can't be framed can't be resynchronized:
+        if (bodyLen > maxFrameSize)
+            return -1;
+        if (connection.input.size() - consumed - 4 < bodyLen)
+            break;
+        if (connection.output.size() - connection.outputSent >
+            maxPendingOutput)
+        {
+            outcome = 1;
+            break;
+        }
+
+        Request request;
+        Status status = Status::Malformed;
+
+        result.clear();
+        if (decodeRequest(frame + 4, bodyLen, request))
+            status = handler(request, result);
+        if (Status::Ok != status)
+            result.clear();
+
+        uint8_t header[5];
+        storeBigEndian(header, static_cast<uint32_t>(result.size() + 1));
+        header[4] = static_cast<uint8_t>(status);
+        connection.output.insert(connection.output.end(), header, header + 5);
+        connection.output.insert(connection.output.end(),
+                                 result.begin(), result.end());
+
+        consumed += 4 + bodyLen;
+    }
+
+    connection.input.erase(connection.input.begin(),
+                           connection.input.begin() + consumed);
+
+    return outcome;
+}
+
+/*!
+Serves what's been received and sends the responses, until either the socket
+or the frames run out. The connection is read from only while its pending
+responses are within maxPendingOutput, and watched for writability only
+while there are some.
+*/
+bool BinServer::Server::flush(Connection& connection)
+{
+    int served;
+    bool blocked = false;
+
+    do {
+        if (0 > (served = serve(connection)))
+            return false;
+
+        while (connection.outputSent < connection.output.size())
+        {
+            ssize_t sent = send(connection.fd,
+                                connection.output.data() +
+                                connection.outputSent,
+                                connection.output.size() -
+                                connection.outputSent,
+                                MSG_NOSIGNAL);
+
+            if ((sent < 0) && (EINTR == errno))
+                continue;
+            if ((sent < 0) && (EAGAIN == errno))
+            {
+                blocked = true;
+                break;
+            }
+            if (sent <= 0)
+                return false;
+
+            connection.outputSent += sent;
+        }
+    } while ((1 == served) && !blocked);
+
+    size_t pendingLen = connection.output.size() - connection.outputSent;
+
+    if (!pendingLen)
+    {
+        connection.output.clear();
+        connection.outputSent = 0;
+    }
+
+    uint32_t events = ((pendingLen <= maxPendingOutput) ? EPOLLIN : 0) |
+                      (pendingLen ? EPOLLOUT : 0);
+
+    if (events != connection.watched)
+    {
+        epoll_event event {};
+        event.events  = events;
+        event.data.fd = connection.fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.watched = events;
+    }
+
+    return true;
+}
+
+void BinServer::Server::close(int fd)
+{
+    auto found = std::find_if(connections.begin(), connections.end(),
+                              [fd] (const Connection* c) {
+                                  return c->fd == fd;
+                              });
+
+    if (connections.end() != found)
+    {
+        delete *found;
+        connections.erase(found);
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    ::close(fd);
+
+    // a descriptor is free again, for the connections waiting:
+    if (!listening && (listenFd >= 0))
+    {
+        epoll_event event {};
+        event.events  = EPOLLIN;
+        event.data.fd = listenFd;
+        listening = (0 == epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd,
+                                    &event));
+    }
+}
+
+BinServer::Server::~Server()
+{
+    release();
+}
+
+void BinServer::Server::release()
+{
+    while (!connections.empty())
+        close(connections.back()->fd);
+
+    if (listenFd >= 0)
+    {
+        ::close(listenFd);
+        unlink(path.data());
+    }
+    if (epollFd >= 0)
+        ::close(epollFd);
+    if (stopFd >= 0)
+        ::close(stopFd);
+
+    listenFd = epollFd = stopFd = -1;
+}
+
+int BinServer::connectSocket(const char* socketPath)
+{
+    sockaddr_un address;
+    int fd;
+
+    if (!fillAddress(address, socketPath) ||
+        (0 > (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0))))
+    {
+        return -1;
+    }
+
+    if (0 > connect(fd, reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)))
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+BinServer::Status BinServer::call(int                   fd,
+                                  const Request&        request,
+                                  std::vector<uint8_t>& result)
+{
+    size_t bodyLen = requestHeaderSize + request.keyLen + request.ivLen +
+                     request.aadLen + request.payloadLen;
+    std::vector<uint8_t> frame (4 + requestHeaderSize);
+    uint8_t header[4];
+
+    if ((bodyLen > maxFrameSize) || (request.keyLen > 0xFF) ||
+        (request.ivLen > 0xFF))
+    {
+        return Status::Malformed;
+    }
+
+    storeBigEndian(frame.data(), static_cast<uint32_t>(bodyLen));
+    frame[4] = request.algo;
+    frame[5] = request.decrypt ? 0x01 : 0x00;
+    frame[6] = static_cast<uint8_t>(request.keyLen);
+    frame[7] = static_cast<uint8_t>(request.ivLen);
+    storeBigEndian(frame.data() + 8, static_cast<uint32_t>(request.aadLen));
+    frame.insert(frame.end(), request.key, request.key + request.keyLen);
+    frame.insert(frame.end(), request.iv, request.iv + request.ivLen);
+    frame.insert(frame.end(), request.aad, request.aad + request.aadLen);
+    frame.insert(frame.end(), request.payload,
+                 request.payload + request.payloadLen);
+
+    if (!writeAll(fd, frame.data(), frame.size()) ||
+        !readAll(fd, header, sizeof(header)))
+    {
+        return Status::Malformed;
+    }
+
+    size_t responseLen = loadBigEndian(header);
+    if (!responseLen || (responseLen > maxFrameSize + 1))
+        return Status::Malformed;
+
+    result.resize(responseLen);
+    if (!readAll(fd, result.data(), responseLen))
+        return Status::Malformed;
+
+    Status status = static_cast<Status>(result[0]);
+    result.erase(result.begin());
+
+    return status;
+}
@@ -0,0 +1,139 @@
+#ifndef BINSERVER_H
+#define BINSERVER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+namespace BinServer
+{
+    /*!
+    Wire format, all integers big-endian. Every message is a frame: a 4 bytes
+    body length, then the body. A request body is:
+        [0]    algorithm, as the value of RippaSSL::Algo
+        [1]    flags: bit 0 set for decryption
+        [2]    key length
+        [3]    IV length (0 for none)
+        [4..7] AAD length (GCM only)
+        then the key, the IV, the AAD and the payload, which takes the rest.
+    A response body is a Status byte, followed by the result when it's Ok.
+    As with binenc, GCM results carry the tag after the ciphertext, and GCM
+    payloads to decrypt shall carry it there.
+    */
+    constexpr size_t requestHeaderSize = 8;
+
+    // frames larger than this end the connection:
+    constexpr size_t maxFrameSize = 64 * 1024 * 1024;
+
+    // a connection isn't read from while more than this many bytes of its
+    // responses wait to be sent, so a client that doesn't read its responses
+    // only stalls itself:
+    constexpr size_t maxPendingOutput = maxFrameSize;
+
+    enum class Status : uint8_t
+    {
+        Ok             = 0,
+        Malformed      = 1,
+        Mode           = 2,
+        Key            = 3,
+        Iv             = 4,
+        Crypto         = 5,
+        Authentication = 6
+    };
+
+    /*!
+    A decoded request: the pointers refer to the connection's buffer, and
+    are valid for the duration of the handler call only.
+    */
+    struct Request {
+        uint8_t        algo;
+        bool           decrypt;
+        const uint8_t* key;
+        size_t         keyLen;
+        const uint8_t* iv;
+        size_t         ivLen;
+        const uint8_t* aad;
+        size_t         aadLen;
+        const uint8_t* payload;
+        size_t         payloadLen;
+    };
+
+    /*!
+    Serves a request, placing the result in "result" when it returns Ok.
+    */
+    typedef std::function<Status(const Request&, std::vector<uint8_t>&)>
+        Handler;
+
+    /*!
+    Answers requests on a Unix domain socket from a single-threaded, epoll
+    driven event loop: any number of clients may stay connected, each one
+    sending requests back to back and getting the responses in order.
+    Everything the handler keeps (handles, contexts) stays warm across
+    requests and connections.
+    */
+    class Server {
+        public:
+            /*!
+            Binds and listens on socketPath, replacing a stale socket file,
+            i.e. one nobody listens on anymore. Throws ServerError_Setup on
+            failure, and if another server is live on socketPath.
+            */
+            Server(const char* socketPath, Handler requestHandler);
+
+            /*!
+            Runs the event loop until stop() is called.
+            */
+            void run();
+
+            /*!
+            Makes run() return. Async-signal-safe, so it may be called from
+            a signal handler, as well as from any thread.
+            */
+            void stop();
+
+            /*!
+            Closes every connection and removes the socket file.
+            */
+            ~Server();
+
+            Server(const Server&)             = delete;
+            Server& operator= (const Server&) = delete;
+
+        private:
+            struct Connection;
+
+            void accept();
+            bool receive(Connection& connection);
+            int serve(Connection& connection);
+            bool flush(Connection& connection);
+            void close(int fd);
+            void release();
+
+            std::vector<char> path;
+            Handler           handler;
+            int               listenFd;
+            int               epollFd;
+            int               stopFd;
+            // false while out of descriptors, see accept():
+            bool              listening;
+            std::vector<Connection*> connections;
+    };
+
+    /*!
+    Client side: connects to socketPath, returning the descriptor, or -1.
+    */
+    int connectSocket(const char* socketPath);
+
+    /*!
+    Sends a request on fd and waits for its response. Returns the status,
+    and the result in "result" when it's Ok; Malformed also stands for I/O
+    errors.
+    */
+    Status call(int fd, const Request& request, std::vector<uint8_t>& result);
+
+    // exception types:
+    struct ServerError_Setup {};
+}
+
+#endif
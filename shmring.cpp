@@ -0,0 +1,562 @@
+#include "shmring.h"
+
+#include <atomic>
+#include <vector>
+#include <new>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    // identifies a request ring segment ("BINENCR1"):
+    constexpr uint64_t segmentMagic = 0x42494E454E435231ull;
+
+    constexpr size_t cacheLineSize = 64;
+
+    // polls of a ring or a slot before going to sleep on its futex:
+    constexpr int spinCount = 64;
+
+    static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+                  "the segment needs address-free atomics");
+
+    size_t roundUp(size_t value, size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    void futexWait(std::atomic<uint32_t>& word, uint32_t expected)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT,
+                expected, NULL, NULL, 0);
+    }
+
+    // a single read of memory another process may be writing, which the
+    // compiler can't repeat later:
+    template<typename T> T readOnce(const T& shared)
+    {
+        return *static_cast<const volatile T*>(&shared);
+    }
+
+    void futexWake(std::atomic<uint32_t>& word, int count)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE,
+                count, NULL, NULL, 0);
+    }
+
+    /*!
+    Lets threads of any process sleep until a condition they poll may have
+    changed: a waiter calls prepare(), polls once more, then wait() and
+    finish(); notify() only enters the kernel when somebody sleeps.
+    */
+    struct EventCount {
+        std::atomic<uint32_t> epoch;
+        std::atomic<uint32_t> sleepers;
+
+        uint32_t prepare()
+        {
+            sleepers.fetch_add(1);
+            return epoch.load();
+        }
+
+        void wait(uint32_t seen)
+        {
+            futexWait(epoch, seen);
+        }
+
+        void finish()
+        {
+            sleepers.fetch_sub(1);
+        }
+
+        void notify()
+        {
+            epoch.fetch_add(1);
+            if (sleepers.load())
+                futexWake(epoch, INT_MAX);
+        }
+    };
+
+    /*!
+    A bounded multi-producer multi-consumer queue of slot indices, after
+    Dmitry Vyukov's: each cell's sequence number tells whether it's ready to
+    be written or read at a given position, so producers and consumers only
+    contend on their own position counter.
+    */
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        uint32_t              value;
+    };
+
+    struct RingHeader {
+        alignas(cacheLineSize) std::atomic<uint64_t> enqueuePos;
+        alignas(cacheLineSize) std::atomic<uint64_t> dequeuePos;
+    };
+
+    void push(RingHeader& ring, Cell* cells, uint64_t mask, uint32_t value)
+    {
+        uint64_t pos = ring.enqueuePos.load(std::memory_order_relaxed);
+
+        // there are as many cells as slot indices, so it never fills up:
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+            if (sequence == pos)
+            {
+                if (ring.enqueuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return;
+                }
+            }
+            else
+            {
+                pos = ring.enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(RingHeader& ring, Cell* cells, uint64_t mask, uint32_t& value)
+    {
+        uint64_t pos = ring.dequeuePos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+            int64_t  distance = static_cast<int64_t>(sequence - (pos + 1));
+
+            if (!distance)
+            {
+                if (ring.dequeuePos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1,
+                                        std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (distance < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = ring.dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // the life of a slot once taken: a client that goes to sleep turns
+    // Submitted into Waiting, so the worker knows it has to wake it up.
+    enum SlotState : uint32_t
+    {
+        Taken     = 0,
+        Submitted = 1,
+        Waiting   = 2,
+        Done      = 3
+    };
+
+    struct alignas(cacheLineSize) SlotHeader {
+        std::atomic<uint32_t> state;
+        uint8_t               algo;
+        uint8_t               decrypt;
+        uint8_t               keyLen;
+        uint8_t               ivLen;
+        uint8_t               status;
+        uint64_t              aadLen;
+        uint64_t              payloadLen;
+        uint64_t              resultLen;
+        uint8_t               key[ShmRing::maxKeyLength];
+        uint8_t               iv[ShmRing::maxIvLength];
+    };
+}
+
+/*!
+The head of the segment, followed by the cells of the free and request
+rings, the slot headers and the slot data areas, at the offsets it records.
+*/
+struct ShmRing::Segment {
+    uint64_t magic;
+    uint64_t totalSize;
+    uint64_t slotCount;
+    uint64_t slotSize;
+    uint64_t freeCellsOffset;
+    uint64_t requestCellsOffset;
+    uint64_t slotsOffset;
+    uint64_t dataOffset;
+
+    alignas(cacheLineSize) EventCount doorbell;
+    EventCount                        slotFreed;
+    std::atomic<uint32_t>             stopping;
+
+    RingHeader freeRing;
+    RingHeader requestRing;
+
+    uint64_t mask() const
+    {
+        return slotCount - 1;
+    }
+
+    Cell* freeCells()
+    {
+        return reinterpret_cast<Cell*>(bytes() + freeCellsOffset);
+    }
+
+    Cell* requestCells()
+    {
+        return reinterpret_cast<Cell*>(bytes() + requestCellsOffset);
+    }
+
+    SlotHeader& slot(uint32_t index)
+    {
+        return reinterpret_cast<SlotHeader*>(bytes() + slotsOffset)[index];
+    }
+
+    uint8_t* data(uint32_t index)
+    {
+        return bytes() + dataOffset + index * slotSize;
+    }
+
+    uint8_t* bytes()
+    {
+        return reinterpret_cast<uint8_t*>(this);
+    }
+};
+
+ShmRing::Worker::Worker(const char* name, uint32_t slotCount, size_t slotSize)
+: segmentName {name, name + std::strlen(name) + 1},
+  segment {nullptr}, mappedSize {0}, slotCount {slotCount},
+  slotSize {roundUp(slotSize, cacheLineSize)}, requestCells {nullptr},
+  slotHeaders {nullptr}, slotData {nullptr}
+{
+    if (!slotCount || (slotCount > maxSlotCount) ||
+        (slotCount & (slotCount - 1)) || !slotSize || (slotSize > maxSlotSize))
+    {
+        throw ShmError_Setup {};
+    }
+
+    // lays the segment out, every part on its own cache lines:
+    Segment layout {};
+    layout.slotCount          = slotCount;
+    layout.slotSize           = roundUp(slotSize, cacheLineSize);
+    layout.freeCellsOffset    = roundUp(sizeof(Segment), cacheLineSize);
+    layout.requestCellsOffset = layout.freeCellsOffset +
+                                roundUp(slotCount * sizeof(Cell),
+                                        cacheLineSize);
+    layout.slotsOffset        = layout.requestCellsOffset +
+                                roundUp(slotCount * sizeof(Cell),
+                                        cacheLineSize);
+    layout.dataOffset         = layout.slotsOffset +
+                                slotCount * sizeof(SlotHeader);
+    layout.totalSize          = layout.dataOffset +
+                                slotCount * layout.slotSize;
+
+    // a segment left behind by a previous run is replaced:
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+        throw ShmError_Setup {};
+
+    void* mapped = MAP_FAILED;
+    if (0 == ftruncate(fd, layout.totalSize))
+    {
+        mapped = mmap(NULL, layout.totalSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (MAP_FAILED == mapped)
+    {
+        shm_unlink(name);
+        throw ShmError_Setup {};
+    }
+
+    mappedSize = layout.totalSize;
+    segment    = new (mapped) Segment {};
+
+    segment->totalSize          = layout.totalSize;
+    segment->slotCount          = layout.slotCount;
+    segment->slotSize           = layout.slotSize;
+    segment->freeCellsOffset    = layout.freeCellsOffset;
+    segment->requestCellsOffset = layout.requestCellsOffset;
+    segment->slotsOffset        = layout.slotsOffset;
+    segment->dataOffset         = layout.dataOffset;
+
+    requestCells = segment->bytes() + layout.requestCellsOffset;
+    slotHeaders  = segment->bytes() + layout.slotsOffset;
+    slotData     = segment->bytes() + layout.dataOffset;
+
+    // every slot starts in the free ring, the request ring starts empty:
+    for (uint32_t i = 0; i < slotCount; ++i)
+    {
+        new (&segment->freeCells()[i]) Cell {{i + 1ull}, i};
+        new (&segment->requestCells()[i]) Cell {{i}, 0};
+        new (&segment->slot(i)) SlotHeader {};
+    }
+    segment->freeRing.enqueuePos.store(slotCount);
+
+    // clients check the magic number last:
+    std::atomic_thread_fence(std::memory_order_release);
+    segment->magic = segmentMagic;
+}
+
+void ShmRing::Worker::run(const Handler& handler)
+{
+    Cell* cells = reinterpret_cast<Cell*>(requestCells);
+    const uint64_t mask = slotCount - 1;
+
+    for (;;)
+    {
+        uint32_t index;
+        bool popped = false;
+
+        for (int spin = 0; !popped && (spin < spinCount); ++spin)
+        {
+            popped = pop(segment->requestRing, cells, mask, index);
+        }
+
+        if (!popped)
+        {
+            if (segment->stopping.load())
+                return;
+
+            uint32_t seen = segment->doorbell.prepare();
+            popped = pop(segment->requestRing, cells, mask, index);
+            if (!popped && !segment->stopping.load())
+                segment->doorbell.wait(seen);
+            segment->doorbell.finish();
+
+            if (!popped)
+                continue;
+        }
+
+        // the client may not be trusted with the slot index, nor with
+        // anything in the slot: the request is copied out once, and only
+        // the copy is checked and used, as the slot may change meanwhile.
+        if (index >= slotCount)
+            continue;
+
+        SlotHeader& slot = reinterpret_cast<SlotHeader*>(slotHeaders)[index];
+        uint8_t* data = slotData + index * slotSize;
+        BinServer::Status status = BinServer::Status::Malformed;
+        size_t resultLen = 0;
+
+        const uint8_t  algo       = readOnce(slot.algo);
+        const bool     decrypt    = 0 != readOnce(slot.decrypt);
+        const size_t   keyLen     = readOnce(slot.keyLen);
+        const size_t   ivLen      = readOnce(slot.ivLen);
+        const uint64_t aadLen     = readOnce(slot.aadLen);
+        const uint64_t payloadLen = readOnce(slot.payloadLen);
+        uint8_t key[maxKeyLength];
+        uint8_t iv[maxIvLength];
+
+        if ((keyLen <= maxKeyLength) && (ivLen <= maxIvLength) &&
+            (aadLen <= slotSize) && (payloadLen <= slotSize - aadLen))
+        {
+            std::memcpy(key, slot.key, keyLen);
+            std::memcpy(iv, slot.iv, ivLen);
+
+            BinServer::Request request {algo, decrypt, key, keyLen,
+                                        iv, ivLen, data, aadLen,
+                                        data + aadLen, payloadLen};
+            size_t capacity = slotSize - aadLen;
+
+            try {
+                status = handler(request, data + aadLen, capacity,
+                                 resultLen);
+            } catch (...) {
+                status = BinServer::Status::Crypto;
+            }
+
+            if ((BinServer::Status::Ok == status) && (resultLen > capacity))
+                status = BinServer::Status::Malformed;
+        }
+
+        slot.status    = static_cast<uint8_t>(status);
+        slot.resultLen = (BinServer::Status::Ok == status) ? resultLen : 0;
+
+        if (Waiting == slot.state.exchange(Done, std::memory_order_acq_rel))
+            futexWake(slot.state, 1);
+    }
+}
+
+void ShmRing::Worker::stop()
+{
+    segment->stopping.store(1);
+    segment->doorbell.notify();
+}
+
+ShmRing::Worker::~Worker()
+{
+    munmap(segment, mappedSize);
+    shm_unlink(segmentName.data());
+}
+
+ShmRing::Client::Client(const char* name)
+: segment {nullptr}, mappedSize {0}
+{
+    struct stat status;
+    int fd = shm_open(name, O_RDWR, 0);
+
+    if (fd < 0)
+        throw ShmError_Setup {};
+
+    void* mapped = MAP_FAILED;
+    if ((0 == fstat(fd, &status)) &&
+        (static_cast<size_t>(status.st_size) >= sizeof(Segment)))
+    {
+        mappedSize = status.st_size;
+        mapped = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    }
+    close(fd);
+
+    if (MAP_FAILED == mapped)
+        throw ShmError_Setup {};
+
+    segment = static_cast<Segment*>(mapped);
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if ((segmentMagic != segment->magic) ||
+        (mappedSize != segment->totalSize))
+    {
+        munmap(segment, mappedSize);
+        throw ShmError_Setup {};
+    }
+}
+
+size_t ShmRing::Client::slotSize() const
+{
+    return segment->slotSize;
+}
+
+uint8_t* ShmRing::Client::acquire(uint32_t& slot)
+{
+    // all the slots may be in flight, in which case the next release wakes
+    // the waiters up:
+    while (!pop(segment->freeRing, segment->freeCells(), segment->mask(),
+                slot))
+    {
+        uint32_t seen = segment->slotFreed.prepare();
+        bool popped = pop(segment->freeRing, segment->freeCells(),
+                          segment->mask(), slot);
+        if (!popped)
+            segment->slotFreed.wait(seen);
+        segment->slotFreed.finish();
+
+        if (popped)
+            break;
+    }
+
+    segment->slot(slot).state.store(Taken, std::memory_order_relaxed);
+
+    return segment->data(slot);
+}
+
+BinServer::Status ShmRing::Client::process(uint32_t   slot,
+                                           const Job& job,
+                                           size_t&    resultLen)
+{
+    SlotHeader& header = segment->slot(slot);
+
+    if ((job.keyLen > maxKeyLength) || (job.ivLen > maxIvLength) ||
+        (job.aadLen > segment->slotSize) ||
+        (job.payloadLen > segment->slotSize - job.aadLen))
+    {
+        return BinServer::Status::Malformed;
+    }
+
+    header.algo       = job.algo;
+    header.decrypt    = job.decrypt ? 1 : 0;
+    header.keyLen     = static_cast<uint8_t>(job.keyLen);
+    header.ivLen      = static_cast<uint8_t>(job.ivLen);
+    header.aadLen     = job.aadLen;
+    header.payloadLen = job.payloadLen;
+    std::memcpy(header.key, job.key, job.keyLen);
+    if (job.ivLen)
+        std::memcpy(header.iv, job.iv, job.ivLen);
+    header.state.store(Submitted, std::memory_order_relaxed);
+
+    // the ring's release store publishes the slot to the worker:
+    push(segment->requestRing, segment->requestCells(), segment->mask(),
+         slot);
+    segment->doorbell.notify();
+
+    uint32_t state = Submitted;
+    for (int spin = 0; (Done != state) && (spin < spinCount); ++spin)
+        state = header.state.load(std::memory_order_acquire);
+
+    if ((Done != state) &&
+        header.state.compare_exchange_strong(state, Waiting,
+                                             std::memory_order_acq_rel))
+    {
+        while (Waiting == (state = header.state.load(
+                               std::memory_order_acquire)))
+        {
+            futexWait(header.state, Waiting);
+        }
+    }
+
+    resultLen = header.resultLen;
+
+    return static_cast<BinServer::Status>(header.status);
+}
+
+void ShmRing::Client::release(uint32_t slot)
+{
+    push(segment->freeRing, segment->freeCells(), segment->mask(), slot);
+    segment->slotFreed.notify();
+}
+
+BinServer::Status ShmRing::Client::call(const BinServer::Request& request,
+                                        std::vector<uint8_t>&     result)
+{
+    if ((request.aadLen > segment->slotSize) ||
+        (request.payloadLen > segment->slotSize - request.aadLen))
+    {
+        return BinServer::Status::Malformed;
+    }
+
+    uint32_t slot;
+    uint8_t* data = acquire(slot);
+    size_t resultLen = 0;
+
+    if (request.aadLen)
+        std::memcpy(data, request.aad, request.aadLen);
+    if (request.payloadLen)
+        std::memcpy(data + request.aadLen, request.payload,
+                    request.payloadLen);
+
+    Job job {request.algo, request.decrypt, request.key, request.keyLen,
+             request.iv, request.ivLen, request.aadLen, request.payloadLen};
+    BinServer::Status status = process(slot, job, resultLen);
+
+    if (BinServer::Status::Ok == status)
+        result.assign(data + request.aadLen,
+                      data + request.aadLen + resultLen);
+    else
+        result.clear();
+
+    release(slot);
+
+    return status;
+}
+
+ShmRing::Client::~Client()
+{
+    munmap(segment, mappedSize);
+}
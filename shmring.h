@@ -0,0 +1,168 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include "server.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+namespace ShmRing
+{
+    /*!
+    A POSIX shared memory segment through which co-located clients hand
+    messages to a worker process without copying them: each request lives in
+    a slot whose data area the client fills in place, and the worker ciphers
+    it there too. Free slots and submitted requests travel through two
+    bounded, lock-free, multi-producer multi-consumer rings of slot indices;
+    a futex lets the worker sleep while there's nothing to do, and another
+    one per slot lets a client sleep until its request is served.
+    A slot's data area holds the AAD first and the payload right after it;
+    the result replaces the payload, starting at the same offset.
+    A client that dies while holding a slot leaks it until the worker
+    restarts.
+    */
+
+    // the most slots, and the largest slot data area, a segment may have:
+    constexpr uint32_t maxSlotCount = 4096;
+    constexpr size_t   maxSlotSize  = 256 * 1024 * 1024;
+
+    // the key and IV room of a slot:
+    constexpr size_t maxKeyLength = 32;
+    constexpr size_t maxIvLength  = 16;
+
+    /*!
+    The description of a request whose AAD and payload are in place in its
+    slot's data area.
+    */
+    struct Job {
+        uint8_t        algo;
+        bool           decrypt;
+        const uint8_t* key;
+        size_t         keyLen;
+        const uint8_t* iv;
+        size_t         ivLen;
+        size_t         aadLen;
+        size_t         payloadLen;
+    };
+
+    /*!
+    Serves a request in place: "output" is request.payload, made writable,
+    and has room for "capacity" bytes. The result length goes to resultLen
+    when it returns Ok.
+    */
+    typedef std::function<BinServer::Status(const BinServer::Request& request,
+                                            uint8_t*                  output,
+                                            size_t                    capacity,
+                                            size_t&                   resultLen)>
+        Handler;
+
+    struct Segment;
+
+    /*!
+    The worker side: creates the segment "name" (as for shm_open, e.g.
+    "/binenc"), replacing a stale one, and serves its requests.
+    */
+    class Worker {
+        public:
+            /*!
+            slotCount shall be a power of two up to maxSlotCount, and
+            slotSize is the size of each slot's data area. Throws
+            ShmError_Setup on failure.
+            */
+            Worker(const char* name, uint32_t slotCount, size_t slotSize);
+
+            /*!
+            Serves the requests as they arrive, until stop() is called.
+            */
+            void run(const Handler& handler);
+
+            /*!
+            Makes run() return. Async-signal-safe, so it may be called from
+            a signal handler, as well as from any thread.
+            */
+            void stop();
+
+            /*!
+            Unmaps and removes the segment.
+            */
+            ~Worker();
+
+            Worker(const Worker&)             = delete;
+            Worker& operator= (const Worker&) = delete;
+
+        private:
+            std::vector<char> segmentName;
+            Segment*          segment;
+            size_t            mappedSize;
+
+            // the worker's own copy of the layout, as clients may overwrite
+            // anything in the segment:
+            uint64_t          slotCount;
+            uint64_t          slotSize;
+            uint8_t*          requestCells;
+            uint8_t*          slotHeaders;
+            uint8_t*          slotData;
+    };
+
+    /*!
+    The client side: maps the segment a worker created. Any number of
+    clients, and of threads within a client, may share a segment.
+    */
+    class Client {
+        public:
+            /*!
+            Throws ShmError_Setup if the segment doesn't exist or isn't a
+            request ring.
+            */
+            explicit Client(const char* name);
+
+            /*!
+            The size of the data area of each slot.
+            */
+            size_t slotSize() const;
+
+            /*!
+            Takes a free slot, waiting for one if they are all in use, and
+            returns its data area.
+            */
+            uint8_t* acquire(uint32_t& slot);
+
+            /*!
+            Submits the request in "slot" and waits for its completion. On
+            Ok, the result is in the data area at offset job.aadLen, and its
+            length in resultLen. The slot stays taken until released.
+            */
+            BinServer::Status process(uint32_t   slot,
+                                      const Job& job,
+                                      size_t&    resultLen);
+
+            /*!
+            Gives the slot back.
+            */
+            void release(uint32_t slot);
+
+            /*!
+            Copies a request in, processes it and copies the result out:
+            the convenience for callers that don't own their buffers.
+            Messages that don't fit in a slot get Malformed.
+            */
+            BinServer::Status call(const BinServer::Request& request,
+                                   std::vector<uint8_t>&     result);
+
+            ~Client();
+
+            Client(const Client&)             = delete;
+            Client& operator= (const Client&) = delete;
+
+        private:
+            Segment* segment;
+            size_t   mappedSize;
+    };
+
+    // exception types:
+    struct ShmError_Setup {};
+}
+
+#endif
@@ -2,21 +2,46 @@
 
 #include "binIO.h"
 #include "RippaSSL/Mac.h"
+#include "RippaSSL/Cipher.h"
+#include "RippaSSL/Registry.h"
+#include "RippaSSL/Etm.h"
+#include "RippaSSL/AesNi.h"
+#include "RippaSSL/MultiBuffer.h"
+#include "RippaSSL/MessageBatch.h"
+#include "RippaSSL/Executor.h"
+#include "RippaSSL/Profiler.h"
+#include "RippaSSL/StaticCipher.h"
+#include "RippaSSL/ContextCache.h"
 #include "RippaSSL/Base.h"
 #include "RippaSSL/error.h"
+#include "server.h"
+#include "shmring.h"
+#include "rippassl.h"
 #include "Assert.h"
 
 #include <string>
 #include <vector>
 #include <iostream>
 #include <utility>
+#include <future>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 std::pair<int, int> BinIO_tests(std::pair<int, int> test_results);
+std::pair<int, int> RippaSSL_Cipher_tests(std::pair<int, int> test_results);
 std::pair<int, int> RippaSSL_MAC_tests(std::pair<int, int> test_results);
+std::pair<int, int> BinServer_tests(std::pair<int, int> test_results);
+std::pair<int, int> ShmRing_tests(std::pair<int, int> test_results);
+std::pair<int, int> CApi_tests(std::pair<int, int> test_results);
 
 int main(int argc, char* argv[])
 {
@@ -30,13 +55,31 @@ int main(int argc, char* argv[])
 
     test_results = BinIO_tests(test_results);
 
+    // RippaSSL/Cipher module /////////////////////////////////////////////////
+
+    test_results = RippaSSL_Cipher_tests(test_results);
+
     // RippaSSL/Mac module ////////////////////////////////////////////////////
 
+    test_results = RippaSSL_MAC_tests(test_results);
+
+    // BinServer module ///////////////////////////////////////////////////////
+
+    test_results = BinServer_tests(test_results);
+
+    // ShmRing module /////////////////////////////////////////////////////////
+
+    test_results = ShmRing_tests(test_results);
+
+    // C interface of librippassl /////////////////////////////////////////////
+
+    test_results = CApi_tests(test_results);
+
     // FINAL REPORT ///////////////////////////////////////////////////////////
     std::cout << "\nNumber of failed tests/total tests:\n"
               << test_results.first << "/" << test_results.second
               << std::endl;
-    return 0;
+    return test_results.first ? 1 : 0;
 }
 
 std::pair<int, int> BinIO_tests(std::pair<int, int> test_results)
@@ -71,6 +114,19 @@ std::pair<int, int> BinIO_tests(std::pair<int, int> test_results)
          "The BinIO::readHexBinary function failed to report"
          " that the input string's length is odd!"});
 
+    // long enough to go through the vectorized decoders, with the bad
+    // character in the last SIMD block:
+    negativeTests.push_back({"000102030405060708090A0B0C0D0E0F"
+                             "101112131415161718191A1B1C1D1E1F"
+                             "202122232425262728292A2B2C2D2E2F"
+                             "303132333435363738393A3B3C3D3E3F"
+                             "404142434445464748494A4B4C4D4E4F"
+                             "505152535455565758595A5B5C5D5E5F"
+                             "606162636465666768696A6B6C6D6E6F"
+                             "707172737475767778797A7B7C7D7E:F", 0,
+         "The BinIO::readHexBinary function failed to report"
+         " an invalid HEX character at the end of a long array!"});
+
     std::string goodString01 {"000102030405060708090A0B0C0D0F101112131415"};
     positiveTests.push_back({std::string{goodString01},
                              static_cast<int>(goodString01.length() / 2),
@@ -82,6 +138,20 @@ std::pair<int, int> BinIO_tests(std::pair<int, int> test_results)
          "The BinIO::hexBinaryToString function failed to reconstruct the"
          " correct vector:"});
 
+    std::string goodString02 {"000102030405060708090A0B0C0D0E0F"
+                              "101112131415161718191A1B1C1D1E1F"
+                              "202122232425262728292A2B2C2D2E2F"
+                              "303132333435363738393A3B3C3D3E3F"
+                              "404142434445464748494A4B4C4D4E4F"
+                              "505152535455565758595A5B5C5D5E5F"
+                              "606162636465666768696A6B6C6D6E6F"
+                              "707172737475767778797A7B7C7D7E7F"
+                              "8081828384"};
+    positiveTests.push_back({std::string{goodString02},
+                             static_cast<int>(goodString02.length() / 2),
+         "The BinIO::readHexBinary function failed to parse"
+         " a long valid HEX array!"});
+
     // test profiling:
     int failedTestsCounter = test_results.first;
     int numberOfTests      = test_results.second;
@@ -130,6 +200,95 @@ std::pair<int, int> BinIO_tests(std::pair<int, int> test_results)
                    errorHandler);
         };
 
+    auto binIoLengthAndCaseTests =
+        [&failedTestsCounter, &numberOfTests, &errorHandler] () {
+            // only the first len characters shall be read, lowercase included:
+            const char* teststring = "deadBEEF00ff0102XXXX";
+            const std::vector<uint8_t> expected {0xDE, 0xAD, 0xBE, 0xEF,
+                                                 0x00, 0xFF, 0x01, 0x02};
+            std::vector<uint8_t> outVec;
+            BinIO::readHexBinary(outVec, teststring, 16);
+            ++numberOfTests;
+            Assert(outVec == expected,
+                   "The BinIO::readHexBinary function failed to parse a"
+                   " length-delimited, mixed case HEX array!",
+                   errorHandler);
+        };
+
+    auto binIoEncodeBufferTests =
+        [&failedTestsCounter, &numberOfTests, &errorHandler] () {
+            // 40 bytes cover both the vectorized and the tail code paths:
+            std::vector<uint8_t> inVec;
+            for (int i = 0; i < 40; ++i)
+                inVec.push_back(0xF0 - 3 * i);
+
+            std::string expected;
+            char pair[3];
+            for (auto b : inVec) {
+                std::snprintf(pair, sizeof(pair), "%02x", b);
+                expected += pair;
+            }
+
+            // the encoder shall not write past 2 * len characters:
+            std::string outStr(2 * inVec.size() + 1, '#');
+            size_t outLen = BinIO::binaryToHex(outStr.data(), inVec.data(),
+                                               inVec.size(), false);
+            ++numberOfTests;
+            Assert((outLen == expected.length())           &&
+                   (outStr.substr(0, outLen) == expected)  &&
+                   (outStr.back() == '#'),
+                   "The BinIO::binaryToHex function failed to encode a"
+                   " lowercase HEX array into a caller buffer:\n" + outStr +
+                   "\nExpected:\n" + expected,
+                   errorHandler);
+        };
+
+    auto binIoStreamTests =
+        [&failedTestsCounter, &numberOfTests, &errorHandler] () {
+            // bytes split across lines and chunks shall be reassembled:
+            const char* text = "00010\n2030405 06\n0708090a0B\n";
+            const std::vector<uint8_t> expected {0x00, 0x01, 0x02, 0x03, 0x04,
+                                                 0x05, 0x06, 0x07, 0x08, 0x09,
+                                                 0x0A, 0x0B};
+            std::vector<uint8_t> outVec;
+            uint8_t chunk[3];
+            size_t readLen;
+
+            FILE* stream = std::tmpfile();
+            std::fputs(text, stream);
+            std::rewind(stream);
+
+            BinIO::StreamReader reader {stream};
+            while ((readLen = reader.read(chunk, sizeof(chunk))))
+                outVec.insert(outVec.end(), chunk, chunk + readLen);
+            std::fclose(stream);
+
+            ++numberOfTests;
+            Assert(outVec == expected,
+                   "The BinIO::StreamReader failed to read a HEX stream"
+                   " split across lines!",
+                   errorHandler);
+
+            // raw data shall go through untouched:
+            std::vector<uint8_t> rawVec;
+            stream = std::tmpfile();
+            BinIO::StreamWriter writer {stream, BinIO::Format::Raw};
+            writer.write(expected.data(), expected.size());
+            writer.finish();
+            std::rewind(stream);
+
+            BinIO::StreamReader rawReader {stream, BinIO::Format::Raw};
+            while ((readLen = rawReader.read(chunk, sizeof(chunk))))
+                rawVec.insert(rawVec.end(), chunk, chunk + readLen);
+            std::fclose(stream);
+
+            ++numberOfTests;
+            Assert(rawVec == expected,
+                   "The BinIO::StreamWriter/StreamReader failed to round-trip"
+                   " raw data!",
+                   errorHandler);
+        };
+
     // NEGATIVE TESTS
     for (auto test : negativeTests) {
         binIoReadHexTests(test.testString.data(),
@@ -147,6 +306,685 @@ std::pair<int, int> BinIO_tests(std::pair<int, int> test_results)
                               test.errorMessage);
     }
 
+    binIoLengthAndCaseTests();
+    binIoEncodeBufferTests();
+    binIoStreamTests();
+
+    return std::pair<int, int> {failedTestsCounter, numberOfTests};
+}
+
+std::pair<int, int> RippaSSL_Cipher_tests(std::pair<int, int> test_results)
+{
+    // test profiling:
+    int failedTestsCounter = test_results.first;
+    int numberOfTests      = test_results.second;
+
+    auto errorHandler =
+        [&failedTestsCounter] (std::string errMsg) {
+            std::cerr << errMsg << std::endl;
+            ++failedTestsCounter;
+        };
+
+    // FIPS-197, appendix C.1, repeated to span more than one block:
+    std::vector<uint8_t> key       {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                                    0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D,
+                                    0x0E, 0x0F};
+    std::vector<uint8_t> plainText {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66,
+                                    0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD,
+                                    0xEE, 0xFF};
+    std::vector<uint8_t> cipherText{0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04,
+                                    0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4,
+                                    0xC5, 0x5A};
+    const std::vector<uint8_t> plainBlock  {plainText};
+    const std::vector<uint8_t> cipherBlock {cipherText};
+    plainText.insert(plainText.end(), plainBlock.begin(), plainBlock.end());
+    cipherText.insert(cipherText.end(), cipherBlock.begin(), cipherBlock.end());
+
+    // vector API, separate output:
+    {
+        std::vector<uint8_t> output;
+        RippaSSL::Cipher ecb {RippaSSL::Algo::AES128ECB,
+                              RippaSSL::BcmMode::Bcm_ECB_Encrypt,
+                              key, nullptr};
+        ecb.finalize(output, plainText);
+        ++numberOfTests;
+        Assert(output == cipherText,
+               "RippaSSL::Cipher::finalize failed the AES-128 known answer"
+               " test!",
+               errorHandler);
+    }
+
+    // pointer API, in-place, split across update and finalize:
+    {
+        std::vector<uint8_t> buffer {cipherText};
+        RippaSSL::Cipher ecb {RippaSSL::Algo::AES128ECB,
+                              RippaSSL::BcmMode::Bcm_ECB_Decrypt,
+                              key.data(), key.size(), nullptr};
+        size_t written = ecb.update(buffer.data(), buffer.data(), 16);
+        written += ecb.finalize(buffer.data() + written,
+                                buffer.data() + 16, buffer.size() - 16);
+        ++numberOfTests;
+        Assert((written == buffer.size()) && (buffer == plainText),
+               "RippaSSL::Cipher failed to decrypt in place through the"
+               " pointer API!",
+               errorHandler);
+    }
+
+    // a reset or rekeyed context shall behave like a fresh one:
+    {
+        std::vector<uint8_t> iv (16, 0xA5);
+        std::vector<uint8_t> otherKey (16, 0x3C);
+        std::vector<uint8_t> expected;
+        std::vector<uint8_t> output;
+
+        RippaSSL::Cipher fresh {RippaSSL::Algo::AES128CBC,
+                                RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                otherKey, iv.data()};
+        fresh.finalize(expected, plainText);
+
+        RippaSSL::Cipher cbc {RippaSSL::Algo::AES128CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                              key, nullptr};
+        // leaves a partial block behind, which the reset shall discard:
+        cbc.update(output, std::vector<uint8_t> (5, 0x00));
+        cbc.rekey(otherKey, iv.data());
+        cbc.finalize(output, plainText);
+        ++numberOfTests;
+        Assert(output == expected,
+               "RippaSSL::Cipher::rekey failed to restart the operation!",
+               errorHandler);
+
+        cbc.update(output, plainText);
+        cbc.reset(iv.data());
+        cbc.finalize(output, plainText);
+        ++numberOfTests;
+        Assert(output == expected,
+               "RippaSSL::Cipher::reset failed to restart the operation!",
+               errorHandler);
+    }
+
+    // finalize releases a partial block held back by update, then pads:
+    {
+        std::vector<uint8_t> iv (16, 0x5A);
+        std::vector<uint8_t> message (16, 0x42);
+        std::vector<uint8_t> expected;
+        std::vector<uint8_t> head;
+        std::vector<uint8_t> tail;
+
+        RippaSSL::Cipher whole {RippaSSL::Algo::AES128CBC,
+                                RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                key, iv.data(), true};
+        whole.finalize(expected, message);
+
+        RippaSSL::Cipher split {RippaSSL::Algo::AES128CBC,
+                                RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                key, iv.data(), true};
+        size_t headLen = split.update(
+            head, std::vector<uint8_t> (message.begin(), message.end() - 1));
+        split.finalize(tail, std::vector<uint8_t> (message.end() - 1,
+                                                   message.end()));
+        ++numberOfTests;
+        Assert((0 == headLen) && (32 == expected.size()) &&
+               (tail == expected),
+               "RippaSSL::Cipher::finalize lost data held back by update!",
+               errorHandler);
+    }
+
+    // the parallel ECB path shall match the serial one byte for byte, with
+    // and without a padded tail:
+    for (auto padding : {false, true})
+    {
+        const size_t len = 4 * RippaSSL::parallelMinSlice + 16;
+        std::vector<uint8_t> input (len);
+        std::vector<uint8_t> serialOut;
+        std::vector<uint8_t> parallelOut;
+        std::vector<uint8_t> roundTrip;
+
+        for (size_t i = 0; i < len; ++i)
+            input[i] = static_cast<uint8_t>(i * 7 + (i >> 11));
+
+        RippaSSL::Cipher serial {RippaSSL::Algo::AES256ECB,
+                                 RippaSSL::BcmMode::Bcm_ECB_Encrypt,
+                                 std::vector<uint8_t> (32, 0x5A), nullptr,
+                                 padding};
+        serial.finalize(serialOut, input);
+
+        RippaSSL::Cipher parallel {RippaSSL::Algo::AES256ECB,
+                                   RippaSSL::BcmMode::Bcm_ECB_Encrypt,
+                                   std::vector<uint8_t> (32, 0x5A), nullptr,
+                                   padding};
+        parallel.setWorkers(3);
+        parallel.finalize(parallelOut, input);
+
+        RippaSSL::Cipher decrypt {RippaSSL::Algo::AES256ECB,
+                                  RippaSSL::BcmMode::Bcm_ECB_Decrypt,
+                                  std::vector<uint8_t> (32, 0x5A), nullptr,
+                                  padding};
+        decrypt.setWorkers(4);
+        decrypt.finalize(roundTrip, parallelOut);
+
+        ++numberOfTests;
+        Assert((parallelOut == serialOut) && (roundTrip == input),
+               "RippaSSL::Cipher parallel ECB output differs from the serial"
+               " one!",
+               errorHandler);
+    }
+
+    // parallel CBC decryption shall restore the plaintext, also when run in
+    // place and with padding removal:
+    for (auto padding : {false, true})
+    {
+        const size_t len = 5 * RippaSSL::parallelMinSlice + 48;
+        std::vector<uint8_t> iv (16, 0x42);
+        std::vector<uint8_t> input (len);
+        std::vector<uint8_t> buffer;
+
+        for (size_t i = 0; i < len; ++i)
+            input[i] = static_cast<uint8_t>(i * 13 + (i >> 9));
+
+        RippaSSL::Cipher encrypt {RippaSSL::Algo::AES128CBC,
+                                  RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                  key, iv.data(), padding};
+        encrypt.finalize(buffer, input);
+
+        RippaSSL::Cipher decrypt {RippaSSL::Algo::AES128CBC,
+                                  RippaSSL::BcmMode::Bcm_CBC_Decrypt,
+                                  key, iv.data(), padding};
+        decrypt.setWorkers(3);
+        size_t written = decrypt.update(buffer.data(), buffer.data(), 4096);
+        written += decrypt.finalize(buffer.data() + written,
+                                    buffer.data() + 4096,
+                                    buffer.size() - 4096);
+
+        ++numberOfTests;
+        Assert((written == len) &&
+               std::equal(input.begin(), input.end(), buffer.begin()),
+               "RippaSSL::Cipher parallel CBC decryption failed to restore"
+               " the plaintext!",
+               errorHandler);
+    }
+
+    // SP 800-38A, F.5.1, then a long non-aligned message through the parallel
+    // path, with a counter that carries past its lowest 64 bits:
+    {
+        std::vector<uint8_t> ctrKey {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2,
+                                     0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF,
+                                     0x4F, 0x3C};
+        std::vector<uint8_t> ctrIv  {0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6,
+                                     0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD,
+                                     0xFE, 0xFF};
+        std::vector<uint8_t> ctrIn  {0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F,
+                                     0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93,
+                                     0x17, 0x2A};
+        std::vector<uint8_t> ctrOut {0x87, 0x4D, 0x61, 0x91, 0xB6, 0x20, 0xE3,
+                                     0x26, 0x1B, 0xEF, 0x68, 0x64, 0x99, 0x0D,
+                                     0xB6, 0xCE};
+        std::vector<uint8_t> output;
+
+        RippaSSL::Cipher ctr {RippaSSL::Algo::AES128CTR,
+                              RippaSSL::BcmMode::Bcm_CTR_Encrypt,
+                              ctrKey, ctrIv.data()};
+        ctr.finalize(output, ctrIn);
+        ++numberOfTests;
+        Assert(output == ctrOut,
+               "RippaSSL::Cipher failed the AES-128-CTR known answer test!",
+               errorHandler);
+
+        const size_t len = 3 * RippaSSL::parallelMinSlice + 1000;
+        std::vector<uint8_t> input (len);
+        std::vector<uint8_t> serialOut;
+        std::vector<uint8_t> parallelOut (len + 16);
+        for (size_t i = 0; i < len; ++i)
+            input[i] = static_cast<uint8_t>(i ^ (i >> 8));
+
+        // the low 64 bits of the counter overflow within the first slice:
+        std::vector<uint8_t> carryIv {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                      0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                      0xFF, 0x80};
+
+        RippaSSL::Cipher serial {RippaSSL::Algo::AES256CTR,
+                                 RippaSSL::BcmMode::Bcm_CTR_Encrypt,
+                                 std::vector<uint8_t> (32, 0x11),
+                                 carryIv.data()};
+        serial.finalize(serialOut, input);
+
+        RippaSSL::Cipher parallel {RippaSSL::Algo::AES256CTR,
+                                   RippaSSL::BcmMode::Bcm_CTR_Encrypt,
+                                   std::vector<uint8_t> (32, 0x11),
+                                   carryIv.data()};
+        parallel.setWorkers(3);
+        // a first aligned update moves the counter before the split:
+        size_t written = parallel.update(parallelOut.data(), input.data(), 64);
+        written += parallel.finalize(parallelOut.data() + written,
+                                     input.data() + 64, len - 64);
+        parallelOut.resize(written);
+
+        ++numberOfTests;
+        Assert(parallelOut == serialOut,
+               "RippaSSL::Cipher parallel CTR output differs from the serial"
+               " one!",
+               errorHandler);
+    }
+
+    // AES-GCM: the zero key, IV and block example of the GCM specification,
+    // then a round trip with AAD whose tampered tag shall be rejected:
+    {
+        std::vector<uint8_t> zeroKey (16, 0x00);
+        std::vector<uint8_t> zeroIv (12, 0x00);
+        std::vector<uint8_t> plainText (16, 0x00);
+        std::vector<uint8_t> cipherText {0x03, 0x88, 0xDA, 0xCE, 0x60, 0xB6,
+                                         0xA3, 0x92, 0xF3, 0x28, 0xC2, 0xB9,
+                                         0x71, 0xB2, 0xFE, 0x78};
+        std::vector<uint8_t> expectedTag {0xAB, 0x6E, 0x47, 0xD4, 0x2C, 0xEC,
+                                          0x13, 0xBD, 0xF5, 0x3A, 0x67, 0xB2,
+                                          0x12, 0x57, 0xBD, 0xDF};
+        std::vector<uint8_t> output (16);
+        std::vector<uint8_t> tag (RippaSSL::aeadTagSize);
+
+        RippaSSL::Cipher gcm {RippaSSL::Algo::AES128GCM,
+                              RippaSSL::BcmMode::Bcm_GCM_Encrypt,
+                              zeroKey, zeroIv.data()};
+        size_t written = gcm.finalizeTag(output.data(), plainText.data(),
+                                         plainText.size(), tag.data());
+
+        ++numberOfTests;
+        Assert((written == 16) && (output == cipherText) &&
+               (tag == expectedTag),
+               "RippaSSL::Cipher AES-GCM output differs from the reference!",
+               errorHandler);
+
+        std::vector<uint8_t> aad {0xFE, 0xED, 0xFA, 0xCE};
+        std::vector<uint8_t> message (100, 0x5A);
+        std::vector<uint8_t> encrypted (message.size());
+        std::vector<uint8_t> decrypted (message.size());
+
+        RippaSSL::Cipher sealer {RippaSSL::Algo::AES256GCM,
+                                 RippaSSL::BcmMode::Bcm_GCM_Encrypt,
+                                 std::vector<uint8_t> (32, 0x42),
+                                 zeroIv.data()};
+        sealer.updateAad(aad.data(), aad.size());
+        sealer.finalizeTag(encrypted.data(), message.data(), message.size(),
+                           tag.data());
+
+        RippaSSL::Cipher opener {RippaSSL::Algo::AES256GCM,
+                                 RippaSSL::BcmMode::Bcm_GCM_Decrypt,
+                                 std::vector<uint8_t> (32, 0x42),
+                                 zeroIv.data()};
+        opener.updateAad(aad.data(), aad.size());
+        written = opener.finalizeVerify(decrypted.data(), encrypted.data(),
+                                        encrypted.size(), tag.data());
+
+        bool rejected = false;
+        tag[0] ^= 0x01;
+        opener.reset(zeroIv.data());
+        opener.updateAad(aad.data(), aad.size());
+        try {
+            opener.finalizeVerify(decrypted.data(), encrypted.data(),
+                                  encrypted.size(), tag.data());
+        } catch (RippaSSL::OpenSSLError_Authentication& au) {
+            rejected = true;
+        }
+
+        ++numberOfTests;
+        Assert((written == message.size()) && (decrypted == message) &&
+               rejected,
+               "RippaSSL::Cipher AES-GCM failed to authenticate its data!",
+               errorHandler);
+    }
+
+    // the compile-time specialized cipher shall match the generic one:
+    {
+        std::vector<uint8_t> data (100, 0x3E);
+        std::vector<uint8_t> key256 (32, 0x61);
+        std::vector<uint8_t> gcmIv (12, 0x07);
+        std::vector<uint8_t> genericOut;
+        std::vector<uint8_t> staticOut (data.size() + 16);
+        std::vector<uint8_t> roundTrip (data.size() + 16);
+        uint8_t tag[RippaSSL::aeadTagSize];
+
+        RippaSSL::Cipher cbc {RippaSSL::Algo::AES256CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                              key256, key.data(), true};
+        cbc.finalize(genericOut, data);
+
+        RippaSSL::StaticCipher<RippaSSL::Algo::AES256CBC,
+                               RippaSSL::BcmMode::Bcm_CBC_Encrypt>
+            staticCbc {key256, key.data(), true};
+        // a first run with another IV checks that reset() starts over:
+        staticCbc.finalize(staticOut.data(), data.data(), data.size());
+        staticCbc.reset(key.data());
+        staticOut.resize(staticCbc.finalize(staticOut.data(), data.data(),
+                                            data.size()));
+
+        RippaSSL::StaticCipher<RippaSSL::Algo::AES256CBC,
+                               RippaSSL::BcmMode::Bcm_CBC_Decrypt>
+            staticCbcDec {key256.data(), key.data(), true};
+        roundTrip.resize(staticCbcDec.finalize(roundTrip.data(),
+                                               staticOut.data(),
+                                               staticOut.size()));
+
+        RippaSSL::StaticCipher<RippaSSL::Algo::AES128GCM,
+                               RippaSSL::BcmMode::Bcm_GCM_Encrypt>
+            staticGcm {key.data(), gcmIv.data()};
+        std::vector<uint8_t> sealed (data.size());
+        staticGcm.updateAad(key.data(), key.size());
+        staticGcm.finalizeTag(sealed.data(), data.data(), data.size(), tag);
+
+        RippaSSL::Cipher gcm {RippaSSL::Algo::AES128GCM,
+                              RippaSSL::BcmMode::Bcm_GCM_Decrypt,
+                              key, gcmIv.data()};
+        std::vector<uint8_t> opened (data.size());
+        gcm.updateAad(key.data(), key.size());
+        gcm.finalizeVerify(opened.data(), sealed.data(), sealed.size(), tag);
+
+        ++numberOfTests;
+        Assert((staticOut == genericOut) && (roundTrip == data) &&
+               (opened == data) &&
+               (32 == decltype(staticCbc)::keyLength) &&
+               (12 == decltype(staticGcm)::ivLength) &&
+               (RippaSSL::blockSizes.at(RippaSSL::Algo::AES128GCM) ==
+                decltype(staticGcm)::blockSize) &&
+               (RippaSSL::blockSizes.at(RippaSSL::Algo::AES256CTR) ==
+                RippaSSL::AlgoTraits<RippaSSL::Algo::AES256CTR>::blockSize) &&
+               (RippaSSL::ivSizes.at(RippaSSL::Algo::AES256CTR) ==
+                RippaSSL::AlgoTraits<RippaSSL::Algo::AES256CTR>::ivLength),
+               "RippaSSL::StaticCipher output differs from RippaSSL::Cipher!",
+               errorHandler);
+    }
+
+    // the profiler shall count a finalize once, without the update it
+    // wraps, and stay silent while disabled:
+    {
+        std::vector<uint8_t> data (4096, 0x11);
+        std::vector<uint8_t> out (4096 + 16);
+        RippaSSL::Cipher ctr {RippaSSL::Algo::AES128CTR,
+                              RippaSSL::BcmMode::Bcm_CTR_Encrypt,
+                              key, key.data()};
+
+        RippaSSL::resetProfile();
+        RippaSSL::enableProfiling(true);
+        ctr.finalize(out.data(), data.data(), data.size());
+        RippaSSL::enableProfiling(false);
+        ctr.update(out.data(), data.data(), data.size());
+
+        std::vector<RippaSSL::KernelProfile> report = RippaSSL::profileReport();
+        RippaSSL::resetProfile();
+
+        ++numberOfTests;
+        Assert((1 == report.size()) &&
+               (RippaSSL::KernelOperation::CipherFinalize ==
+                report[0].operation) &&
+               (RippaSSL::Algo::AES128CTR == report[0].algo) &&
+               (1 == report[0].calls) && (data.size() == report[0].bytes),
+               "RippaSSL profiler totals are wrong!",
+               errorHandler);
+    }
+
+    // algorithm handles shall be fetched once and shared:
+    {
+        const CipherHandle* handle =
+            RippaSSL::fetchCipher(RippaSSL::Algo::AES256CBC);
+        ++numberOfTests;
+        Assert((nullptr != handle) &&
+               (handle == RippaSSL::fetchCipher(RippaSSL::Algo::AES256CBC)) &&
+               (nullptr != RippaSSL::fetchMac(RippaSSL::MacMode::CMAC)),
+               "The RippaSSL registry failed to share the fetched handles!",
+               errorHandler);
+    }
+
+    // the context cache shall hand out copies that cipher as fresh objects
+    // do, independently of each other, evicting the least recently used keys:
+    {
+        std::vector<std::vector<uint8_t>> keys;
+        std::vector<uint8_t> firstIv (16, 0x01);
+        std::vector<uint8_t> secondIv (16, 0x02);
+        std::vector<uint8_t> message (64, 0x77);
+
+        for (uint8_t k = 0; k < 3; ++k)
+            keys.emplace_back(16, static_cast<uint8_t>(0x10 + k));
+
+        auto expected = [&message] (const std::vector<uint8_t>& key,
+                                    const std::vector<uint8_t>& iv) {
+            std::vector<uint8_t> result;
+            RippaSSL::Cipher fresh {RippaSSL::Algo::AES128CBC,
+                                    RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                    key, iv.data()};
+            fresh.finalize(result, message);
+            return result;
+        };
+
+        RippaSSL::ContextCache cache {2};
+        bool matching = true;
+
+        // keys 0, 1, 0 (hit), 2 (evicts 1), 1 (evicts 0):
+        for (size_t k : {0, 1, 0, 2, 1})
+        {
+            std::vector<uint8_t> result;
+            RippaSSL::Cipher copy = cache.acquire(
+                RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                keys[k], firstIv.data());
+            copy.finalize(result, message);
+            matching = matching && (result == expected(keys[k], firstIv));
+        }
+
+        // two live copies of one context don't share their state:
+        RippaSSL::Cipher first = cache.acquire(
+            RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+            keys[1], firstIv.data());
+        RippaSSL::Cipher second = cache.acquire(
+            RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+            keys[1], secondIv.data());
+        std::vector<uint8_t> firstResult (message.size() + 16);
+        std::vector<uint8_t> secondResult (message.size() + 16);
+
+        size_t firstLen  = first.update(firstResult.data(), message.data(), 32);
+        size_t secondLen = second.finalize(secondResult.data(),
+                                           message.data(), message.size());
+        firstLen += first.finalize(firstResult.data() + firstLen,
+                                   message.data() + 32, 32);
+        firstResult.resize(firstLen);
+        secondResult.resize(secondLen);
+
+        RippaSSL::ContextCache::Statistics before = cache.statistics();
+        size_t dropped = cache.evict(keys[2].data(), keys[2].size());
+        RippaSSL::ContextCache::Statistics after = cache.statistics();
+
+        ++numberOfTests;
+        Assert(matching && (firstResult == expected(keys[1], firstIv)) &&
+               (secondResult == expected(keys[1], secondIv)) &&
+               (3 == before.hits) && (4 == before.misses) &&
+               (2 == before.evictions) && (2 == before.size) &&
+               (1 == dropped) && (1 == after.size) && (3 == after.evictions),
+               "RippaSSL::ContextCache copies or counters are wrong!",
+               errorHandler);
+    }
+
+    // the AES-NI backend shall match OpenSSL for every length, whether fed
+    // at once or in uneven pieces, across resets, rekeys and cache copies:
+    {
+        struct Case {
+            RippaSSL::Algo    algo;
+            RippaSSL::BcmMode mode;
+            const EVP_CIPHER* (*evp) ();
+            bool              decrypt;
+        };
+        const std::vector<Case> cases {
+            {RippaSSL::Algo::AES128ECB, RippaSSL::BcmMode::Bcm_ECB_Encrypt,
+             EVP_aes_128_ecb, false},
+            {RippaSSL::Algo::AES128ECB, RippaSSL::BcmMode::Bcm_ECB_Decrypt,
+             EVP_aes_128_ecb, true},
+            {RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+             EVP_aes_128_cbc, false},
+            {RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Decrypt,
+             EVP_aes_128_cbc, true},
+            {RippaSSL::Algo::AES256ECB, RippaSSL::BcmMode::Bcm_ECB_Encrypt,
+             EVP_aes_256_ecb, false},
+            {RippaSSL::Algo::AES256ECB, RippaSSL::BcmMode::Bcm_ECB_Decrypt,
+             EVP_aes_256_ecb, true},
+            {RippaSSL::Algo::AES256CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+             EVP_aes_256_cbc, false},
+            {RippaSSL::Algo::AES256CBC, RippaSSL::BcmMode::Bcm_CBC_Decrypt,
+             EVP_aes_256_cbc, true}};
+
+        std::vector<uint8_t> keys[2] {std::vector<uint8_t> (32),
+                                      std::vector<uint8_t> (32)};
+        std::vector<uint8_t> ivs[2] {std::vector<uint8_t> (16),
+                                     std::vector<uint8_t> (16)};
+        std::vector<uint8_t> data (1024);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = static_cast<uint8_t>(i * 31 + 7);
+        for (size_t i = 0; i < 32; ++i)
+        {
+            keys[0][i] = static_cast<uint8_t>(i);
+            keys[1][i] = static_cast<uint8_t>(0xA5 ^ (i * 13));
+        }
+        for (size_t i = 0; i < 16; ++i)
+        {
+            ivs[0][i] = static_cast<uint8_t>(0xF0 - i);
+            ivs[1][i] = static_cast<uint8_t>(i * 7);
+        }
+
+        auto reference = [&data] (const Case& c, const std::vector<uint8_t>& k,
+                                  const std::vector<uint8_t>& iv, size_t len) {
+            std::vector<uint8_t> result (len + 16);
+            int outLen = 0;
+            int finalLen = 0;
+            EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+            EVP_CipherInit_ex(ctx, c.evp(), NULL, k.data(), iv.data(),
+                              c.decrypt ? 0 : 1);
+            EVP_CIPHER_CTX_set_padding(ctx, 0);
+            EVP_CipherUpdate(ctx, result.data(), &outLen, data.data(), len);
+            EVP_CipherFinal_ex(ctx, result.data() + outLen, &finalLen);
+            EVP_CIPHER_CTX_free(ctx);
+            result.resize(outLen + finalLen);
+            return result;
+        };
+
+        RippaSSL::ContextCache cache {4};
+        bool matching = true;
+        bool native = true;
+
+        for (const Case& c : cases)
+        {
+            RippaSSL::Cipher cipher {c.algo, c.mode, keys[0], ivs[0].data()};
+            native = native &&
+                     (cipher.nativeBackend() == RippaSSL::aesNiAvailable());
+
+            for (size_t len : {16, 32, 48, 64, 80, 144, 1024})
+            {
+                std::vector<uint8_t> expected = reference(c, keys[1], ivs[1],
+                                                          len);
+
+                // at once, after a rekey:
+                std::vector<uint8_t> out (len + 16);
+                cipher.rekey(keys[1], ivs[1].data());
+                out.resize(cipher.finalize(out.data(), data.data(), len));
+                matching = matching && (out == expected);
+
+                // in uneven pieces, after a reset:
+                std::vector<uint8_t> pieces (len + 16);
+                size_t split = len * 2 / 3 + 1;
+                size_t written = 0;
+                cipher.reset(ivs[1].data());
+                written += cipher.update(pieces.data(), data.data(), 5);
+                written += cipher.update(pieces.data() + written,
+                                         data.data() + 5, split - 5);
+                written += cipher.finalize(pieces.data() + written,
+                                           data.data() + split, len - split);
+                pieces.resize(written);
+                matching = matching && (pieces == expected);
+
+                // in place, from a cached copy:
+                std::vector<uint8_t> inPlace (data.begin(),
+                                              data.begin() + len);
+                RippaSSL::Cipher copy = cache.acquire(c.algo, c.mode, keys[1],
+                                                      ivs[1].data());
+                copy.finalize(inPlace.data(), inPlace.data(), len);
+                matching = matching && (inPlace == expected) &&
+                           (copy.nativeBackend() == cipher.nativeBackend());
+            }
+
+            // without padding, a partial block can't be finalized:
+            bool refused = false;
+            std::vector<uint8_t> out (64);
+            cipher.reset(ivs[0].data());
+            try {
+                cipher.finalize(out.data(), data.data(), 20);
+            } catch (RippaSSL::OpenSSLError_CryptoFinalize& cf) {
+                refused = true;
+            }
+            matching = matching && refused;
+        }
+
+        // a second worker hands the state over to EVP, mid-message too:
+        RippaSSL::Cipher handedOver {RippaSSL::Algo::AES256CBC,
+                                     RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                     keys[1], ivs[1].data()};
+        std::vector<uint8_t> handedOut (data.size() + 16);
+        size_t handedLen = handedOver.update(handedOut.data(), data.data(),
+                                             20);
+        handedOver.setWorkers(2);
+        handedLen += handedOver.finalize(handedOut.data() + handedLen,
+                                         data.data() + 20, data.size() - 20);
+        handedOut.resize(handedLen);
+        matching = matching && !handedOver.nativeBackend() &&
+                   (handedOut == reference(cases[6], keys[1], ivs[1],
+                                           data.size()));
+
+        // padding keeps EVP, also when copied from an AES-NI prototype, and
+        // the cache keeps padded contexts apart from the others:
+        RippaSSL::Cipher padded {RippaSSL::Algo::AES128CBC,
+                                 RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                 keys[0], ivs[0].data(), true};
+        cache.acquire(RippaSSL::Algo::AES128CBC,
+                      RippaSSL::BcmMode::Bcm_CBC_Encrypt, keys[1],
+                      ivs[1].data());
+        RippaSSL::ContextCache::Statistics beforePadded = cache.statistics();
+        RippaSSL::Cipher paddedCopy = cache.acquire(
+            RippaSSL::Algo::AES128CBC, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+            keys[1], ivs[1].data(), true);
+        RippaSSL::ContextCache::Statistics afterPadded = cache.statistics();
+        RippaSSL::Cipher nativePrototype {RippaSSL::Algo::AES128CBC,
+                                          RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                          keys[1], ivs[0].data()};
+        RippaSSL::Cipher paddedFromNative {nativePrototype, ivs[1].data(),
+                                           true};
+        std::vector<uint8_t> paddedOut;
+        std::vector<uint8_t> paddedFromNativeOut;
+        std::vector<uint8_t> paddedReference;
+        paddedCopy.finalize(paddedOut, data);
+        paddedFromNative.finalize(paddedFromNativeOut, data);
+        padded.rekey(keys[1], ivs[1].data());
+        padded.finalize(paddedReference, data);
+
+        ++numberOfTests;
+        Assert(matching && native && !padded.nativeBackend() &&
+               !paddedCopy.nativeBackend() &&
+               !paddedFromNative.nativeBackend() &&
+               (afterPadded.misses == beforePadded.misses + 1) &&
+               (paddedOut == paddedReference) &&
+               (paddedFromNativeOut == paddedReference) &&
+               (paddedOut.size() == data.size() + 16),
+               "RippaSSL::Cipher AES-NI output differs from OpenSSL!",
+               errorHandler);
+    }
+
+    // a key shorter than the algorithm requires shall be refused:
+    {
+        bool refused = false;
+        try {
+            RippaSSL::Cipher ecb {RippaSSL::Algo::AES256ECB,
+                                  RippaSSL::BcmMode::Bcm_ECB_Encrypt,
+                                  key, nullptr};
+        } catch (RippaSSL::InputError_KEY_LENGTH& kl) {
+            refused = true;
+        }
+        ++numberOfTests;
+        Assert(refused,
+               "RippaSSL::Cipher accepted a 16 bytes key for AES-256!",
+               errorHandler);
+    }
+
     return std::pair<int, int> {failedTestsCounter, numberOfTests};
 }
 
@@ -155,14 +993,952 @@ std::pair<int, int> RippaSSL_MAC_tests(std::pair<int, int> test_results)
     // test profiling:
     int failedTestsCounter = test_results.first;
     int numberOfTests      = test_results.second;
-    std::vector<uint8_t> iv  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                              0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    auto errorHandler =
+        [&failedTestsCounter] (std::string errMsg) {
+            std::cerr << errMsg << std::endl;
+            ++failedTestsCounter;
+        };
+
+    // RFC 4493, section 4, examples 1 and 2:
+    std::vector<uint8_t> key     {0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2,
+                                  0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF,
+                                  0x4F, 0x3C};
+    std::vector<uint8_t> message {0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F,
+                                  0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93,
+                                  0x17, 0x2A};
+    std::vector<uint8_t> emptyMac {0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37,
+                                   0x28, 0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75,
+                                   0x67, 0x46};
+    std::vector<uint8_t> blockMac {0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41,
+                                   0x44, 0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A,
+                                   0x28, 0x7C};
+
+    {
+        std::vector<uint8_t> tag;
+        RippaSSL::Cmac myCmac {RippaSSL::Algo::AES128CBC,
+                               RippaSSL::MacMode::CMAC,
+                               key, nullptr};
+        myCmac.finalize(tag, std::vector<uint8_t> {});
+        ++numberOfTests;
+        Assert(tag == emptyMac,
+               "RippaSSL::Cmac failed the RFC 4493 empty message test!",
+               errorHandler);
+    }
+
+    {
+        uint8_t tag[16];
+        RippaSSL::Cmac myCmac {RippaSSL::Algo::AES128CBC,
+                               RippaSSL::MacMode::CMAC,
+                               key.data(), key.size(), nullptr};
+        myCmac.update(nullptr, message.data(), 7);
+        size_t tagLen = myCmac.finalize(tag, message.data() + 7,
+                                        message.size() - 7);
+        ++numberOfTests;
+        Assert((tagLen == sizeof(tag)) &&
+               (std::vector<uint8_t> (tag, tag + tagLen) == blockMac),
+               "RippaSSL::Cmac failed the RFC 4493 one block test through the"
+               " pointer API!",
+               errorHandler);
+    }
+
+    // the fused encrypt-then-MAC engine shall match a Cipher followed by a
+    // Cmac, across several tiles and a padded last block:
+    {
+        const size_t len = 3 * RippaSSL::etmTileSize + 1000;
+        std::vector<uint8_t> input (len);
+        for (size_t i = 0; i < len; ++i)
+            input[i] = static_cast<uint8_t>(i * 7);
+        std::vector<uint8_t> iv (16, 0x24);
+        std::vector<uint8_t> cipherKey (32, 0x5C);
+        std::vector<uint8_t> macKey (32, 0x36);
+
+        std::vector<uint8_t> separateOut;
+        std::vector<uint8_t> separateTag;
+        RippaSSL::Cipher cbc {RippaSSL::Algo::AES256CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                              cipherKey, iv.data(), true};
+        cbc.finalize(separateOut, input);
+        RippaSSL::Cmac cmac {RippaSSL::Algo::AES256CBC,
+                             RippaSSL::MacMode::CMAC,
+                             macKey, nullptr};
+        cmac.finalize(separateTag, separateOut);
+
+        std::vector<uint8_t> fusedOut (len + 16);
+        std::vector<uint8_t> fusedTag (16);
+        RippaSSL::EncryptThenMac sealer {RippaSSL::Algo::AES256CBC,
+                                         RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                         cipherKey, iv.data(), macKey, true};
+        size_t written = sealer.update(fusedOut.data(), input.data(), 100);
+        written += sealer.finalizeTag(fusedOut.data() + written,
+                                      input.data() + 100, len - 100,
+                                      fusedTag.data());
+        fusedOut.resize(written);
+
+        ++numberOfTests;
+        Assert((fusedOut == separateOut) && (fusedTag == separateTag),
+               "RippaSSL::EncryptThenMac output differs from Cipher + Cmac!",
+               errorHandler);
+
+        // in-place decryption verifies the tag, and rejects a tampered one:
+        std::vector<uint8_t> buffer {fusedOut};
+        RippaSSL::EncryptThenMac opener {RippaSSL::Algo::AES256CBC,
+                                         RippaSSL::BcmMode::Bcm_CBC_Decrypt,
+                                         cipherKey, iv.data(), macKey, true};
+        written = opener.finalizeVerify(buffer.data(), buffer.data(),
+                                        buffer.size(), fusedTag.data());
+        buffer.resize(written);
+
+        bool rejected = false;
+        fusedTag[15] ^= 0x80;
+        try {
+            RippaSSL::EncryptThenMac tampered {
+                                      RippaSSL::Algo::AES256CBC,
+                                      RippaSSL::BcmMode::Bcm_CBC_Decrypt,
+                                      cipherKey, iv.data(), macKey, true};
+            std::vector<uint8_t> scratch (fusedOut.size() + 16);
+            tampered.finalizeVerify(scratch.data(), fusedOut.data(),
+                                    fusedOut.size(), fusedTag.data());
+        } catch (RippaSSL::OpenSSLError_Authentication& au) {
+            rejected = true;
+        }
+
+        ++numberOfTests;
+        Assert((buffer == input) && rejected,
+               "RippaSSL::EncryptThenMac failed to verify and decrypt!",
+               errorHandler);
+    }
+
+    // multi-buffer CBC and CMAC shall match one Cipher / Cmac per message,
+    // with more messages than lanes and lengths that end them out of step:
+    for (RippaSSL::Algo algo : {RippaSSL::Algo::AES128CBC,
+                                RippaSSL::Algo::AES256CBC})
+    {
+        const size_t jobCount = 3 * RippaSSL::multiBufferLanes + 5;
+        const size_t keyLen = (RippaSSL::Algo::AES128CBC == algo) ? 16 : 32;
+        std::vector<std::vector<uint8_t>> keys;
+        std::vector<std::vector<uint8_t>> messages;
+        std::vector<std::vector<uint8_t>> outputs;
+        std::vector<std::vector<uint8_t>> tags;
+        std::vector<uint8_t> iv (16);
+        std::vector<RippaSSL::CbcJob> cbcJobs;
+        std::vector<RippaSSL::CmacJob> cmacJobs;
+
+        for (size_t j = 0; j < jobCount; ++j)
+        {
+            keys.emplace_back(keyLen, static_cast<uint8_t>(j * 13 + 1));
+            messages.emplace_back((j * 37) % 200);
+            for (size_t i = 0; i < messages[j].size(); ++i)
+                messages[j][i] = static_cast<uint8_t>(i + j);
+            outputs.emplace_back(messages[j].size());
+            tags.emplace_back(16);
+            iv[j % 16] ^= static_cast<uint8_t>(j);
+        }
+
+        for (size_t j = 0; j < jobCount; ++j)
+        {
+            // CBC lengths are trimmed to whole blocks:
+            cbcJobs.push_back({keys[j].data(), iv.data(), messages[j].data(),
+                               outputs[j].data(),
+                               messages[j].size() / 16 * 16});
+            cmacJobs.push_back({keys[j].data(), messages[j].data(),
+                                messages[j].size(), tags[j].data()});
+        }
+
+        RippaSSL::cbcEncryptMulti(algo, cbcJobs.data(), cbcJobs.size());
+        RippaSSL::cmacMulti(algo, cmacJobs.data(), cmacJobs.size());
+
+        bool matching = true;
+        RippaSSL::Cmac reference {algo, RippaSSL::MacMode::CMAC,
+                                  keys[0], nullptr};
+        for (size_t j = 0; j < jobCount; ++j)
+        {
+            std::vector<uint8_t> cbcOut;
+            std::vector<uint8_t> cbcIn (messages[j].begin(),
+                                        messages[j].begin() +
+                                        cbcJobs[j].length);
+            RippaSSL::Cipher cbc {algo, RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                  keys[j], iv.data()};
+            cbc.finalize(cbcOut, cbcIn);
+
+            std::vector<uint8_t> tag;
+            reference.rekey(keys[j].data(), keys[j].size());
+            reference.finalize(tag, messages[j]);
+
+            outputs[j].resize(cbcJobs[j].length);
+            matching = matching && (outputs[j] == cbcOut) && (tags[j] == tag);
+        }
+
+        ++numberOfTests;
+        Assert(matching,
+               "RippaSSL multi-buffer output differs from the one message at a"
+               " time one!",
+               errorHandler);
+    }
+
+    {
+        std::vector<uint8_t> data (20);
+        RippaSSL::CbcJob job {key.data(), key.data(), data.data(),
+                              data.data(), data.size()};
+        bool refused = false;
+        try {
+            RippaSSL::cbcEncryptMulti(RippaSSL::Algo::AES128CBC, &job, 1);
+        } catch (RippaSSL::InputError_MISALIGNED_DATA& md) {
+            refused = true;
+        }
+        ++numberOfTests;
+        Assert(refused,
+               "RippaSSL::cbcEncryptMulti accepted a partial block!",
+               errorHandler);
+    }
+
+    // a MessageBatch run shall match one Cipher / Cmac per message:
+    {
+        RippaSSL::MessageBatch batch {RippaSSL::Algo::AES128CBC};
+        std::vector<std::vector<uint8_t>> messages;
+        std::vector<uint8_t> otherKey (16, 0x77);
+        std::vector<uint8_t> iv (16, 0x0F);
+        std::vector<uint8_t> otherIv (16, 0xF0);
+
+        size_t firstKey = batch.addKey(key.data(), key.size());
+        size_t secondKey = batch.addKey(otherKey.data(), otherKey.size());
+        size_t firstIv = batch.addIv(iv.data());
+        size_t secondIv = batch.addIv(otherIv.data());
+        batch.reserve(12, 12 * 40);
+
+        for (size_t r = 0; r < 12; ++r)
+        {
+            messages.emplace_back(r * 5, static_cast<uint8_t>(r));
+            // runs of records share a key:
+            batch.add(messages[r].data(), messages[r].size(),
+                      (r % 4 < 2) ? firstKey : secondKey,
+                      (r % 3) ? firstIv : secondIv);
+        }
+
+        RippaSSL::Cipher cbc {RippaSSL::Algo::AES128CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                              key, iv.data(), true};
+        cbc.finalizeBatch(batch);
+
+        bool matching = true;
+        for (size_t r = 0; r < batch.size(); ++r)
+        {
+            std::vector<uint8_t> expected;
+            RippaSSL::Cipher single {RippaSSL::Algo::AES128CBC,
+                                     RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                     batch.key(r), batch.keyLength(r),
+                                     batch.iv(r), true};
+            single.finalize(expected, messages[r]);
+            matching = matching &&
+                       (std::vector<uint8_t> (batch.output(r),
+                                              batch.output(r) +
+                                              batch.outputLength(r)) ==
+                        expected);
+        }
+
+        RippaSSL::Cmac cmac {RippaSSL::Algo::AES128CBC,
+                             RippaSSL::MacMode::CMAC, key, nullptr};
+        cmac.finalizeBatch(batch);
+
+        for (size_t r = 0; r < batch.size(); ++r)
+        {
+            std::vector<uint8_t> expected;
+            RippaSSL::Cmac single {RippaSSL::Algo::AES128CBC,
+                                   RippaSSL::MacMode::CMAC,
+                                   batch.key(r), batch.keyLength(r),
+                                   batch.iv(r)};
+            single.finalize(expected, messages[r]);
+            matching = matching &&
+                       (std::vector<uint8_t> (batch.output(r),
+                                              batch.output(r) +
+                                              batch.outputLength(r)) ==
+                        expected);
+        }
+
+        ++numberOfTests;
+        Assert(matching,
+               "RippaSSL MessageBatch output differs from the one message at a"
+               " time one!",
+               errorHandler);
+    }
+
+    // the executor shall return what the synchronous classes compute, through
+    // futures and callbacks, with a queue short enough to block producers:
+    {
+        std::vector<uint8_t> iv (16, 0x3C);
+        std::vector<std::future<std::vector<uint8_t>>> cipherResults;
+        std::vector<std::future<std::vector<uint8_t>>> macResults;
+        std::atomic<int> callbackMatches {0};
+        std::vector<uint8_t> expectedMac;
+
+        RippaSSL::Cmac single {RippaSSL::Algo::AES128CBC,
+                               RippaSSL::MacMode::CMAC, key, nullptr};
+        single.finalize(expectedMac, message);
+
+        bool matching = true;
+        bool refused = false;
+        {
+            RippaSSL::Executor executor {3, 2};
+
+            for (int t = 0; t < 20; ++t)
+            {
+                std::vector<uint8_t> input (t * 16, static_cast<uint8_t>(t));
+                cipherResults.push_back(executor.submit(
+                    RippaSSL::CipherTask {RippaSSL::Algo::AES128CBC,
+                                          RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                          key, iv, input, (t % 2) != 0}));
+                macResults.push_back(executor.submit(
+                    RippaSSL::MacTask {RippaSSL::Algo::AES128CBC,
+                                       RippaSSL::MacMode::CMAC,
+                                       key, {}, message}));
+                executor.submit(RippaSSL::MacTask {RippaSSL::Algo::AES128CBC,
+                                                   RippaSSL::MacMode::CMAC,
+                                                   key, {}, message},
+                                [&] (std::vector<uint8_t> tag,
+                                     std::exception_ptr error) {
+                                    if (!error && (tag == expectedMac))
+                                        ++callbackMatches;
+                                });
+            }
+
+            for (int t = 0; t < 20; ++t)
+            {
+                std::vector<uint8_t> expected;
+                std::vector<uint8_t> input (t * 16, static_cast<uint8_t>(t));
+                RippaSSL::Cipher cbc {RippaSSL::Algo::AES128CBC,
+                                      RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                      key, iv.data(), (t % 2) != 0};
+                cbc.finalize(expected, input);
+                matching = matching && (cipherResults[t].get() == expected) &&
+                           (macResults[t].get() == expectedMac);
+            }
+
+            // errors travel through the future:
+            auto failing = executor.submit(
+                RippaSSL::CipherTask {RippaSSL::Algo::AES256CBC,
+                                      RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                                      key, iv, message, false});
+            try {
+                failing.get();
+            } catch (RippaSSL::InputError_KEY_LENGTH& kl) {
+                refused = true;
+            }
+
+            // the executor runs the pending callbacks before going away:
+        }
+
+        ++numberOfTests;
+        Assert(matching && refused && (20 == callbackMatches),
+               "RippaSSL::Executor results differ from the synchronous ones!",
+               errorHandler);
+    }
+
+    // contexts copied from the registry template shall take the caller's key
+    // only, refusing a missing one rather than keeping the template's:
+    {
+        std::vector<uint8_t> macKey (16, 0x2B);
+        std::vector<uint8_t> message (40, 0x6C);
+        std::vector<uint8_t> first;
+        std::vector<uint8_t> second;
+        RippaSSL::Cmac one {RippaSSL::Algo::AES128CBC, RippaSSL::MacMode::CMAC,
+                            macKey, nullptr};
+        RippaSSL::Cmac other {RippaSSL::Algo::AES128CBC,
+                              RippaSSL::MacMode::CMAC,
+                              std::vector<uint8_t> (16, 0x00), nullptr};
+        one.finalize(first, message);
+        other.rekey(macKey.data(), macKey.size());
+        other.finalize(second, message);
+
+        bool refused = false;
+        try {
+            RippaSSL::Cmac keyless {RippaSSL::Algo::AES128CBC,
+                                    RippaSSL::MacMode::CMAC,
+                                    nullptr, 16, nullptr};
+        } catch (RippaSSL::InputError_NULLPTR& np) {
+            refused = true;
+        }
+
+        ++numberOfTests;
+        Assert((first == second) && (16 == first.size()) && refused,
+               "RippaSSL::Cmac contexts from the registry are wrong!",
+               errorHandler);
+    }
+
+    return std::pair<int, int> {failedTestsCounter, numberOfTests};
+}
+
+std::pair<int, int> BinServer_tests(std::pair<int, int> test_results)
+{
+    // test profiling:
+    int failedTestsCounter = test_results.first;
+    int numberOfTests      = test_results.second;
+
+    auto errorHandler =
+        [&failedTestsCounter] (std::string errMsg) {
+            std::cerr << errMsg << std::endl;
+            ++failedTestsCounter;
+        };
+
+    // a server that echoes the payload with the key appended shall answer
+    // back to back requests of two clients in order, and report the
+    // handler's failures without closing the connection:
+    {
+        std::string socketPath = "binenc-test-" +
+                                 std::to_string(getpid()) + ".sock";
+        std::vector<uint8_t> key (16, 0xA5);
+        std::vector<uint8_t> payload (100000);
+        for (size_t i = 0; i < payload.size(); ++i)
+            payload[i] = static_cast<uint8_t>(i * 7);
+
+        BinServer::Server server {
+            socketPath.c_str(),
+            [] (const BinServer::Request& request,
+                std::vector<uint8_t>&     result) {
+                if (request.decrypt)
+                    return BinServer::Status::Mode;
+
+                result.assign(request.payload,
+                              request.payload + request.payloadLen);
+                result.insert(result.end(), request.key,
+                              request.key + request.keyLen);
+                return BinServer::Status::Ok;
+            }};
+        std::thread loop {[&server] () { server.run(); }};
+
+        int first  = BinServer::connectSocket(socketPath.c_str());
+        int second = BinServer::connectSocket(socketPath.c_str());
+        bool matching = (first >= 0) && (second >= 0);
+
+        BinServer::Request request {0, false, key.data(), key.size(),
+                                    nullptr, 0, nullptr, 0,
+                                    payload.data(), payload.size()};
+        std::vector<uint8_t> expected {payload};
+        expected.insert(expected.end(), key.begin(), key.end());
+        std::vector<uint8_t> result;
+
+        for (int round = 0; matching && (round < 3); ++round)
+        {
+            matching = (BinServer::Status::Ok ==
+                        BinServer::call(first, request, result)) &&
+                       (result == expected) &&
+                       (BinServer::Status::Ok ==
+                        BinServer::call(second, request, result)) &&
+                       (result == expected);
+        }
+
+        request.decrypt = true;
+        matching = matching &&
+                   (BinServer::Status::Mode ==
+                    BinServer::call(first, request, result)) &&
+                   result.empty();
+
+        request.decrypt = false;
+        matching = matching &&
+                   (BinServer::Status::Ok ==
+                    BinServer::call(first, request, result)) &&
+                   (result == expected);
+
+        close(first);
+        close(second);
+        server.stop();
+        loop.join();
+
+        ++numberOfTests;
+        Assert(matching,
+               "BinServer failed to answer requests over the socket!",
+               errorHandler);
+    }
+
+    // a client that doesn't read its responses shall only stall itself: the
+    // server stops reading from it past maxPendingOutput, and catches up as
+    // they get read. A second server is refused the socket of a live one,
+    // while the file of a dead one is replaced:
+    {
+        std::string socketPath = "binenc-test-" +
+                                 std::to_string(getpid()) + "-backlog.sock";
+        const size_t payloadLen = 1024 * 1024;
+        const size_t frames = BinServer::maxPendingOutput / payloadLen + 16;
+        BinServer::Handler echo =
+            [] (const BinServer::Request& request,
+                std::vector<uint8_t>&     result) {
+                result.assign(request.payload,
+                              request.payload + request.payloadLen);
+                result.insert(result.end(), request.key,
+                              request.key + request.keyLen);
+                return BinServer::Status::Ok;
+            };
+
+        // a socket bound, then closed without a server behind it:
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, socketPath.c_str(),
+                     sizeof(address.sun_path) - 1);
+        int dead = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool leftBehind =
+            (0 == bind(dead, reinterpret_cast<sockaddr*>(&address),
+                       sizeof(address))) &&
+            (0 == access(socketPath.c_str(), F_OK));
+        close(dead);
+
+        BinServer::Server server {socketPath.c_str(), echo};
+        std::thread loop {[&server] () { server.run(); }};
+
+        bool refused = false;
+        try {
+            BinServer::Server other {socketPath.c_str(), echo};
+        } catch (BinServer::ServerError_Setup& se) {
+            refused = true;
+        }
+
+        // frame: length, header (1 byte key, no IV nor AAD), key, payload:
+        std::vector<uint8_t> frame (4 + BinServer::requestHeaderSize + 1 +
+                                    payloadLen);
+        uint32_t bodyLen = frame.size() - 4;
+        frame[0] = bodyLen >> 24;
+        frame[1] = bodyLen >> 16;
+        frame[2] = bodyLen >> 8;
+        frame[3] = bodyLen;
+        frame[6] = 1;
+        frame[12] = 0x5C;
+        for (size_t i = 0; i < payloadLen; ++i)
+            frame[13 + i] = static_cast<uint8_t>(i * 3);
+
+        std::vector<uint8_t> expected (frame.begin() + 13, frame.end());
+        expected.push_back(0x5C);
+
+        int fd = BinServer::connectSocket(socketPath.c_str());
+        std::atomic<bool> allSent {false};
+        std::thread sender {[&] () {
+            for (size_t f = 0; f < frames; ++f)
+            {
+                for (size_t done = 0; done < frame.size(); )
+                {
+                    ssize_t sent = send(fd, frame.data() + done,
+                                        frame.size() - done, MSG_NOSIGNAL);
+                    if (sent <= 0)
+                        return;
+                    done += sent;
+                }
+            }
+            allSent = true;
+        }};
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        bool stalled = !allSent;
+
+        auto readAll = [fd] (uint8_t* data, size_t len) {
+            while (len)
+            {
+                ssize_t got = recv(fd, data, len, 0);
+                if (got <= 0)
+                    return false;
+                data += got;
+                len  -= got;
+            }
+            return true;
+        };
+
+        bool matching = (fd >= 0);
+        std::vector<uint8_t> response (5 + expected.size());
+        for (size_t f = 0; matching && (f < frames); ++f)
+        {
+            matching = readAll(response.data(), response.size()) &&
+                       (0 == response[4]) &&
+                       std::equal(expected.begin(), expected.end(),
+                                  response.begin() + 5);
+        }
+
+        sender.join();
+        close(fd);
+        server.stop();
+        loop.join();
+
+        ++numberOfTests;
+        Assert(leftBehind && refused && stalled && allSent && matching,
+               "BinServer failed to hold back a client, or to guard its "
+               "socket!",
+               errorHandler);
+    }
+
+    return std::pair<int, int> {failedTestsCounter, numberOfTests};
+}
+
+std::pair<int, int> ShmRing_tests(std::pair<int, int> test_results)
+{
+    // test profiling:
+    int failedTestsCounter = test_results.first;
+    int numberOfTests      = test_results.second;
+
+    auto errorHandler =
+        [&failedTestsCounter] (std::string errMsg) {
+            std::cerr << errMsg << std::endl;
+            ++failedTestsCounter;
+        };
+
+    // a worker that XORs the payload with the first key byte, in place, and
+    // appends the AAD length shall serve threads contending for fewer slots
+    // than they are, through both the copying and the zero-copy calls:
+    {
+        std::string name = "/binenc-test-" + std::to_string(getpid());
+        ShmRing::Worker worker {name.c_str(), 2, 4096};
+
+        ShmRing::Handler handler =
+            [] (const BinServer::Request& request, uint8_t* output,
+                size_t capacity, size_t& resultLen) {
+                if (request.decrypt)
+                    return BinServer::Status::Mode;
+                if (request.payloadLen + 1 > capacity)
+                    return BinServer::Status::Malformed;
+
+                for (size_t i = 0; i < request.payloadLen; ++i)
+                    output[i] = request.payload[i] ^ request.key[0];
+                output[request.payloadLen] =
+                    static_cast<uint8_t>(request.aadLen);
+                resultLen = request.payloadLen + 1;
+
+                return BinServer::Status::Ok;
+            };
+        std::thread loop {[&worker, &handler] () { worker.run(handler); }};
+
+        std::atomic<int> matches {0};
+        std::vector<std::thread> clients;
+
+        for (int t = 0; t < 4; ++t)
+        {
+            clients.emplace_back([&name, &matches, t] () {
+                ShmRing::Client client {name.c_str()};
+                std::vector<uint8_t> key (16, static_cast<uint8_t>(t + 1));
+                std::vector<uint8_t> aad (3, 0xAA);
+                std::vector<uint8_t> result;
+
+                for (int round = 0; round < 50; ++round)
+                {
+                    std::vector<uint8_t> payload (round * 10,
+                                                  static_cast<uint8_t>(round));
+                    std::vector<uint8_t> expected (payload);
+                    for (auto& byte : expected)
+                        byte ^= key[0];
+                    expected.push_back(3);
+
+                    BinServer::Request request {0, false, key.data(), 16,
+                                                nullptr, 0, aad.data(), 3,
+                                                payload.data(),
+                                                payload.size()};
+                    if ((BinServer::Status::Ok ==
+                         client.call(request, result)) &&
+                        (result == expected))
+                    {
+                        ++matches;
+                    }
+                }
+            });
+        }
+
+        for (auto& client : clients)
+            client.join();
+
+        bool matching = (200 == matches);
+        {
+            ShmRing::Client client {name.c_str()};
+            uint8_t key[16] {0x0F};
+            uint32_t slot;
+            size_t resultLen = 0;
+
+            uint8_t* data = client.acquire(slot);
+            std::memcpy(data, "zero-copy", 9);
+
+            ShmRing::Job job {0, false, key, 16, nullptr, 0, 0, 9};
+            matching = matching &&
+                       (BinServer::Status::Ok ==
+                        client.process(slot, job, resultLen)) &&
+                       (10 == resultLen) && ('z' == (data[0] ^ 0x0F)) &&
+                       (0 == data[9]);
+
+            job.decrypt = true;
+            matching = matching &&
+                       (BinServer::Status::Mode ==
+                        client.process(slot, job, resultLen));
+
+            job.payloadLen = client.slotSize() + 1;
+            matching = matching &&
+                       (BinServer::Status::Malformed ==
+                        client.process(slot, job, resultLen));
+            client.release(slot);
+        }
+
+        worker.stop();
+        loop.join();
+
+        ++numberOfTests;
+        Assert(matching,
+               "ShmRing failed to serve requests through shared memory!",
+               errorHandler);
+    }
+
+    return std::pair<int, int> {failedTestsCounter, numberOfTests};
+}
+
+std::pair<int, int> CApi_tests(std::pair<int, int> test_results)
+{
+    // test profiling:
+    int failedTestsCounter = test_results.first;
+    int numberOfTests      = test_results.second;
+
+    auto errorHandler =
+        [&failedTestsCounter] (std::string errMsg) {
+            std::cerr << errMsg << std::endl;
+            ++failedTestsCounter;
+        };
+
     std::vector<uint8_t> key {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
                               0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+    std::vector<uint8_t> iv (16, 0x00);
+
+    // the C ciphers shall match the C++ ones, in pieces and in one go, and
+    // back:
+    {
+        std::vector<uint8_t> message (100, 0x5A);
+        std::vector<uint8_t> expected;
+        RippaSSL::Cipher cbc {RippaSSL::Algo::AES128CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                              key, iv.data(), true};
+        cbc.finalize(expected, message);
+
+        rippassl_cipher* encryptor = NULL;
+        rippassl_cipher* decryptor = NULL;
+        uint8_t ciphertext[144];
+        uint8_t plaintext[144];
+        size_t first = 0, second = 0, decrypted = 0, last = 0;
+
+        bool matching =
+            (RIPPASSL_OK == rippassl_cipher_new(&encryptor, RIPPASSL_AES128CBC,
+                                                RIPPASSL_ENCRYPT, key.data(),
+                                                16, iv.data(), 16, 1)) &&
+            (RIPPASSL_OK == rippassl_cipher_update(encryptor, ciphertext,
+                                                   sizeof(ciphertext),
+                                                   message.data(), 40,
+                                                   &first)) &&
+            (RIPPASSL_OK == rippassl_cipher_final(encryptor,
+                                                  ciphertext + first,
+                                                  sizeof(ciphertext) - first,
+                                                  message.data() + 40, 60,
+                                                  &second)) &&
+            (expected == std::vector<uint8_t> (ciphertext,
+                                               ciphertext + first + second)) &&
+            (RIPPASSL_OK == rippassl_cipher_new(&decryptor, RIPPASSL_AES128CBC,
+                                                RIPPASSL_DECRYPT, key.data(),
+                                                16, iv.data(), 16, 1)) &&
+            (RIPPASSL_OK == rippassl_cipher_final(decryptor, plaintext,
+                                                  sizeof(plaintext),
+                                                  ciphertext, first + second,
+                                                  &decrypted)) &&
+            (message == std::vector<uint8_t> (plaintext,
+                                              plaintext + decrypted));
+
+        // the handles restart with a new IV:
+        matching = matching &&
+                   (RIPPASSL_OK == rippassl_cipher_reset(encryptor, iv.data(),
+                                                         16)) &&
+                   (RIPPASSL_OK == rippassl_cipher_final(encryptor,
+                                                         ciphertext,
+                                                         sizeof(ciphertext),
+                                                         message.data(), 100,
+                                                         &last)) &&
+                   (expected == std::vector<uint8_t> (ciphertext,
+                                                      ciphertext + last));
+
+        rippassl_cipher_free(encryptor);
+        rippassl_cipher_free(decryptor);
+
+        ++numberOfTests;
+        Assert(matching,
+               "librippassl ciphers differ from RippaSSL::Cipher!",
+               errorHandler);
+    }
+
+    // final shall have room for a partial block held back by update, plus
+    // the padding:
+    {
+        std::vector<uint8_t> message (16, 0x5A);
+        std::vector<uint8_t> expected;
+        RippaSSL::Cipher cbc {RippaSSL::Algo::AES128CBC,
+                              RippaSSL::BcmMode::Bcm_CBC_Encrypt,
+                              key, iv.data(), true};
+        cbc.finalize(expected, message);
 
-    RippaSSL::Cmac myCmac {RippaSSL::Algo::AES128CBC,
-                           RippaSSL::MacMode::CMAC,
-                           key, iv.data()};
+        rippassl_cipher* encryptor = NULL;
+        uint8_t ciphertext[33];
+        size_t first = 0, second = 0;
+
+        bool matching =
+            (RIPPASSL_OK == rippassl_cipher_new(&encryptor, RIPPASSL_AES128CBC,
+                                                RIPPASSL_ENCRYPT, key.data(),
+                                                16, iv.data(), 16, 1)) &&
+            (RIPPASSL_OK == rippassl_cipher_update(encryptor, ciphertext, 31,
+                                                   message.data(), 15,
+                                                   &first)) &&
+            (0 == first) &&
+            (RIPPASSL_ERR_BUFFER_TOO_SMALL ==
+             rippassl_cipher_final(encryptor, ciphertext, 17,
+                                   message.data() + 15, 1, &second)) &&
+            (RIPPASSL_OK == rippassl_cipher_final(encryptor, ciphertext,
+                                                  sizeof(ciphertext),
+                                                  message.data() + 15, 1,
+                                                  &second)) &&
+            (expected == std::vector<uint8_t> (ciphertext,
+                                               ciphertext + second));
+
+        rippassl_cipher_free(encryptor);
+
+        ++numberOfTests;
+        Assert(matching,
+               "librippassl let final overflow after a partial update!",
+               errorHandler);
+    }
+
+    // GCM tags shall verify, and tampering shall be reported as such:
+    {
+        std::vector<uint8_t> zeros (16, 0x00);
+        uint8_t ciphertext[32];
+        uint8_t plaintext[32];
+        uint8_t tag[RIPPASSL_TAG_SIZE];
+        size_t encrypted = 0, decrypted = 0;
+        rippassl_cipher* gcm = NULL;
+        rippassl_cipher* check = NULL;
+
+        bool matching =
+            (RIPPASSL_OK == rippassl_cipher_new(&gcm, RIPPASSL_AES128GCM,
+                                                RIPPASSL_ENCRYPT, zeros.data(),
+                                                16, zeros.data(), 12, 0)) &&
+            (RIPPASSL_OK == rippassl_cipher_final_tag(gcm, ciphertext,
+                                                      sizeof(ciphertext),
+                                                      zeros.data(), 16,
+                                                      &encrypted, tag,
+                                                      sizeof(tag))) &&
+            (16 == encrypted) && (0x03 == ciphertext[0]) && (0xAB == tag[0]) &&
+            (RIPPASSL_OK == rippassl_cipher_new(&check, RIPPASSL_AES128GCM,
+                                                RIPPASSL_DECRYPT, zeros.data(),
+                                                16, zeros.data(), 12, 0)) &&
+            (RIPPASSL_OK == rippassl_cipher_final_verify(check, plaintext,
+                                                         sizeof(plaintext),
+                                                         ciphertext, 16,
+                                                         &decrypted, tag,
+                                                         sizeof(tag))) &&
+            (zeros == std::vector<uint8_t> (plaintext,
+                                            plaintext + decrypted));
+
+        tag[0] ^= 0x01;
+        matching = matching &&
+                   (RIPPASSL_OK == rippassl_cipher_reset(check, zeros.data(),
+                                                         12)) &&
+                   (RIPPASSL_ERR_AUTHENTICATION ==
+                    rippassl_cipher_final_verify(check, plaintext,
+                                                 sizeof(plaintext),
+                                                 ciphertext, 16, &decrypted,
+                                                 tag, sizeof(tag)));
+
+        rippassl_cipher_free(gcm);
+        rippassl_cipher_free(check);
+
+        ++numberOfTests;
+        Assert(matching,
+               "librippassl failed the GCM tag round trip!",
+               errorHandler);
+    }
+
+    // RFC 4493, section 4, example 2, through the C CMAC and the HEX codec:
+    {
+        const char keyHex[]     = "2b7e151628aed2a6abf7158809cf4f3c";
+        const char messageHex[] = "6BC1BEE22E409F96E93D7E117393172A";
+        uint8_t macKey[16];
+        uint8_t message[16];
+        uint8_t mac[16];
+        char macHex[32];
+        size_t keyLen = 0, messageLen = 0, macLen = 0, macHexLen = 0;
+        rippassl_cmac* cmac = NULL;
+
+        bool matching =
+            (RIPPASSL_OK == rippassl_hex_decode(macKey, sizeof(macKey),
+                                                keyHex, 32, &keyLen)) &&
+            (RIPPASSL_OK == rippassl_hex_decode(message, sizeof(message),
+                                                messageHex, 32,
+                                                &messageLen)) &&
+            (RIPPASSL_OK == rippassl_cmac_new(&cmac, RIPPASSL_AES128CBC,
+                                              macKey, keyLen)) &&
+            (RIPPASSL_OK == rippassl_cmac_update(cmac, message, 5)) &&
+            (RIPPASSL_OK == rippassl_cmac_final(cmac, message + 5, 11, mac,
+                                                sizeof(mac), &macLen)) &&
+            (RIPPASSL_OK == rippassl_hex_encode(macHex, sizeof(macHex), mac,
+                                                macLen, 1, &macHexLen)) &&
+            (std::string (macHex, macHexLen) ==
+             "070A16B46B4D4144F79BDD9DD04A287C");
+
+        // the same key again, after a reset:
+        matching = matching &&
+                   (RIPPASSL_OK == rippassl_cmac_reset(cmac)) &&
+                   (RIPPASSL_OK == rippassl_cmac_final(cmac, message, 16, mac,
+                                                       sizeof(mac), &macLen)) &&
+                   (0x07 == mac[0]) && (0x7C == mac[15]);
+
+        rippassl_cmac_free(cmac);
+
+        ++numberOfTests;
+        Assert(matching,
+               "librippassl failed the RFC 4493 CMAC test!",
+               errorHandler);
+    }
+
+    // errors come back as codes:
+    {
+        rippassl_cipher* cipher = NULL;
+        rippassl_cmac* cmac = NULL;
+        uint8_t output[16];
+        size_t outputLen = 0;
+
+        bool matching =
+            (RIPPASSL_ERR_KEY_LENGTH ==
+             rippassl_cipher_new(&cipher, RIPPASSL_AES256CBC, RIPPASSL_ENCRYPT,
+                                 key.data(), 16, iv.data(), 16, 0)) &&
+            (NULL == cipher) &&
+            (RIPPASSL_ERR_IV_LENGTH ==
+             rippassl_cipher_new(&cipher, RIPPASSL_AES128CTR, RIPPASSL_ENCRYPT,
+                                 key.data(), 16, NULL, 0, 0)) &&
+            (RIPPASSL_ERR_UNSUPPORTED_MODE ==
+             rippassl_cipher_new(&cipher, 42, RIPPASSL_ENCRYPT,
+                                 key.data(), 16, NULL, 0, 0)) &&
+            (RIPPASSL_ERR_UNSUPPORTED_MODE ==
+             rippassl_cmac_new(&cmac, RIPPASSL_AES128GCM, key.data(), 16)) &&
+            (RIPPASSL_ERR_ENCODING ==
+             rippassl_hex_decode(output, sizeof(output), "0G", 2,
+                                 &outputLen)) &&
+            (RIPPASSL_ERR_ENCODING ==
+             rippassl_hex_decode(output, sizeof(output), "012", 3,
+                                 &outputLen)) &&
+            (RIPPASSL_ERR_BUFFER_TOO_SMALL ==
+             rippassl_hex_decode(output, 1, "0102", 4, &outputLen));
+
+        matching = matching &&
+                   (RIPPASSL_OK ==
+                    rippassl_cipher_new(&cipher, RIPPASSL_AES128ECB,
+                                        RIPPASSL_ENCRYPT, key.data(), 16,
+                                        NULL, 0, 0)) &&
+                   (RIPPASSL_ERR_BUFFER_TOO_SMALL ==
+                    rippassl_cipher_update(cipher, output, sizeof(output),
+                                           key.data(), 16, &outputLen)) &&
+                   (RIPPASSL_ERR_BUFFER_TOO_SMALL ==
+                    rippassl_cipher_update(cipher, output, sizeof(output),
+                                           key.data(), SIZE_MAX - 8,
+                                           &outputLen)) &&
+                   (RIPPASSL_ERR_UNSUPPORTED_MODE ==
+                    rippassl_cipher_update_aad(cipher, key.data(), 16));
+
+        rippassl_cipher_free(cipher);
+
+        ++numberOfTests;
+        Assert(matching,
+               "librippassl failed to report errors with their codes!",
+               errorHandler);
+    }
 
     return std::pair<int, int> {failedTestsCounter, numberOfTests};
 }